@@ -0,0 +1,242 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file activity_monitor.cpp
+///
+/// per-bay disk activity LEDs
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "activity_monitor.h"
+#include "mediasmartserverd.h"
+#include "trace_events.h"
+#include <iostream>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+/// @param sysfs_root Where sysfs is mounted
+/// @param interval Time between samples of busy disks we can't offload (ns)
+/// @param idle_interval Longest time between samples once they are idle (ns)
+ActivityMonitor::ActivityMonitor( const LedControlPtr& leds, Scheduler& scheduler, const std::string& sysfs_root, uint64_t interval, uint64_t idle_interval )
+	:	Scheduler::Task( interval, idle_interval, 25 )
+	,	leds_( leds )
+	,	scheduler_( scheduler )
+	,	sysfs_root_( sysfs_root )
+	,	bpf_( 0 )
+	,	bpf_failures_( 0 )
+	,	reader_( BatchReader::PREAD )
+	,	events_( 0 )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+ActivityMonitor::~ActivityMonitor( ) {
+	while ( !disks_.empty() ) Unbind( disks_.back().led_idx );
+	scheduler_.Remove( this );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// show activity of a block device on a bay
+/// @param name Block device name (e.g. sda)
+void ActivityMonitor::Bind( size_t led_idx, const std::string& name ) {
+	Unbind( led_idx );
+	
+	Disk disk;
+	disk.led_idx	= led_idx;
+	disk.name		= name;
+	disk.source		= Disk::TRIGGER;
+	disk.fd_stat	= -1;
+	disk.slot		= -1;
+	disk.ios		= 0;
+	disk.lit		= false;
+	
+	if ( leds_->SetActivityTrigger( led_idx, "/dev/" + name ) ) {
+		if ( verbose ) std::cout << "Activity [" << led_idx + 1 << "] " << name << ": kernel trigger\n";
+	} else if ( watch_( disk ) ) {
+		if ( verbose ) std::cout << "Activity [" << led_idx + 1 << "] " << name << ": bpf\n";
+		scheduler_.Add( this ); // new disk, so sample quickly
+	} else {
+		disk.source		= Disk::STAT;
+		disk.fd_stat = open( (sysfs_root_ + "/block/" + name + "/stat").c_str(), O_RDONLY | O_CLOEXEC );
+		if ( disk.fd_stat < 0 ) {
+			if ( debug || verbose > 0 ) std::cerr << "Activity [" << led_idx + 1 << "] " << name << ": no stat\n";
+			return;
+		}
+		disk.slot = reader_.Add( disk.fd_stat );
+		if ( disk.slot < 0 ) {
+			close( disk.fd_stat );
+			return;
+		}
+		if ( verbose ) std::cout << "Activity [" << led_idx + 1 << "] " << name << ": sampled\n";
+		reader_.Read( disk.slot );
+		sample_( disk ); // baseline
+		disk.lit = false;
+		scheduler_.Add( this ); // new disk, so sample quickly
+	}
+	
+	disks_.push_back( disk );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop showing activity on a bay
+void ActivityMonitor::Unbind( size_t led_idx ) {
+	for ( size_t i = 0; i < disks_.size(); ++i ) {
+		Disk& disk = disks_[i];
+		if ( led_idx != disk.led_idx ) continue;
+		
+		if ( Disk::TRIGGER == disk.source ) {
+			leds_->SetActivityTrigger( led_idx, "" );
+		} else {
+			if ( disk.lit ) leds_->SetActivity( led_idx, false );
+			if ( led_idx < MAX_BAYS ) busy_[ led_idx ] = false;
+			if ( Disk::BPF == disk.source ) bpf_->Unwatch( led_idx );
+			else {
+				reader_.Remove( disk.slot );
+				close( disk.fd_stat );
+			}
+		}
+		
+		disks_.erase( disks_.begin() + i );
+		if ( 0 == Sampled() ) scheduler_.Remove( this );
+		return;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t ActivityMonitor::Offloaded( ) const {
+	size_t cnt = 0;
+	for ( size_t i = 0; i < disks_.size(); ++i ) {
+		if ( Disk::TRIGGER == disks_[i].source ) ++cnt;
+	}
+	return cnt;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// sample disks, lighting those that did I/O since last time
+/// @returns whether any did I/O
+bool ActivityMonitor::OnTick( uint64_t ) {
+	TraceScope scope( "activity.sample", "activity" );
+	
+	// every bay BPF is counting, and every stat file, in one go each
+	bool bpf_read = false;
+	bool bpf_ok = false;
+	bool stat_read = false;
+	
+	bool any_busy = false;
+	for ( size_t i = 0; i < disks_.size(); ++i ) {
+		Disk& disk = disks_[i];
+		if ( Disk::TRIGGER == disk.source ) continue;
+		
+		if ( Disk::BPF == disk.source ) {
+			if ( !bpf_read ) {
+				bpf_ok = bpf_->Read( );
+				bpf_failures_ = ( bpf_ok ) ? 0 : bpf_failures_ + 1;
+				bpf_read = true;
+			}
+			if ( !bpf_ok ) continue; // (stat disks still get sampled)
+		}
+		if ( Disk::STAT == disk.source && !stat_read ) {
+			reader_.ReadAll( );
+			stat_read = true;
+		}
+		
+		const bool busy = sample_( disk );
+		any_busy |= busy;
+		if ( busy == disk.lit ) continue;
+		leds_->SetActivity( disk.led_idx, busy );
+		disk.lit = busy;
+		if ( disk.led_idx < MAX_BAYS ) busy_[ disk.led_idx ] = busy;
+	}
+	
+	if ( bpf_failures_ >= MAX_BPF_FAILURES ) {
+		dropBpf_( );
+		any_busy = true; // sample the rebound disks soon
+	}
+	
+	if ( events_ ) events_->Activity( busy_ );
+	return any_busy;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// BPF keeps failing: rebind its disks to be sampled from their stat files
+void ActivityMonitor::dropBpf_( ) {
+	if ( debug || verbose > 0 ) std::cerr << "Activity: BPF reads failing, sampling stat instead\n";
+	
+	std::vector< Disk > rebind;
+	for ( size_t i = 0; i < disks_.size(); ++i ) {
+		if ( Disk::BPF == disks_[i].source ) rebind.push_back( disks_[i] );
+	}
+	for ( size_t i = 0; i < rebind.size(); ++i ) Unbind( rebind[i].led_idx );
+	
+	bpf_ = 0;
+	bpf_failures_ = 0;
+	for ( size_t i = 0; i < rebind.size(); ++i ) Bind( rebind[i].led_idx, rebind[i].name );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// have BPF count a disk's I/O
+/// @returns false if there is no BPF or the disk can't be watched
+bool ActivityMonitor::watch_( Disk& disk ) {
+	if ( !bpf_ ) return false;
+	
+	unsigned int major = 0, minor = 0;
+	FILE* dev = fopen( (sysfs_root_ + "/block/" + disk.name + "/dev").c_str(), "re" );
+	if ( !dev ) return false;
+	const bool parsed = ( 2 == fscanf( dev, "%u:%u", &major, &minor ) );
+	fclose( dev );
+	if ( !parsed || !bpf_->Watch( disk.led_idx, major, minor ) ) return false;
+	
+	disk.source = Disk::BPF;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a disk's I/O counters
+/// @returns whether any I/O was issued or completed since the last sample
+bool ActivityMonitor::sample_( Disk& disk ) {
+	if ( Disk::BPF == disk.source ) {
+		const BpfActivity::Counts& counts = bpf_->Bay( disk.led_idx );
+		const unsigned long long ios = counts.issued + counts.completed;
+		const bool busy = ( ios != disk.ios );
+		disk.ios = ios;
+		return busy;
+	}
+	
+	const char* buf = reader_.Data( disk.slot );
+	if ( !*buf ) return false;
+	
+	// reads completed is the first field, writes completed the fifth
+	unsigned long long reads = 0, writes = 0, skip;
+	if ( 5 != sscanf( buf, "%llu %llu %llu %llu %llu", &reads, &skip, &skip, &skip, &writes ) ) return false;
+	
+	const unsigned long long ios = reads + writes;
+	const bool busy = ( ios != disk.ios );
+	disk.ios = ios;
+	return busy;
+}
@@ -0,0 +1,122 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file activity_monitor.h
+///
+/// per-bay disk activity LEDs
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_ACTIVITY_MONITOR
+#define INCLUDED_ACTIVITY_MONITOR
+
+//- includes
+#include "batch_reader.h"
+#include "bpf_activity.h"
+#include "event_stream.h"
+#include "led_control_base.h"
+#include "scheduler.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// per-bay disk activity LEDs
+///
+/// Bays are handed to the kernel (blkdev LED trigger) where the LED
+/// interface can do that, costing us nothing. Otherwise the disk's I/O
+/// counts are sampled by the scheduler, only while there is such a disk:
+/// every interval while the disks are busy, backing off to the idle
+/// interval once they go quiet. Counts come from BPF (all bays in one
+/// syscall) when given a BpfActivity, else each /sys/block/<name>/stat
+/// (all read in one batch, through io_uring if asked).
+class ActivityMonitor : public Scheduler::Task {
+public:
+	/// default time between samples
+	static const uint64_t SAMPLE_INTERVAL = 100000000ULL;
+	/// default time between samples of idle disks
+	static const uint64_t IDLE_INTERVAL = 3200000000ULL;
+	/// failed BPF reads in a row before its disks are sampled from stat
+	static const unsigned int MAX_BPF_FAILURES = 3;
+	
+	ActivityMonitor( const LedControlPtr& leds, Scheduler& scheduler, const std::string& sysfs_root, uint64_t interval = SAMPLE_INTERVAL, uint64_t idle_interval = IDLE_INTERVAL );
+	~ActivityMonitor( );
+	
+	/// count I/O in the kernel where we can (optional)
+	void Bpf( BpfActivity* bpf ) { bpf_ = bpf; }
+	/// tell subscribers which bays are showing activity
+	void Events( EventStream* events ) { events_ = events; }
+	
+	/// batch stat reads through io_uring where we can (otherwise pread)
+	void Uring( bool use ) { reader_.SetMode( ( use ) ? BatchReader::AUTO : BatchReader::PREAD ); }
+	
+	void Bind( size_t led_idx, const std::string& name );
+	void Unbind( size_t led_idx );
+	
+	/// bays the kernel is blinking for us
+	size_t Offloaded( ) const;
+	/// bays we are sampling
+	size_t Sampled( ) const { return disks_.size() - Offloaded(); }
+	
+	bool OnTick( uint64_t now );
+	const char* TraceName( ) const { return "activity"; }
+	
+private:
+	// no copying
+	ActivityMonitor( const ActivityMonitor& rhs );
+	const ActivityMonitor& operator=( const ActivityMonitor& rhs );
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// a disk with an activity LED
+	struct Disk {
+		/// where its activity comes from
+		enum Source {
+			TRIGGER,	///< kernel blinks the LED
+			BPF,		///< counted by BPF
+			STAT,		///< /sys/block/<name>/stat
+		};
+		
+		size_t				led_idx;	///< which bay
+		std::string			name;		///< block device (e.g. sda)
+		Source				source;		///< activity source
+		int					fd_stat;	///< /sys/block/<name>/stat (-1 unless STAT)
+		int					slot;		///< stat's slot in the reader
+		unsigned long long	ios;		///< I/Os at the last sample
+		bool				lit;		///< showing activity
+	};
+	
+	bool watch_( Disk& disk );
+	bool sample_( Disk& disk );
+	void dropBpf_( );
+	
+	LedControlPtr		leds_;			///< led control interface
+	Scheduler&			scheduler_;		///< runs our samples
+	std::string			sysfs_root_;	///< where sysfs is mounted
+	BpfActivity*		bpf_;			///< in-kernel counts (optional)
+	unsigned int		bpf_failures_;	///< failed BPF reads in a row
+	BatchReader			reader_;		///< reads the stat files
+	EventStream*		events_;		///< subscribers (optional)
+	BaySet				busy_;			///< bays showing activity
+	std::vector< Disk >	disks_;			///< bound disks
+};
+
+#endif // INCLUDED_ACTIVITY_MONITOR
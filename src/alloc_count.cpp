@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file alloc_count.cpp
+///
+/// allocation counting for benchmarks
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "bench.h"
+#include <new>
+#include <stdlib.h>
+
+// Replacement global operator new/delete that count allocations. Kept in
+// its own translation unit so the compiler never sees malloc/free pairs
+// through inlining.
+
+//- globals
+static unsigned long allocations = 0;	///< calls to operator new
+
+void* operator new( size_t size ) {
+	__atomic_fetch_add( &allocations, 1, __ATOMIC_RELAXED );
+	void* ptr = malloc( size ? size : 1 );
+	if ( !ptr ) throw std::bad_alloc( );
+	return ptr;
+}
+void* operator new[]( size_t size ) { return operator new( size ); }
+void operator delete( void* ptr ) throw() { free( ptr ); }
+void operator delete[]( void* ptr ) throw() { free( ptr ); }
+void operator delete( void* ptr, size_t ) throw() { free( ptr ); }
+void operator delete[]( void* ptr, size_t ) throw() { free( ptr ); }
+
+/////////////////////////////////////////////////////////////////////////////
+/// allocations made by operator new so far
+unsigned long bench_allocations( ) {
+	return __atomic_load_n( &allocations, __ATOMIC_RELAXED );
+}
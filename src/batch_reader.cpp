@@ -0,0 +1,263 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file batch_reader.cpp
+///
+/// reads a set of small files in one go (io_uring, or pread)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "batch_reader.h"
+#include "mediasmartserverd.h"
+#include <algorithm>
+#include <iostream>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+	unsigned* ring_field( void* ring, unsigned offset ) {
+		return reinterpret_cast< unsigned* >( static_cast< char* >( ring ) + offset );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (the ring is only set up once there is something to read)
+BatchReader::BatchReader( Mode mode )
+	:	mode_( mode )
+	,	fds_( MAX_FILES, -1 )
+	,	buf_( MAX_FILES * BUF_SIZE, 0 )
+	,	used_( 0 )
+	,	syscalls_( 0 )
+	,	ring_fd_( -1 )
+	,	ring_tried_( PREAD == mode )
+	,	rings_( MAP_FAILED )
+	,	rings_size_( 0 )
+	,	sqes_( MAP_FAILED )
+	,	sqes_size_( 0 )
+	,	sq_tail_( 0 ), sq_mask_( 0 ), sq_array_( 0 )
+	,	cq_head_( 0 ), cq_tail_( 0 ), cq_mask_( 0 ), cqes_( 0 )
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor (the files are the caller's to close)
+BatchReader::~BatchReader( ) {
+	teardown_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// change how we read (io_uring is set up on the next batch)
+void BatchReader::SetMode( Mode mode ) {
+	if ( mode == mode_ ) return;
+	
+	mode_ = mode;
+	teardown_( );
+	ring_tried_ = ( PREAD == mode );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a file every batch
+/// @returns its slot, or -1 if full
+int BatchReader::Add( int fd ) {
+	for ( size_t slot = 0; slot < fds_.size(); ++slot ) {
+		if ( fds_[ slot ] >= 0 ) continue;
+		
+		fds_[ slot ] = fd;
+		buf_[ slot * BUF_SIZE ] = 0;
+		++used_;
+		if ( Uring() && !update_( slot, fd ) ) teardown_( );
+		return slot;
+	}
+	return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop reading a file (before closing it)
+void BatchReader::Remove( int slot ) {
+	if ( slot < 0 || size_t(slot) >= fds_.size() || fds_[ slot ] < 0 ) return;
+	
+	fds_[ slot ] = -1;
+	--used_;
+	if ( Uring() && !update_( slot, -1 ) ) teardown_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read every file
+void BatchReader::ReadAll( ) {
+	if ( !used_ ) return;
+	if ( !ring_tried_ ) setup_( );
+	if ( Uring() && readUring_() ) return;
+	
+	for ( size_t slot = 0; slot < fds_.size(); ++slot ) {
+		if ( fds_[ slot ] >= 0 ) readPread_( slot );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read one file (e.g. for a baseline when it is added)
+void BatchReader::Read( int slot ) {
+	if ( slot >= 0 && size_t(slot) < fds_.size() && fds_[ slot ] >= 0 ) readPread_( slot );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// create the ring, register our buffers and files
+/// @returns false (having fallen back to pread) if we can't
+bool BatchReader::setup_( ) {
+	ring_tried_ = true;
+	
+	struct io_uring_params params;
+	memset( &params, 0, sizeof(params) );
+	ring_fd_ = syscall( __NR_io_uring_setup, MAX_FILES, &params );
+	if ( ring_fd_ < 0 ) {
+		if ( debug || verbose > 1 ) std::cout << "No io_uring (" << strerror( errno ) << "), reading with pread\n";
+		return false;
+	}
+	
+	// both rings in one mapping where the kernel allows it
+	const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if ( !( params.features & IORING_FEAT_SINGLE_MMAP ) ) {
+		teardown_( );
+		return false;
+	}
+	rings_size_ = std::max( sq_size, cq_size );
+	rings_ = mmap( 0, rings_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING );
+	sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes_ = mmap( 0, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES );
+	if ( MAP_FAILED == rings_ || MAP_FAILED == sqes_ ) {
+		teardown_( );
+		return false;
+	}
+	
+	sq_tail_	= ring_field( rings_, params.sq_off.tail );
+	sq_mask_	= ring_field( rings_, params.sq_off.ring_mask );
+	sq_array_	= ring_field( rings_, params.sq_off.array );
+	cq_head_	= ring_field( rings_, params.cq_off.head );
+	cq_tail_	= ring_field( rings_, params.cq_off.tail );
+	cq_mask_	= ring_field( rings_, params.cq_off.ring_mask );
+	cqes_		= static_cast< char* >( rings_ ) + params.cq_off.cqes;
+	
+	// one buffer for every slot, and a (sparse) table of every slot's file
+	struct iovec iov = { &buf_[0], buf_.size() };
+	if ( syscall( __NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS, &iov, 1 ) ||
+		 syscall( __NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, &fds_[0], fds_.size() ) )
+	{
+		if ( debug || verbose > 1 ) std::cout << "Can't register with io_uring (" << strerror( errno ) << "), reading with pread\n";
+		teardown_( );
+		return false;
+	}
+	
+	if ( debug || verbose > 1 ) std::cout << "Reading " << used_ << " file(s) with io_uring\n";
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// drop the ring (back to pread)
+void BatchReader::teardown_( ) {
+	if ( MAP_FAILED != sqes_ ) munmap( sqes_, sqes_size_ );
+	if ( MAP_FAILED != rings_ ) munmap( rings_, rings_size_ );
+	if ( ring_fd_ >= 0 ) close( ring_fd_ );
+	sqes_ = rings_ = MAP_FAILED;
+	ring_fd_ = -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// change a slot in the registered file table
+bool BatchReader::update_( int slot, int fd ) {
+	struct io_uring_files_update update;
+	memset( &update, 0, sizeof(update) );
+	update.offset	= slot;
+	update.fds		= (uintptr_t)&fd;
+	return 1 == syscall( __NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES_UPDATE, &update, 1 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// submit a read for every slot and wait for them all
+/// @returns false (having fallen back to pread) if the ring failed
+bool BatchReader::readUring_( ) {
+	struct io_uring_sqe* sqes = static_cast< struct io_uring_sqe* >( sqes_ );
+	struct io_uring_cqe* cqes = static_cast< struct io_uring_cqe* >( cqes_ );
+	
+	// we are the only submitter, and everything submitted is reaped below
+	unsigned tail = *sq_tail_;
+	unsigned submitted = 0;
+	for ( size_t slot = 0; slot < fds_.size(); ++slot ) {
+		if ( fds_[ slot ] < 0 ) continue;
+		
+		const unsigned idx = tail & *sq_mask_;
+		struct io_uring_sqe& sqe = sqes[ idx ];
+		memset( &sqe, 0, sizeof(sqe) );
+		sqe.opcode		= IORING_OP_READ_FIXED;
+		sqe.flags		= IOSQE_FIXED_FILE;
+		sqe.fd			= slot;
+		sqe.addr		= (uintptr_t)&buf_[ slot * BUF_SIZE ];
+		sqe.len			= BUF_SIZE - 1;
+		sqe.off			= 0;
+		sqe.buf_index	= 0;
+		sqe.user_data	= slot;
+		sq_array_[ idx ] = idx;
+		++tail;
+		++submitted;
+	}
+	__atomic_store_n( sq_tail_, tail, __ATOMIC_RELEASE );
+	
+	unsigned to_submit = submitted;
+	unsigned reaped = 0;
+	while ( reaped < submitted ) {
+		++syscalls_;
+		const int res = syscall( __NR_io_uring_enter, ring_fd_, to_submit, submitted - reaped, IORING_ENTER_GETEVENTS, 0, 0 );
+		if ( res < 0 && EINTR != errno ) {
+			if ( debug || verbose > 0 ) std::cerr << "io_uring_enter: " << strerror( errno ) << ", reading with pread\n";
+			teardown_( );
+			return false;
+		}
+		if ( res > 0 ) to_submit -= std::min( to_submit, unsigned(res) );
+		
+		unsigned head = *cq_head_;
+		const unsigned cq_tail = __atomic_load_n( cq_tail_, __ATOMIC_ACQUIRE );
+		for ( ; head != cq_tail; ++head, ++reaped ) {
+			const struct io_uring_cqe& cqe = cqes[ head & *cq_mask_ ];
+			const size_t slot = cqe.user_data;
+			buf_[ slot * BUF_SIZE + ( ( cqe.res > 0 ) ? cqe.res : 0 ) ] = 0;
+		}
+		__atomic_store_n( cq_head_, head, __ATOMIC_RELEASE );
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a slot with pread
+void BatchReader::readPread_( int slot ) {
+	++syscalls_;
+	char* buf = &buf_[ slot * BUF_SIZE ];
+	const ssize_t len = pread( fds_[ slot ], buf, BUF_SIZE - 1, 0 );
+	buf[ ( len > 0 ) ? len : 0 ] = 0;
+}
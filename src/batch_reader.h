@@ -0,0 +1,115 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file batch_reader.h
+///
+/// reads a set of small files in one go (io_uring, or pread)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_BATCH_READER
+#define INCLUDED_BATCH_READER
+
+//- includes
+#include "led_control_base.h"
+#include <stdint.h>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// reads a set of small, kept open files (sysfs/procfs attributes) from
+/// the start, all at once
+///
+/// With io_uring the files and a buffer per file are registered with the
+/// kernel and every read for a tick goes in (and comes back out) with a
+/// single io_uring_enter. Where io_uring isn't there (old kernel, disabled
+/// by sysctl or seccomp) it falls back to a pread per file.
+///
+/// Fewer syscalls isn't always cheaper: sysfs can't be read without
+/// blocking, so io_uring hands those reads to its worker threads, which
+/// can cost more than the preads (see the sample_* benchmarks).
+class BatchReader {
+public:
+	enum {
+		MAX_FILES	= MAX_BAYS,	///< most files
+		BUF_SIZE	= 256,		///< bytes read from each (a block stat line fits)
+	};
+	
+	/// how to read
+	enum Mode {
+		AUTO,	///< io_uring if we can
+		PREAD,	///< a pread per file
+	};
+	
+	explicit BatchReader( Mode mode = AUTO );
+	~BatchReader( );
+	
+	void SetMode( Mode mode );
+	
+	int Add( int fd );
+	void Remove( int slot );
+	
+	void ReadAll( );
+	void Read( int slot );
+	
+	/// what was read from a slot (nul terminated, empty if the read failed)
+	const char* Data( int slot ) const { return &buf_[ slot * BUF_SIZE ]; }
+	
+	/// reading with io_uring
+	bool Uring( ) const { return ring_fd_ >= 0; }
+	/// syscalls made reading
+	unsigned long Syscalls( ) const { return syscalls_; }
+	
+private:
+	// no copying
+	BatchReader( const BatchReader& rhs );
+	const BatchReader& operator=( const BatchReader& rhs );
+	
+	bool setup_( );
+	void teardown_( );
+	bool update_( int slot, int fd );
+	bool readUring_( );
+	void readPread_( int slot );
+	
+	Mode				mode_;		///< how we were asked to read
+	std::vector< int >	fds_;		///< fd per slot (-1 if free)
+	std::vector< char >	buf_;		///< BUF_SIZE bytes per slot
+	size_t				used_;		///< slots in use
+	unsigned long		syscalls_;	///< syscalls made reading
+	
+	// io_uring (ring_fd_ < 0 until set up, or if we can't)
+	int					ring_fd_;		///< the ring
+	bool				ring_tried_;	///< don't keep trying to set up
+	void*				rings_;			///< submission and completion rings
+	size_t				rings_size_;	///< their mapping
+	void*				sqes_;			///< submission queue entries
+	size_t				sqes_size_;		///< their mapping
+	unsigned*			sq_tail_;		///< where we submit
+	unsigned*			sq_mask_;
+	unsigned*			sq_array_;
+	unsigned*			cq_head_;		///< where we reap
+	unsigned*			cq_tail_;
+	unsigned*			cq_mask_;
+	void*				cqes_;			///< completion entries
+};
+
+#endif // INCLUDED_BATCH_READER
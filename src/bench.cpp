@@ -0,0 +1,840 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file bench.cpp
+///
+/// benchmarks and regression gate
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "bench.h"
+#include "batch_reader.h"
+#include "coro.h"
+#include "device_monitor.h"
+#include "errno_exception.h"
+#include "journal.h"
+#include "led_committer.h"
+#include "led_gpio.h"
+#include "led_sysfs.h"
+#include "light_show.h"
+#include "mediasmartserverd.h"
+#include "sim_gpio_lines.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+
+using std::cout;
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// results of a single benchmark
+struct BenchResult {
+	BenchResult( ) : ns_per_op( 0 ), port_ops_per_op( 0 ), allocs_per_op( 0 ), ops_per_sec( 0 ) { }
+	
+	std::string	name;
+	double		ns_per_op;
+	double		port_ops_per_op;
+	double		allocs_per_op;
+	double		ops_per_sec;
+};
+typedef std::vector< BenchResult > ListBenchResults;
+
+/////////////////////////////////////////////////////////////////////////////
+/// behaviour checked along the way (any failure fails the run)
+typedef std::vector< std::string > ListFailures;
+
+void check( ListFailures& failures, bool ok, const std::string& what ) {
+	if ( !ok ) failures.push_back( what );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// something to benchmark (Run performs `ops` operations)
+class Benchmark {
+public:
+	virtual ~Benchmark( ) { }
+	virtual void Run( unsigned long ops ) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// time a benchmark, counting port I/O (or GPIO ioctls) and allocations
+template < class SimIoPtr >
+BenchResult measure( const std::string& name, Benchmark& bench, const SimIoPtr& io, unsigned long ops ) {
+	RealClock clock;
+	
+	bench.Run( ops / 10 + 1 ); // warm up
+	
+	// best of a few runs to keep noise out of the timings
+	uint64_t elapsed = ~0ULL;
+	unsigned long allocs = 0;
+	for ( int run = 0; run < 3; ++run ) {
+		io->ResetCounters( );
+		allocs = bench_allocations( );
+		const uint64_t start = clock.Now( );
+		bench.Run( ops );
+		elapsed = std::min( elapsed, clock.Now( ) - start );
+		allocs = bench_allocations( ) - allocs;
+	}
+	
+	BenchResult res;
+	res.name			= name;
+	res.ns_per_op		= double(elapsed) / ops;
+	res.port_ops_per_op	= double(io->Ops()) / ops;
+	res.allocs_per_op	= double(allocs) / ops;
+	res.ops_per_sec		= ( elapsed ) ? ops * 1e9 / elapsed : 0;
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// toggle bay LEDs
+class BenchLedSet : public Benchmark {
+public:
+	BenchLedSet( const LedControlPtr& leds ) : leds_( leds ) { }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) leds_->Set( (i & 4) ? LED_RED : LED_BLUE, i & 3, i & 8 );
+	}
+private:
+	LedControlPtr leds_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// read back bay LEDs
+class BenchLedGet : public Benchmark {
+public:
+	BenchLedGet( const LedControlPtr& leds ) : leds_( leds ), sink_( 0 ) { }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) sink_ += leds_->Get( i & 3 );
+	}
+private:
+	LedControlPtr leds_;
+	int sink_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// switch the system LED between states
+class BenchSystemLed : public Benchmark {
+public:
+	BenchSystemLed( const LedControlPtr& leds ) : leds_( leds ) { }
+	void Run( unsigned long ops ) {
+		const LedState STATES[] = { LED_OFF, LED_ON, LED_BLINK };
+		for ( unsigned long i = 0; i < ops; ++i ) leds_->SetSystemLed( LED_BLUE, STATES[ i % 3 ] );
+	}
+private:
+	LedControlPtr leds_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// kick an armed watchdog
+class BenchWatchdogKick : public Benchmark {
+public:
+	BenchWatchdogKick( const LedControlPtr& leds ) : leds_( leds ) { leds_->ArmWatchdog( 240 ); }
+	~BenchWatchdogKick( ) { leds_->DisarmWatchdog( ); }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) leds_->KickWatchdog( );
+	}
+private:
+	LedControlPtr leds_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// hotplug events through the device monitor
+class BenchMonitor : public Benchmark {
+public:
+	BenchMonitor( const LedControlPtr& leds ) {
+		monitor_.Attach( leds );
+		for ( int host = 0; host < 4; ++host ) {
+			events_.push_back( SyntheticDeviceEvent( "add", host, "pci" ) );
+			events_.push_back( SyntheticDeviceEvent( "remove", host, "pci" ) );
+		}
+		events_.push_back( SyntheticDeviceEvent( "add", 4, "usb" ) );
+		events_.push_back( SyntheticDeviceEvent( "change", 0, "pci" ) );
+	}
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) monitor_.Dispatch( events_[ i % events_.size() ] );
+	}
+private:
+	DeviceMonitor		monitor_;
+	ListDeviceEvents	events_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// recorded trace through the device monitor (an enumeration counts as one op)
+class BenchReplay : public Benchmark {
+public:
+	BenchReplay( const LedControlPtr& leds, const DeviceTrace& trace ) : pos_( 0 ) {
+		monitor_.Attach( leds );
+		for ( size_t i = 0; i < trace.events.size(); ++i ) {
+			const bool enumerated = ( "enum" == trace.events[i].action );
+			if ( !enumerated || steps_.empty() || "enum" != steps_.back().back().action ) {
+				steps_.push_back( ListDeviceEvents() );
+			}
+			steps_.back().push_back( trace.events[i] );
+		}
+	}
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) {
+			const ListDeviceEvents& step = steps_[ pos_ ];
+			if ( ++pos_ >= steps_.size() ) pos_ = 0;
+			
+			if ( "enum" == step.front().action ) monitor_.Enumerated( step );
+			else monitor_.Dispatch( step.front() );
+		}
+	}
+private:
+	DeviceMonitor		monitor_;
+	std::vector< ListDeviceEvents > steps_;
+	size_t				pos_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// render light show frames
+class BenchLightShow : public Benchmark {
+public:
+	BenchLightShow( const LedControlPtr& leds, int light_show ) : show_( leds, light_show, 1 ) { }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) show_.Frame( );
+	}
+private:
+	LightShow show_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// light show frames queued through the committer (one commit per frame)
+class BenchCommittedShow : public Benchmark {
+public:
+	BenchCommittedShow( const LedControlPtr& leds, int light_show )
+		:	loop_( ClockPtr( new VirtualClock ) )
+		,	committer_( new LedCommitter( leds, loop_ ) )
+		,	show_( committer_, light_show, 1 )
+	{ }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) {
+			show_.Frame( );
+			committer_->Commit( );
+		}
+	}
+	LedControlPtr Leds( ) const { return committer_; }
+private:
+	EventLoop							loop_;
+	std::tr1::shared_ptr< LedCommitter >	committer_;
+	LightShow							show_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// intents through the queue on their own
+class BenchIntentQueue : public Benchmark {
+public:
+	BenchIntentQueue( ) : queue_( LedCommitter::QUEUE_SIZE ) { }
+	void Run( unsigned long ops ) {
+		LedIntent intent = { LedIntent::SET, 0, 0, 0 };
+		for ( unsigned long i = 0; i < ops; ++i ) {
+			intent.led_idx = i & 3;
+			queue_.Push( intent );
+			queue_.Pop( intent );
+		}
+	}
+private:
+	LedIntentQueue queue_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// a tick's worth of block stat reads for a number of bays (regular files
+/// standing in for /sys/block/<disk>/stat)
+class BenchSampling : public Benchmark {
+public:
+	BenchSampling( size_t bays, BatchReader::Mode mode ) : reader_( mode ), sink_( 0 ) {
+		char tmpl[] = "/tmp/mediasmartserverd-bench.XXXXXX";
+		if ( !mkdtemp( tmpl ) ) throw ErrnoException( "mkdtemp" );
+		root_ = tmpl;
+		
+		for ( size_t bay = 0; bay < bays; ++bay ) {
+			std::ostringstream path;
+			path << root_ << "/stat" << bay;
+			std::ofstream( path.str().c_str() ) << "  " << 1000 + bay << " 0 8000 0 " << 500 + bay << " 0 4000 0 0 0 0 0 0 0 0 0 0\n";
+			paths_.push_back( path.str() );
+			
+			const int fd = open( path.str().c_str(), O_RDONLY | O_CLOEXEC );
+			if ( fd < 0 ) throw ErrnoException( path.str() );
+			fds_.push_back( fd );
+			reader_.Add( fd );
+		}
+	}
+	~BenchSampling( ) {
+		for ( size_t i = 0; i < fds_.size(); ++i ) close( fds_[i] );
+		for ( size_t i = 0; i < paths_.size(); ++i ) remove( paths_[i].c_str() );
+		rmdir( root_.c_str() );
+	}
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) {
+			reader_.ReadAll( );
+			for ( size_t slot = 0; slot < fds_.size(); ++slot ) sink_ += reader_.Data( slot )[2];
+		}
+	}
+private:
+	BatchReader					reader_;
+	std::string					root_;
+	std::vector< std::string >	paths_;
+	std::vector< int >			fds_;
+	unsigned long				sink_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// journal records (a throwaway journal, wrapping many times over)
+class BenchJournal : public Benchmark {
+public:
+	BenchJournal( ) : devpath_( "/devices/pci0000:00/0000:00:1f.2/host2/target2:0:0/2:0:0:0" ) {
+		char tmpl[] = "/tmp/mediasmartserverd-bench.XXXXXX";
+		const int fd = mkstemp( tmpl );
+		if ( fd < 0 ) throw ErrnoException( "mkstemp" );
+		close( fd );
+		path_ = tmpl;
+		Journal::Enable( path_, 64 * 1024 );
+	}
+	~BenchJournal( ) {
+		Journal::Disable( );
+		remove( path_.c_str() );
+	}
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) Journal::Bay( i & 3, i & 4, devpath_ );
+	}
+private:
+	std::string path_;
+	std::string devpath_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// a job that notes when it ran and how many ran at once alongside it
+class BenchJob : public WorkerPool::Job {
+public:
+	BenchJob( int* active = 0, int* most = 0, useconds_t sleep_us = 0, int* completions = 0 )
+		:	active_( active ), most_( most ), sleep_us_( sleep_us ), completions_( completions ), ran( false ), completed( false ), order( -1 ) { }
+	void Run( ) {
+		if ( active_ ) {
+			const int now = __atomic_add_fetch( active_, 1, __ATOMIC_ACQ_REL );
+			int most = __atomic_load_n( most_, __ATOMIC_ACQUIRE );
+			while ( now > most && !__atomic_compare_exchange_n( most_, &most, now, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) { }
+		}
+		if ( sleep_us_ ) usleep( sleep_us_ );
+		if ( active_ ) __atomic_sub_fetch( active_, 1, __ATOMIC_ACQ_REL );
+		__atomic_store_n( &ran, true, __ATOMIC_RELEASE );
+	}
+	void Complete( ) {
+		completed = true;
+		if ( completions_ ) order = (*completions_)++;
+	}
+	
+private:
+	int*		active_;		///< jobs running on this key
+	int*		most_;			///< most that ever did
+	useconds_t	sleep_us_;		///< how long to block
+	int*		completions_;	///< Complete() calls so far (optional)
+	
+public:
+	bool		ran;			///< Run() was called
+	bool		completed;		///< Complete() was called
+	int			order;			///< completions before ours (-1 if not counted)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// does nothing (bounds how long a check may wait on the loop)
+class BenchGiveUp : public EventLoop::Timer {
+public:
+	void OnTimer( uint64_t ) { }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// one loop wakeup (nothing here signals it, so it must never stop)
+void run_once( ListFailures& failures, EventLoop& loop ) {
+	check( failures, loop.RunOnce( ), "event loop: stopped without a signal" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a trivial function on a worker and back
+CoTask bench_offload( WorkerPool& pool, int& ran, bool& resumed ) {
+	co_await CoOffload( pool, [&ran]( ) { __atomic_store_n( &ran, 1, __ATOMIC_RELEASE ); } );
+	resumed = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// jobs through a worker pool: deadlines, cancelling, per disk ordering,
+/// and destroying a coroutine whose job finished but wasn't delivered
+void check_worker_pool( ListFailures& failures ) {
+	EventLoop loop( ClockPtr( new RealClock ) );
+	WorkerPool pool( loop, 2 );
+	BenchGiveUp give_up;
+	loop.Arm( &give_up, loop.Now( ) + sec_to_ns( 5 ) );
+	
+	// all on one disk: the first blocks long enough for the deadline to pass
+	int active = 0, most = 0;
+	BenchJob slow( &active, &most, 50000 ), same( &active, &most ), expiring( &active, &most ), cancelled( &active, &most );
+	pool.Submit( &slow, 1 );
+	pool.Submit( &same, 1 );
+	pool.Submit( &expiring, 1, loop.Now( ) + ms_to_ns( 10 ) );
+	pool.Submit( &cancelled, 1 );
+	pool.Cancel( &cancelled );
+	while ( !( slow.completed && same.completed && expiring.completed && cancelled.completed ) && give_up.Armed() ) run_once( failures, loop );
+	
+	check( failures, WorkerPool::Job::DONE == slow.GetStatus() && WorkerPool::Job::DONE == same.GetStatus(), "worker pool: jobs on one disk both ran" );
+	check( failures, 1 == most, "worker pool: jobs on one disk never overlap" );
+	check( failures, WorkerPool::Job::EXPIRED == expiring.GetStatus() && !expiring.ran, "worker pool: a job past its deadline expires unrun" );
+	check( failures, WorkerPool::Job::CANCELLED == cancelled.GetStatus() && !cancelled.ran, "worker pool: a cancelled job never runs" );
+	
+	// all finished before the loop hears of any: completed in the order queued
+	const size_t IN_ORDER = 5;
+	int completions = 0;
+	std::vector< BenchJob > in_order( IN_ORDER, BenchJob( 0, 0, 0, &completions ) );
+	for ( size_t i = 0; i < IN_ORDER; ++i ) pool.Submit( &in_order[i], 2 );
+	while ( !__atomic_load_n( &in_order.back().ran, __ATOMIC_ACQUIRE ) ) usleep( 1000 );
+	usleep( 10000 ); // for the last to be handed back
+	while ( completions < int(IN_ORDER) && give_up.Armed() ) run_once( failures, loop );
+	bool ordered = true;
+	for ( size_t i = 0; i < IN_ORDER; ++i ) ordered &= ( int(i) == in_order[i].order );
+	check( failures, ordered, "worker pool: jobs on one disk complete in the order queued" );
+	
+	// finished on the thread, coroutine gone before the loop hears of it
+	int ran = 0;
+	bool resumed = false;
+	CoTask task = bench_offload( pool, ran, resumed );
+	while ( !__atomic_load_n( &ran, __ATOMIC_ACQUIRE ) ) usleep( 1000 );
+	usleep( 10000 ); // for it to be handed back
+	const unsigned long completed = pool.Completed( );
+	task.Reset( );
+	run_once( failures, loop );
+	check( failures, !resumed && completed == pool.Completed(), "worker pool: a destroyed coroutine's finished job isn't completed" );
+	
+	loop.Cancel( &give_up );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// sleep on the loop, noting when we woke
+CoTask bench_sleep( EventLoop& loop, uint64_t ns, uint64_t& woke ) {
+	co_await CoSleep( loop, ns );
+	woke = loop.Now( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// coroutine waiting for a file descriptor
+CoTask bench_read( CoFd& fd, bool& resumed ) {
+	co_await fd.Readable( );
+	resumed = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// sleeping coroutines wake on time, lose their timer when destroyed and
+/// hand their frames back; an fd that outlives its reader doesn't wake it
+void check_coroutines( ListFailures& failures ) {
+	EventLoop loop( ClockPtr( new RealClock ) );
+	BenchGiveUp give_up;
+	loop.Arm( &give_up, loop.Now( ) + sec_to_ns( 5 ) );
+	const size_t frames = CoArena::InUse( );
+	
+	const uint64_t start = loop.Now( );
+	uint64_t woke = 0, never = 0;
+	CoTask sleeper = bench_sleep( loop, ms_to_ns( 5 ), woke );
+	CoTask destroyed = bench_sleep( loop, ms_to_ns( 1 ), never );
+	destroyed.Reset( );
+	while ( !woke && give_up.Armed() ) run_once( failures, loop );
+	check( failures, woke >= start + ms_to_ns( 5 ), "coroutines: a sleep wakes no earlier than asked" );
+	check( failures, !never, "coroutines: a destroyed sleeper never wakes" );
+	
+	sleeper.Reset( );
+	check( failures, frames == CoArena::InUse(), "coroutines: finished frames go back to the arena" );
+	
+	const int efd = eventfd( 0, EFD_NONBLOCK );
+	if ( efd < 0 ) throw ErrnoException( "eventfd" );
+	{
+		CoFd fd( loop, efd, "bench" );
+		bool resumed = false;
+		CoTask reader = bench_read( fd, resumed );
+		reader.Reset( );
+		const uint64_t one = 1;
+		if ( write( efd, &one, sizeof(one) ) < 0 ) throw ErrnoException( "eventfd write" );
+		run_once( failures, loop );
+		check( failures, !resumed, "coroutines: an fd doesn't resume a destroyed reader" );
+	}
+	close( efd );
+	
+	loop.Cancel( &give_up );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a trivial function through a worker thread and back, per op
+class BenchOffload : public Benchmark {
+public:
+	BenchOffload( ) : loop_( ClockPtr( new RealClock ) ), pool_( loop_, 1 ) { }
+	void Run( unsigned long ops ) {
+		for ( unsigned long i = 0; i < ops; ++i ) {
+			int ran = 0;
+			bool resumed = false;
+			CoTask task = bench_offload( pool_, ran, resumed );
+			while ( !resumed ) {
+				if ( !loop_.RunOnce( ) ) throw std::runtime_error( "Event loop stopped without a signal" );
+			}
+		}
+	}
+private:
+	EventLoop	loop_;
+	WorkerPool	pool_;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// a throwaway /sys/class/leds with four bays and system LEDs
+class FakeLedClass {
+public:
+	FakeLedClass( ) {
+		char tmpl[] = "/tmp/mediasmartserverd-bench.XXXXXX";
+		if ( !mkdtemp( tmpl ) ) throw ErrnoException( "mkdtemp" );
+		root_ = tmpl;
+		mkdir_( "/class" );
+		mkdir_( "/class/leds" );
+		
+		std::ofstream map( (root_ + "/leds.map").c_str() );
+		const char* const COLOURS[] = { "blue", "red" };
+		for ( int bay = -1; bay < 4; ++bay ) {
+			for ( int c = 0; c < 2; ++c ) {
+				std::ostringstream name;
+				name << "bench:" << COLOURS[c] << ':' << ( (bay < 0) ? std::string("system") : "hdd" + std::string( 1, char('0' + bay) ) );
+				addLed_( name.str() );
+				if ( bay < 0 ) map << "system";
+				else map << bay;
+				map << ' ' << COLOURS[c] << ' ' << name.str() << '\n';
+			}
+		}
+		files_.push_back( "/leds.map" );
+	}
+	~FakeLedClass( ) {
+		for ( size_t i = files_.size(); i-- > 0; ) remove( (root_ + files_[i]).c_str() );
+		rmdir( root_.c_str() );
+	}
+	
+	const std::string& Root( ) const { return root_; }
+	std::string Map( ) const { return root_ + "/leds.map"; }
+	
+private:
+	void mkdir_( const std::string& path ) {
+		if ( mkdir( (root_ + path).c_str(), 0700 ) ) throw ErrnoException( root_ + path );
+		files_.push_back( path );
+	}
+	void addLed_( const std::string& name ) {
+		const std::string dir = "/class/leds/" + name;
+		mkdir_( dir );
+		const char* const ATTRS[][2] = { { "brightness", "0" }, { "max_brightness", "255" }, { "trigger", "[none] timer" } };
+		for ( size_t i = 0; i < sizeof(ATTRS) / sizeof(ATTRS[0]); ++i ) {
+			const std::string path = dir + '/' + ATTRS[i][0];
+			std::ofstream( (root_ + path).c_str() ) << ATTRS[i][1] << '\n';
+			files_.push_back( path );
+		}
+	}
+	
+	std::string root_;
+	std::vector< std::string > files_;	///< relative to root_ (in creation order)
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// initialised simulated LED interface
+LedControlPtr sim_leds( const SimPortIoPtr& io ) {
+	LedControlPtr leds = get_led_interface( io );
+	if ( !leds ) throw std::runtime_error( "Simulated board failed to initialise" );
+	return leds;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a busy disk pulled (as DeviceMonitor queues it) and one that goes busy,
+/// each in one frame, must leave the hardware showing the last intent
+void check_committed_activity( ListFailures& failures, const LedControlPtr& leds, const std::string& backend ) {
+	EventLoop loop( ClockPtr( new VirtualClock ) );
+	LedCommitter committer( leds, loop );
+	
+	committer.Set( LED_BLUE, 0, true );
+	committer.SetActivity( 0, true );
+	committer.Commit( );
+	committer.SetActivity( 0, false ); // ActivityMonitor::Unbind
+	committer.Set( LED_BLUE, 0, false );
+	
+	committer.Set( LED_BLUE, 1, true );
+	committer.SetActivity( 1, true );
+	committer.Commit( );
+	
+	const BaySet blue = leds->Lit( LED_BLUE );
+	check( failures, !blue[0], backend + ": a removed busy bay reads dark" );
+	check( failures, !blue[1], backend + ": activity queued after a set shows" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run every benchmark
+ListBenchResults run_all( const std::vector< std::string >& traces, ListFailures& failures ) {
+	ListBenchResults results;
+	const unsigned long OPS = 200000;
+	
+	const char* const BOARDS[] = { "ex48x", "h340" };
+	for ( size_t i = 0; i < sizeof(BOARDS) / sizeof(BOARDS[0]); ++i ) {
+		const std::string board = BOARDS[i];
+		SimPortIoPtr io = get_sim_port_io( board );
+		LedControlPtr leds = sim_leds( io );
+		
+		{ BenchLedSet bench( leds );    results.push_back( measure( "led_set_" + board, bench, io, OPS ) ); }
+		{ BenchLedGet bench( leds );    results.push_back( measure( "led_get_" + board, bench, io, OPS ) ); }
+		{ BenchSystemLed bench( leds ); results.push_back( measure( "system_led_" + board, bench, io, OPS ) ); }
+		{ BenchWatchdogKick bench( leds ); results.push_back( measure( "watchdog_kick_" + board, bench, io, OPS ) ); }
+	}
+	
+	// GPIO chip backend (ioctls counted as port I/O)
+	{
+		SimGpioLinesPtr gpio( new SimGpioLines( 76 ) );
+		LedControlPtr leds( new LedGpio( gpio ) );
+		if ( !leds->Init( ) ) throw std::runtime_error( "GPIO backend failed to initialise" );
+		
+		{ BenchLedSet bench( leds );    results.push_back( measure( "led_set_gpio", bench, gpio, OPS ) ); }
+		{ BenchLedGet bench( leds );    results.push_back( measure( "led_get_gpio", bench, gpio, OPS ) ); }
+		{ BenchSystemLed bench( leds ); results.push_back( measure( "system_led_gpio", bench, gpio, OPS ) ); }
+		{ BenchLightShow bench( leds, 2 ); results.push_back( measure( "light_show_2_gpio", bench, gpio, OPS / 10 ) ); }
+	}
+	
+	// LED class backend (regular files standing in for sysfs, no port I/O)
+	{
+		FakeLedClass sysfs;
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		LedControlPtr leds( new LedSysfs( sysfs.Map(), sysfs.Root() ) );
+		if ( !leds->Init( ) ) throw std::runtime_error( "LED class backend failed to initialise" );
+		
+		{ BenchLedSet bench( leds );    results.push_back( measure( "led_set_sysfs", bench, io, OPS ) ); }
+		{ BenchLedGet bench( leds );    results.push_back( measure( "led_get_sysfs", bench, io, OPS ) ); }
+		{ BenchSystemLed bench( leds ); results.push_back( measure( "system_led_sysfs", bench, io, OPS ) ); }
+	}
+	
+	// device monitor (keeping per device chatter out of the timings)
+	{
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		BenchMonitor bench( sim_leds( io ) );
+		std::streambuf* cout_buf = cout.rdbuf( 0 );
+		results.push_back( measure( "monitor_dispatch", bench, io, OPS ) );
+		cout.rdbuf( cout_buf );
+		cout.clear( );
+	}
+	
+	// recorded traces
+	for ( size_t i = 0; i < traces.size(); ++i ) {
+		DeviceTrace trace;
+		LoadDeviceTrace( traces[i], trace );
+		if ( trace.events.empty() ) continue;
+		
+		// name after the file (without directory or extension)
+		std::string name = traces[i].substr( traces[i].rfind( '/' ) + 1 );
+		name = "replay_" + name.substr( 0, name.rfind( '.' ) );
+		
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		BenchReplay bench( sim_leds( io ), trace );
+		std::streambuf* cout_buf = cout.rdbuf( 0 );
+		results.push_back( measure( name, bench, io, OPS ) );
+		cout.rdbuf( cout_buf );
+		cout.clear( );
+	}
+	
+	// light shows (holiday lights, blue chasers, knight rider, pulsing)
+	const int SHOWS[] = { 1, 2, 3, 4, 5 };
+	for ( size_t i = 0; i < sizeof(SHOWS) / sizeof(SHOWS[0]); ++i ) {
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		BenchLightShow bench( sim_leds( io ), SHOWS[i] );
+		
+		std::ostringstream name;
+		name << "light_show_" << SHOWS[i];
+		results.push_back( measure( name.str(), bench, io, OPS / 10 ) );
+	}
+	
+	// LED intents (queue alone, then folded and committed per frame)
+	{
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		{ BenchIntentQueue bench; results.push_back( measure( "led_queue_push_pop", bench, io, OPS ) ); }
+		check_committed_activity( failures, sim_leds( io ), "committed ports" );
+		{
+			SimGpioLinesPtr gpio( new SimGpioLines( 76 ) );
+			LedControlPtr leds( new LedGpio( gpio ) );
+			if ( !leds->Init( ) ) throw std::runtime_error( "GPIO backend failed to initialise" );
+			check_committed_activity( failures, leds, "committed GPIO" );
+		}
+		
+		{ BenchCommittedShow bench( sim_leds( io ), 1 ); results.push_back( measure( "light_show_1_committed", bench, io, OPS / 10 ) ); }
+		{
+			BenchCommittedShow show( sim_leds( io ), 2 );
+			results.push_back( measure( "light_show_2_committed", show, io, OPS / 10 ) );
+			
+			// reading back from the state model instead of the ports
+			BenchLedGet bench( show.Leds() );
+			results.push_back( measure( "led_get_committed", bench, io, OPS ) );
+		}
+	}
+	
+	// per tick stat reads: a pread per bay against one batch
+	{
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		const size_t BAYS[] = { 4, 16, 64 };
+		for ( size_t i = 0; i < sizeof(BAYS) / sizeof(BAYS[0]); ++i ) {
+			std::ostringstream suffix;
+			suffix << '_' << BAYS[i];
+			{ BenchSampling bench( BAYS[i], BatchReader::PREAD ); results.push_back( measure( "sample_pread" + suffix.str(), bench, io, OPS / 100 ) ); }
+			{ BenchSampling bench( BAYS[i], BatchReader::AUTO );  results.push_back( measure( "sample_batch" + suffix.str(), bench, io, OPS / 100 ) ); }
+		}
+	}
+	
+	// blocking work on worker threads
+	{
+		check_worker_pool( failures );
+		check_coroutines( failures );
+		
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		BenchOffload bench;
+		results.push_back( measure( "offload_round_trip", bench, io, OPS / 100 ) );
+	}
+	
+	// postmortem journal
+	{
+		SimPortIoPtr io = get_sim_port_io( "ex48x" );
+		BenchJournal bench;
+		results.push_back( measure( "journal_record", bench, io, OPS ) );
+	}
+	
+	return results;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write results as JSON (one benchmark per line)
+void write_json( std::ostream& out, const ListBenchResults& results ) {
+	out << "{\n  \"benchmarks\": [\n";
+	for ( size_t i = 0; i < results.size(); ++i ) {
+		const BenchResult& res = results[i];
+		out << std::fixed << "    { \"name\": \"" << res.name << "\""
+			<< ", \"ns_per_op\": " << std::setprecision(2) << res.ns_per_op
+			<< ", \"port_ops_per_op\": " << std::setprecision(3) << res.port_ops_per_op
+			<< ", \"allocs_per_op\": " << std::setprecision(3) << res.allocs_per_op
+			<< ", \"ops_per_sec\": " << std::setprecision(0) << res.ops_per_sec
+			<< " }" << ( ( i + 1 < results.size() ) ? "," : "" ) << '\n';
+	}
+	out << "  ]\n}\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// pull a numeric "key": value out of a line
+bool json_number( const std::string& line, const char* key, double& val ) {
+	const std::string pattern = std::string( "\"" ) + key + "\":";
+	const size_t pos = line.find( pattern );
+	if ( std::string::npos == pos ) return false;
+	val = strtod( line.c_str() + pos + pattern.size(), 0 );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read results written by write_json
+std::map< std::string, BenchResult > read_json( const std::string& path ) {
+	std::ifstream in( path.c_str() );
+	if ( !in ) throw ErrnoException( path );
+	
+	std::map< std::string, BenchResult > results;
+	std::string line;
+	while ( std::getline( in, line ) ) {
+		const std::string NAME = "\"name\": \"";
+		const size_t pos = line.find( NAME );
+		if ( std::string::npos == pos ) continue;
+		
+		BenchResult res;
+		res.name = line.substr( pos + NAME.size(), line.find( '"', pos + NAME.size() ) - pos - NAME.size() );
+		json_number( line, "ns_per_op", res.ns_per_op );
+		json_number( line, "port_ops_per_op", res.port_ops_per_op );
+		json_number( line, "allocs_per_op", res.allocs_per_op );
+		json_number( line, "ops_per_sec", res.ops_per_sec );
+		results[ res.name ] = res;
+	}
+	return results;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// compare a metric, printing and returning whether it regressed
+/// @param tolerance Allowed change in percent
+/// @param slack Allowed absolute change (to cover rounding in the JSON)
+bool regressed( const char* metric, double base, double cur, double tolerance, double slack, bool higher_is_better ) {
+	const double limit = ( higher_is_better )
+		?	base * ( 1 - tolerance / 100 ) - slack
+		:	base * ( 1 + tolerance / 100 ) + slack
+	;
+	const bool bad = ( higher_is_better ) ? cur < limit : cur > limit;
+	if ( bad || verbose ) {
+		cout << "  " << std::setw(16) << std::left << metric << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(14) << base << " -> " << std::setw(14) << cur << ( bad ? "  REGRESSED" : "" ) << '\n';
+	}
+	return bad;
+}
+
+} // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+/// run benchmarks (and compare against a baseline)
+int run_bench( const std::string& output, const std::string& baseline, double tolerance, const std::vector< std::string >& traces ) {
+	ListFailures failures;
+	const ListBenchResults results = run_all( traces, failures );
+	
+	if ( output.empty() || "-" == output ) {
+		write_json( cout, results );
+	} else {
+		std::ofstream out( output.c_str() );
+		if ( !out ) throw ErrnoException( output );
+		write_json( out, results );
+	}
+	
+	for ( size_t i = 0; i < failures.size(); ++i ) cout << "FAILED: " << failures[i] << '\n';
+	if ( !failures.empty() ) cout << failures.size() << " failed check(s)\n";
+	if ( baseline.empty() ) return ( failures.empty() ) ? 0 : 1;
+	
+	// port I/O and allocations are deterministic so must not grow at all,
+	// timings get some slack for noisy machines (and a couple of ns on top,
+	// which is all noise for the cheapest operations)
+	const std::map< std::string, BenchResult > base = read_json( baseline );
+	size_t regressions = 0;
+	for ( size_t i = 0; i < results.size(); ++i ) {
+		const BenchResult& cur = results[i];
+		const std::map< std::string, BenchResult >::const_iterator it = base.find( cur.name );
+		if ( base.end() == it ) {
+			cout << cur.name << ": not in baseline\n";
+			continue;
+		}
+		
+		cout << cur.name << '\n';
+		const BenchResult& old = it->second;
+		regressions += regressed( "port_ops_per_op", old.port_ops_per_op, cur.port_ops_per_op, 0, 0.0005, false );
+		regressions += regressed( "allocs_per_op",   old.allocs_per_op,   cur.allocs_per_op,   0, 0.0005, false );
+		regressions += regressed( "ns_per_op",       old.ns_per_op,       cur.ns_per_op,       tolerance, 2, false );
+		regressions += regressed( "ops_per_sec",     old.ops_per_sec,     cur.ops_per_sec,     tolerance, 0.5, true );
+	}
+	
+	cout << regressions << " regression(s) against " << baseline << '\n';
+	return ( regressions || !failures.empty() ) ? 1 : 0;
+}
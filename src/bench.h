@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file bench.h
+///
+/// benchmarks and regression gate
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_BENCH
+#define INCLUDED_BENCH
+
+//- includes
+#include <string>
+#include <vector>
+
+/// run benchmarks against simulated hardware
+/// @param output Where to write JSON results (empty for none)
+/// @param baseline Stored results to compare against (empty for none)
+/// @param tolerance Allowed slowdown in percent for timing metrics
+/// @param traces Recorded device traces to replay
+/// @returns process exit code (non-zero on regression)
+int run_bench( const std::string& output, const std::string& baseline, double tolerance, const std::vector< std::string >& traces );
+
+/// allocations made by operator new so far
+unsigned long bench_allocations( );
+
+#endif // INCLUDED_BENCH
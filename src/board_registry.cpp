@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file board_registry.cpp
+///
+/// registry of supported boards (detected from DMI and PCI ids)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "board_registry.h"
+#include "mediasmartserverd.h"
+#include "sysfs.h"
+#include <iostream>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// case insensitive substring search
+static bool contains( const std::string& str, const char* what ) {
+	if ( !what || !*what ) return true;
+	const std::string::size_type len = strlen( what );
+	for ( std::string::size_type i = 0; i + len <= str.size(); ++i ) {
+		if ( 0 == strncasecmp( str.c_str() + i, what, len ) ) return true;
+	}
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// registered boards (constructed on first use, whatever the static init order)
+BoardRegistry::ListBoards& BoardRegistry::boards_( ) {
+	static ListBoards boards;
+	return boards;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void BoardRegistry::Register( const BoardDesc& desc ) {
+	boards_().push_back( &desc );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// every board (in registration order)
+const BoardRegistry::ListBoards& BoardRegistry::Boards( ) {
+	return boards_();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// board by name
+const BoardDesc* BoardRegistry::Find( const std::string& name ) {
+	const ListBoards& boards = boards_();
+	for ( size_t i = 0; i < boards.size(); ++i ) {
+		if ( name == boards[i]->name ) return boards[i];
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// board names (for messages)
+std::string BoardRegistry::Names( ) {
+	std::string names;
+	const ListBoards& boards = boards_();
+	for ( size_t i = 0; i < boards.size(); ++i ) {
+		if ( i ) names += ", ";
+		names += boards[i]->name;
+	}
+	return names;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// work out which board we are on without touching any ports
+/// @param sysfs_root Where sysfs is mounted
+/// @returns the board or NULL if DMI and PCI don't tell us
+const BoardDesc* BoardRegistry::Detect( const std::string& sysfs_root ) {
+	std::string vendor, product, pci_vendor, pci_device;
+	sysfs_read( sysfs_root + "/class/dmi/id/sys_vendor", vendor );
+	sysfs_read( sysfs_root + "/class/dmi/id/product_name", product );
+	
+	unsigned int did_vid = 0;
+	const std::string lpc = sysfs_root + "/bus/pci/devices/0000:00:1f.0";
+	if ( sysfs_read( lpc + "/vendor", pci_vendor ) && sysfs_read( lpc + "/device", pci_device ) ) {
+		did_vid = strtoul( pci_device.c_str(), 0, 16 ) << 16 | strtoul( pci_vendor.c_str(), 0, 16 );
+	}
+	
+	if ( debug ) {
+		std::cout << "DMI: '" << vendor << "' '" << product << "'\n";
+		std::cout << "LPC: 0x" << std::hex << did_vid << std::dec << '\n';
+	}
+	
+	// DMI says which board, the most specific match winning (as long as the
+	// LPC bridge agrees, if we know it)
+	const ListBoards& boards = boards_();
+	const BoardDesc* best = 0;
+	size_t best_len = 0;
+	if ( !vendor.empty() || !product.empty() ) {
+		for ( size_t i = 0; i < boards.size(); ++i ) {
+			const BoardDesc& board = *boards[i];
+			if ( !contains( vendor, board.dmi_vendor ) || !contains( product, board.dmi_product ) ) continue;
+			if ( did_vid && board.did_vid && did_vid != board.did_vid ) continue;
+			
+			const size_t len = strlen( board.dmi_vendor ) + strlen( board.dmi_product );
+			if ( !best || len > best_len ) {
+				best = &board;
+				best_len = len;
+			}
+		}
+	}
+	if ( best ) return best;
+	
+	// otherwise the first board with that LPC bridge
+	if ( did_vid ) {
+		for ( size_t i = 0; i < boards.size(); ++i ) {
+			if ( did_vid == boards[i]->did_vid ) return boards[i];
+		}
+	}
+	
+	return 0;
+}
@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file board_registry.h
+///
+/// registry of supported boards (detected from DMI and PCI ids)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_BOARD_REGISTRY
+#define INCLUDED_BOARD_REGISTRY
+
+//- includes
+#include "led_control_base.h"
+#include "port_io.h"
+#include <string>
+#include <vector>
+
+//- forwards
+struct GpioPinMap;
+
+/////////////////////////////////////////////////////////////////////////////
+/// everything we know about a board
+struct BoardDesc {
+	const char*			name;			///< short name (--board, --simulate)
+	const char*			desc;			///< description
+	const char*			dmi_vendor;		///< found in /sys/class/dmi/id/sys_vendor
+	const char*			dmi_product;	///< found in /sys/class/dmi/id/product_name
+	unsigned int		did_vid;		///< LPC bridge (PCI 00:1f.0) device and vendor id
+	unsigned char		sio_id;			///< SuperIO device id (checked before the driver claims the board)
+	const GpioPinMap*	pins;			///< LED lines on a GPIO chip (or NULL)
+	LedControlPtr		(*create)( const PortIoPtr& io, const BoardDesc& board );	///< port I/O driver
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// registry of supported boards
+///
+/// Boards register themselves (see boards.cpp). Detection reads DMI and the
+/// LPC bridge id from sysfs once and picks the board straight from those,
+/// so only that board's driver goes on to touch ports.
+class BoardRegistry {
+public:
+	/// registers a board at static initialisation
+	struct Registrar {
+		Registrar( const BoardDesc& desc ) { BoardRegistry::Register( desc ); }
+	};
+	
+	typedef std::vector< const BoardDesc* > ListBoards;
+	
+	static void Register( const BoardDesc& desc );
+	static const ListBoards& Boards( );
+	static const BoardDesc* Find( const std::string& name );
+	static const BoardDesc* Detect( const std::string& sysfs_root );
+	static std::string Names( );
+	
+private:
+	static ListBoards& boards_( );
+};
+
+#endif // INCLUDED_BOARD_REGISTRY
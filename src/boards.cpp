@@ -0,0 +1,81 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file boards.cpp
+///
+/// supported boards
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "board_registry.h"
+#include "led_acerh340.h"
+#include "led_gpio.h"
+#include "led_hpex485.h"
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// port I/O drivers
+LedControlPtr create_acer_h340( const PortIoPtr& io, const BoardDesc& board ) { return LedControlPtr( new LedAcerH340( io, board.sio_id ) ); }
+LedControlPtr create_hp_ex48x( const PortIoPtr& io, const BoardDesc& board ) { return LedControlPtr( new LedHpEx48X( io, board.sio_id ) ); }
+
+//- boards (the first board with a given LPC bridge is the one picked when
+//  DMI doesn't match anything)
+
+/// Acer Aspire easyStore H340 (ICH7, SCH5127 drives the LEDs)
+const BoardDesc ACER_H340 = {
+	"h340", "Acer Aspire easyStore H340", "Acer", "H340",
+	0x27B88086, 0x86, 0, &create_acer_h340,
+};
+const BoardRegistry::Registrar REG_ACER_H340( ACER_H340 );
+
+/// Acer Aspire easyStore H341/H342 (same board, fewer bays populated)
+const BoardDesc ACER_H341 = {
+	"h341", "Acer Aspire easyStore H341", "Acer", "H341",
+	0x27B88086, 0x86, 0, &create_acer_h340,
+};
+const BoardRegistry::Registrar REG_ACER_H341( ACER_H341 );
+
+const BoardDesc ACER_H342 = {
+	"h342", "Acer Aspire easyStore H342", "Acer", "H342",
+	0x27B88086, 0x86, 0, &create_acer_h340,
+};
+const BoardRegistry::Registrar REG_ACER_H342( ACER_H342 );
+
+/// HP MediaSmart Server EX485/EX487 (ICH9R GPIOs drive the LEDs)
+const BoardDesc HP_EX48X = {
+	"ex48x", "HP MediaSmart Server EX48X", "Hewlett-Packard", "MediaSmart",
+	0x29168086, 0x86, &LedGpio::HpEx48X(), &create_hp_ex48x,
+};
+const BoardRegistry::Registrar REG_HP_EX48X( HP_EX48X );
+
+/// HP MediaSmart Server EX490/EX495 (same LED wiring as the EX48X)
+const BoardDesc HP_EX49X = {
+	"ex49x", "HP MediaSmart Server EX49X", "Hewlett-Packard", "MediaSmart Server EX49",
+	0x29168086, 0x86, &LedGpio::HpEx48X(), &create_hp_ex48x,
+};
+const BoardRegistry::Registrar REG_HP_EX49X( HP_EX49X );
+
+} // namespace
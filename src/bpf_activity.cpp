@@ -0,0 +1,323 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file bpf_activity.cpp
+///
+/// per-bay block I/O counted in the kernel by a BPF program
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "bpf_activity.h"
+#include "errno_exception.h"
+#include "mediasmartserverd.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/bpf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+	/// kernel's dev_t (which is not glibc's)
+	uint32_t kernel_dev( unsigned int major, unsigned int minor ) { return ( major << 20 ) | ( minor & 0xfffff ); }
+	
+	/// the bpf syscall
+	long sys_bpf( int cmd, union bpf_attr& attr ) {
+		return syscall( __NR_bpf, cmd, &attr, sizeof(attr) );
+	}
+	
+	/// an instruction
+	struct bpf_insn insn( uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm ) {
+		struct bpf_insn i;
+		memset( &i, 0, sizeof(i) );
+		i.code		= code;
+		i.dst_reg	= dst;
+		i.src_reg	= src;
+		i.off		= off;
+		i.imm		= imm;
+		return i;
+	}
+	
+	/// look a key on the stack at fp - off up in map_fd (result in r0)
+	void emit_lookup( std::vector< struct bpf_insn >& prog, int map_fd, int16_t off ) {
+		prog.push_back( insn( BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0 ) );
+		prog.push_back( insn( BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -off ) );
+		prog.push_back( insn( BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd ) );
+		prog.push_back( insn( 0, 0, 0, 0, 0 ) );
+		prog.push_back( insn( BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem ) );
+	}
+	
+	/// offset of a 4 byte field in a tracepoint's record (from its format file)
+	int16_t field_offset( const std::string& format_path, const char* field ) {
+		std::ifstream in( format_path.c_str() );
+		const std::string want = std::string( " " ) + field + ";";
+		std::string line;
+		while ( std::getline( in, line ) ) {
+			const size_t name = line.find( want );
+			const size_t semi = line.find( ';' );
+			if ( std::string::npos == name || name + want.size() - 1 != semi ) continue;
+			
+			int offset = -1, size = 0;
+			const size_t at = line.find( "offset:" );
+			if ( std::string::npos == at || 2 != sscanf( line.c_str() + at, "offset:%d;\tsize:%d;", &offset, &size ) ) break;
+			if ( 4 != size || offset < 0 ) break;
+			return offset;
+		}
+		throw std::runtime_error( "No " + std::string( field ) + " in " + format_path );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (loads and attaches the programs)
+/// @param sysfs_root Where sysfs (and under it tracefs) is mounted
+BpfActivity::BpfActivity( const std::string& sysfs_root )
+	:	sysfs_root_( sysfs_root )
+	,	devs_fd_( -1 )
+	,	counts_fd_( -1 )
+	,	devs_( MAX_BAYS, 0 )
+	,	counts_( MAX_BAYS )
+	,	keys_( MAX_BAYS )
+	,	batch_( true )
+	,	reads_( 0 )
+{
+	memset( &counts_[0], 0, counts_.size() * sizeof(Counts) );
+	
+	try {
+		union bpf_attr attr;
+		memset( &attr, 0, sizeof(attr) );
+		attr.map_type		= BPF_MAP_TYPE_HASH;
+		attr.key_size		= sizeof(uint32_t);
+		attr.value_size		= sizeof(uint32_t);
+		attr.max_entries	= MAX_BAYS;
+		strncpy( attr.map_name, "mssd_devs", sizeof(attr.map_name) - 1 );
+		devs_fd_ = sys_bpf( BPF_MAP_CREATE, attr );
+		if ( devs_fd_ < 0 ) throw ErrnoException( "bpf map" );
+		
+		attr.map_type		= BPF_MAP_TYPE_ARRAY;
+		attr.value_size		= sizeof(Counts);
+		strncpy( attr.map_name, "mssd_counts", sizeof(attr.map_name) - 1 );
+		counts_fd_ = sys_bpf( BPF_MAP_CREATE, attr );
+		if ( counts_fd_ < 0 ) throw ErrnoException( "bpf map" );
+		
+		attach_( "block_rq_issue", offsetof( Counts, issued ), false );
+		attach_( "block_rq_complete", offsetof( Counts, completed ), true );
+	} catch ( ... ) {
+		close_( );
+		throw;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor (detaches)
+BpfActivity::~BpfActivity( ) {
+	close_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// count a disk's I/O against a bay (from zero)
+/// @returns false if the kernel won't let us (e.g. no longer root on an
+///          older kernel)
+bool BpfActivity::Watch( size_t bay, unsigned int major, unsigned int minor ) {
+	if ( bay >= devs_.size() ) return false;
+	Unwatch( bay );
+	
+	uint32_t key = bay;
+	Counts zero;
+	memset( &zero, 0, sizeof(zero) );
+	
+	union bpf_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.map_fd	= counts_fd_;
+	attr.key	= (uintptr_t)&key;
+	attr.value	= (uintptr_t)&zero;
+	if ( sys_bpf( BPF_MAP_UPDATE_ELEM, attr ) ) return false;
+	counts_[ bay ] = zero;
+	
+	uint32_t dev = kernel_dev( major, minor );
+	attr.map_fd	= devs_fd_;
+	attr.key	= (uintptr_t)&dev;
+	attr.value	= (uintptr_t)&key;
+	if ( sys_bpf( BPF_MAP_UPDATE_ELEM, attr ) ) return false;
+	
+	devs_[ bay ] = dev;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop counting a bay's disk
+void BpfActivity::Unwatch( size_t bay ) {
+	if ( bay >= devs_.size() || !devs_[ bay ] ) return;
+	
+	union bpf_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.map_fd	= devs_fd_;
+	attr.key	= (uintptr_t)&devs_[ bay ];
+	sys_bpf( BPF_MAP_DELETE_ELEM, attr );
+	devs_[ bay ] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// fetch every bay's counts (one syscall, or one per watched bay on
+/// kernels without batch lookups)
+bool BpfActivity::Read( ) {
+	++reads_;
+	
+	union bpf_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	
+	if ( batch_ ) {
+		uint32_t out_batch = 0;
+		attr.batch.map_fd		= counts_fd_;
+		attr.batch.out_batch	= (uintptr_t)&out_batch;
+		attr.batch.keys			= (uintptr_t)&keys_[0];
+		attr.batch.values		= (uintptr_t)&counts_[0];
+		attr.batch.count		= counts_.size();
+		if ( 0 == sys_bpf( BPF_MAP_LOOKUP_BATCH, attr ) || ENOENT == errno ) return true;
+		if ( EINVAL != errno && ENOTSUP != errno && 524 != errno ) return false; // 524 is the kernel's ENOTSUPP
+		batch_ = false;
+		memset( &attr, 0, sizeof(attr) );
+	}
+	
+	attr.map_fd = counts_fd_;
+	for ( uint32_t bay = 0; bay < devs_.size(); ++bay ) {
+		if ( !devs_[ bay ] ) continue;
+		attr.key	= (uintptr_t)&bay;
+		attr.value	= (uintptr_t)&counts_[ bay ];
+		if ( sys_bpf( BPF_MAP_LOOKUP_ELEM, attr ) ) return false;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// where a block tracepoint's id and format are
+std::string BpfActivity::eventDir_( const char* tracepoint ) const {
+	static const char* const mounts[] = { "/kernel/tracing", "/kernel/debug/tracing" };
+	for ( size_t i = 0; i < sizeof(mounts) / sizeof(mounts[0]); ++i ) {
+		const std::string dir = sysfs_root_ + mounts[i] + "/events/block/" + tracepoint;
+		if ( 0 == access( ( dir + "/id" ).c_str(), R_OK ) ) return dir;
+	}
+	throw std::runtime_error( std::string( "No tracefs with block:" ) + tracepoint );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// load a counting program and attach it to a tracepoint
+/// @param count_field Offset in Counts of the count to add one to
+/// @param bytes Also add up the request's size
+void BpfActivity::attach_( const char* tracepoint, size_t count_field, bool bytes ) {
+	const std::string dir = eventDir_( tracepoint );
+	const int16_t dev_off = field_offset( dir + "/format", "dev" );
+	const int16_t sectors_off = ( bytes ) ? field_offset( dir + "/format", "nr_sector" ) : 0;
+	
+	int id = -1;
+	std::ifstream( ( dir + "/id" ).c_str() ) >> id;
+	if ( id < 0 ) throw std::runtime_error( "No id for block:" + std::string( tracepoint ) );
+	
+	// r6 = record, r7 = bytes
+	std::vector< struct bpf_insn > prog;
+	prog.push_back( insn( BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0 ) );
+	if ( bytes ) {
+		prog.push_back( insn( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_7, BPF_REG_6, sectors_off, 0 ) );
+		prog.push_back( insn( BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_7, 0, 0, 9 ) );
+	}
+	
+	// bay = devs[ record->dev ] (or leave)
+	prog.push_back( insn( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_1, BPF_REG_6, dev_off, 0 ) );
+	prog.push_back( insn( BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_1, -4, 0 ) );
+	emit_lookup( prog, devs_fd_, 4 );
+	std::vector< size_t > exits;
+	exits.push_back( prog.size() );
+	prog.push_back( insn( BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, 0 ) );
+	
+	// counts = counts[ bay ] (or leave)
+	prog.push_back( insn( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_1, BPF_REG_0, 0, 0 ) );
+	prog.push_back( insn( BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_1, -8, 0 ) );
+	emit_lookup( prog, counts_fd_, 8 );
+	exits.push_back( prog.size() );
+	prog.push_back( insn( BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, 0 ) );
+	
+	// other CPUs are counting too
+	prog.push_back( insn( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_1, 0, 0, 1 ) );
+	prog.push_back( insn( BPF_STX | BPF_ATOMIC | BPF_DW, BPF_REG_0, BPF_REG_1, count_field, BPF_ADD ) );
+	if ( bytes ) prog.push_back( insn( BPF_STX | BPF_ATOMIC | BPF_DW, BPF_REG_0, BPF_REG_7, offsetof( Counts, bytes ), BPF_ADD ) );
+	
+	// return 0 (nothing for perf to record)
+	for ( size_t i = 0; i < exits.size(); ++i ) prog[ exits[i] ].off = prog.size() - exits[i] - 1;
+	prog.push_back( insn( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, 0 ) );
+	prog.push_back( insn( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ) );
+	
+	char log[ 4096 ] = "";
+	union bpf_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.prog_type	= BPF_PROG_TYPE_TRACEPOINT;
+	attr.insns		= (uintptr_t)&prog[0];
+	attr.insn_cnt	= prog.size();
+	attr.license	= (uintptr_t)"Dual BSD/GPL";
+	if ( debug ) {
+		// the verifier's reasoning (the kernel wants no buffer otherwise)
+		attr.log_buf	= (uintptr_t)log;
+		attr.log_size	= sizeof(log);
+		attr.log_level	= 1;
+	}
+	strncpy( attr.prog_name, "mssd_activity", sizeof(attr.prog_name) - 1 );
+	const int prog_fd = sys_bpf( BPF_PROG_LOAD, attr );
+	if ( prog_fd < 0 ) {
+		if ( log[0] ) std::cerr << log;
+		throw ErrnoException( "bpf load" );
+	}
+	fds_.push_back( prog_fd );
+	
+	// the program runs for the tracepoint on every CPU, wherever the event is
+	struct perf_event_attr pattr;
+	memset( &pattr, 0, sizeof(pattr) );
+	pattr.type			= PERF_TYPE_TRACEPOINT;
+	pattr.size			= sizeof(pattr);
+	pattr.config		= id;
+	pattr.sample_period	= 1;
+	pattr.wakeup_events	= 1;
+	const int event_fd = syscall( __NR_perf_event_open, &pattr, -1, 0, -1, PERF_FLAG_FD_CLOEXEC );
+	if ( event_fd < 0 ) throw ErrnoException( "perf_event_open" );
+	fds_.push_back( event_fd );
+	
+	if ( ioctl( event_fd, PERF_EVENT_IOC_SET_BPF, prog_fd ) ) throw ErrnoException( "PERF_EVENT_IOC_SET_BPF" );
+	if ( ioctl( event_fd, PERF_EVENT_IOC_ENABLE, 0 ) ) throw ErrnoException( "PERF_EVENT_IOC_ENABLE" );
+	
+	if ( debug || verbose > 1 ) std::cout << "BPF counting block:" << tracepoint << " (" << prog.size() << " instructions)\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// detach and free everything
+void BpfActivity::close_( ) {
+	for ( size_t i = fds_.size(); i > 0; --i ) close( fds_[ i - 1 ] );
+	fds_.clear( );
+	if ( counts_fd_ >= 0 ) close( counts_fd_ );
+	if ( devs_fd_ >= 0 ) close( devs_fd_ );
+	counts_fd_ = devs_fd_ = -1;
+}
@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file bpf_activity.h
+///
+/// per-bay block I/O counted in the kernel by a BPF program
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_BPF_ACTIVITY
+#define INCLUDED_BPF_ACTIVITY
+
+//- includes
+#include "led_control_base.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// per-bay block I/O counted in the kernel
+///
+/// A few instructions on the block_rq_issue and block_rq_complete
+/// tracepoints look the request's dev_t up in a map of watched disks and
+/// add to that bay's slot in an array map, so no I/O is missed however
+/// short and nothing runs in the daemon until it wants the counts. Read()
+/// then fetches every bay in a single syscall.
+///
+/// The programs are assembled here and loaded with the raw bpf syscall
+/// (no libbpf, no compiler), which needs root; the constructor throws if
+/// BPF or tracefs isn't there so the caller can sample instead.
+class BpfActivity {
+public:
+	/////////////////////////////////////////////////////////////////////////
+	/// I/O a bay has done since its disk was watched (matches the map value)
+	struct Counts {
+		uint64_t	issued;		///< requests sent to the disk
+		uint64_t	completed;	///< requests the disk finished
+		uint64_t	bytes;		///< bytes in finished requests
+	};
+	
+	explicit BpfActivity( const std::string& sysfs_root );
+	~BpfActivity( );
+	
+	bool Watch( size_t bay, unsigned int major, unsigned int minor );
+	void Unwatch( size_t bay );
+	
+	bool Read( );
+	
+	/// counts as of the last Read()
+	const Counts& Bay( size_t bay ) const { return counts_[ bay ]; }
+	/// number of reads
+	unsigned long Reads( ) const { return reads_; }
+	
+private:
+	// no copying
+	BpfActivity( const BpfActivity& rhs );
+	const BpfActivity& operator=( const BpfActivity& rhs );
+	
+	std::string eventDir_( const char* tracepoint ) const;
+	void attach_( const char* tracepoint, size_t count_field, bool bytes );
+	void close_( );
+	
+	std::string				sysfs_root_;	///< where sysfs is mounted
+	int						devs_fd_;		///< kernel dev_t -> bay
+	int						counts_fd_;		///< bay -> Counts
+	std::vector< int >		fds_;			///< programs and their perf events
+	std::vector< uint32_t >	devs_;			///< watched kernel dev_t per bay (0 if none)
+	std::vector< Counts >	counts_;		///< last read
+	std::vector< uint32_t >	keys_;			///< batch read keys
+	bool					batch_;			///< kernel can read the map in one go
+	unsigned long			reads_;			///< reads
+};
+
+#endif // INCLUDED_BPF_ACTIVITY
@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file clock.cpp
+///
+/// time source and timer arming (real or simulated)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "clock.h"
+#include "errno_exception.h"
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+RealClock::RealClock( )
+	:	timer_fd_( -1 )
+	,	epoll_fd_( -1 )
+	,	deadline_( NEVER )
+{
+	timer_fd_ = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( timer_fd_ < 0 ) throw ErrnoException( "timerfd_create" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+RealClock::~RealClock( ) {
+	if ( timer_fd_ >= 0 ) close( timer_fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// current time in nanoseconds
+uint64_t RealClock::Now( ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// arm the timerfd (only touches the kernel when the deadline changes)
+void RealClock::Arm( uint64_t deadline ) {
+	if ( deadline == deadline_ ) return;
+	deadline_ = deadline;
+	
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+	if ( NEVER != deadline ) {
+		its.it_value.tv_sec  = deadline / 1000000000ULL;
+		its.it_value.tv_nsec = deadline % 1000000000ULL;
+		if ( !its.it_value.tv_sec && !its.it_value.tv_nsec ) its.it_value.tv_nsec = 1; // zero disarms
+	}
+	if ( timerfd_settime( timer_fd_, TFD_TIMER_ABSTIME, &its, 0 ) ) throw ErrnoException( "timerfd_settime" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// block until something interesting happens
+int RealClock::Wait( int epoll_fd, epoll_event* events, int max_events ) {
+	// our timer needs to be part of the set being waited on
+	if ( epoll_fd != epoll_fd_ ) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.fd = timer_fd_;
+		if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, timer_fd_, &ev ) ) throw ErrnoException( "epoll_ctl" );
+		epoll_fd_ = epoll_fd;
+	}
+	
+	sigset_t sigempty;
+	sigemptyset( &sigempty );
+	int res = epoll_pwait( epoll_fd, events, max_events, -1, &sigempty );
+	if ( res < 0 ) return res;
+	
+	// hide our timer from the caller
+	for ( int i = 0; i < res; ++i ) {
+		if ( events[i].data.fd != timer_fd_ ) continue;
+		
+		uint64_t expirations;
+		if ( read( timer_fd_, &expirations, sizeof(expirations) ) < 0 && EAGAIN != errno ) {
+			throw ErrnoException( "read(timerfd)" );
+		}
+		deadline_ = NEVER; // one-shot
+		
+		events[i] = events[--res];
+		break;
+	}
+	
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+VirtualClock::VirtualClock( uint64_t end )
+	:	now_( 0 )
+	,	end_( end )
+	,	deadline_( NEVER )
+{ }
+
+/////////////////////////////////////////////////////////////////////////////
+/// poll for real events, otherwise jump straight to the deadline
+int VirtualClock::Wait( int epoll_fd, epoll_event* events, int max_events ) {
+	int res = epoll_wait( epoll_fd, events, max_events, 0 );
+	if ( 0 != res ) return res;
+	
+	if ( NEVER == deadline_ || deadline_ > end_ ) {
+		if ( NEVER != end_ ) now_ = end_;
+		errno = ETIME;
+		return -1;
+	}
+	
+	if ( deadline_ > now_ ) now_ = deadline_;
+	deadline_ = NEVER;
+	
+	return 0;
+}
@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file clock.h
+///
+/// time source and timer arming (real or simulated)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_CLOCK
+#define INCLUDED_CLOCK
+
+//- includes
+#include <stdint.h>
+#include <tr1/memory>
+
+//- forwards
+struct epoll_event;
+
+/////////////////////////////////////////////////////////////////////////////
+/// time source and timer arming
+///
+/// All time dependent logic reads the time and waits through a Clock so it
+/// can be run against simulated time.
+class Clock {
+public:
+	static const uint64_t NEVER = ~0ULL;	///< deadline that never expires
+	
+	virtual ~Clock( ) { }
+	
+	/// current time in nanoseconds (monotonic, arbitrary epoch)
+	virtual uint64_t Now( ) = 0;
+	
+	/// arm the wakeup deadline for the next Wait (NEVER to disarm)
+	virtual void Arm( uint64_t deadline ) = 0;
+	
+	/// wait for events on an epoll set or the armed deadline
+	/// @returns number of events, 0 if the deadline passed, or -1 with errno
+	///          EINTR if interrupted by a signal or ETIME at the end of time
+	virtual int Wait( int epoll_fd, epoll_event* events, int max_events ) = 0;
+	
+	/// is this simulated time?
+	virtual bool Virtual( ) const { return false; }
+	
+protected:
+	Clock( ) { }
+	
+private:
+	// no copying
+	Clock( const Clock& rhs );
+	const Clock& operator=( const Clock& rhs );
+};
+typedef std::tr1::shared_ptr< Clock > ClockPtr;
+
+/////////////////////////////////////////////////////////////////////////////
+/// CLOCK_MONOTONIC with a timerfd for the deadline
+class RealClock : public Clock {
+public:
+	RealClock( );
+	~RealClock( );
+	
+	uint64_t Now( );
+	void Arm( uint64_t deadline );
+	int  Wait( int epoll_fd, epoll_event* events, int max_events );
+	
+private:
+	int			timer_fd_;		///< timerfd for the deadline
+	int			epoll_fd_;		///< epoll set timer_fd_ has been added to
+	uint64_t	deadline_;		///< currently armed deadline
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// simulated time that jumps straight to the next deadline
+class VirtualClock : public Clock {
+public:
+	/// @param end Time at which the simulation finishes
+	VirtualClock( uint64_t end = NEVER );
+	
+	uint64_t Now( ) { return now_; }
+	void Arm( uint64_t deadline ) { deadline_ = deadline; }
+	int  Wait( int epoll_fd, epoll_event* events, int max_events );
+	bool Virtual( ) const { return true; }
+	
+private:
+	uint64_t	now_;			///< current simulated time
+	uint64_t	end_;			///< end of simulation
+	uint64_t	deadline_;		///< currently armed deadline
+};
+
+//- helpers
+inline uint64_t ms_to_ns( uint64_t ms ) { return ms * 1000000ULL; }
+inline uint64_t sec_to_ns( uint64_t sec ) { return sec * 1000000000ULL; }
+
+#endif // INCLUDED_CLOCK
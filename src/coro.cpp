@@ -0,0 +1,152 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file coro.cpp
+///
+/// coroutines on the event loop (fd, timer and worker pool awaitables)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "coro.h"
+#include <new>
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// arena storage (free blocks are chained through their first bytes)
+union ArenaBlock {
+	ArenaBlock*	next;
+	char		bytes[ CoArena::BLOCK_SIZE ];
+	max_align_t	align;
+};
+
+ArenaBlock		arena_blocks[ CoArena::BLOCKS ];
+ArenaBlock*		arena_free = 0;
+size_t			arena_carved = 0;	///< blocks taken from arena_blocks so far
+size_t			arena_in_use = 0;
+unsigned long	arena_spills = 0;
+
+/// is this one of ours?
+bool in_arena( void* ptr ) {
+	return ptr >= (void*)arena_blocks && ptr < (void*)( arena_blocks + CoArena::BLOCKS );
+}
+
+} // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+/// memory for a coroutine frame
+void* CoArena::Alloc( size_t size ) {
+	if ( size <= BLOCK_SIZE ) {
+		ArenaBlock* block = 0;
+		if ( arena_free ) {
+			block = arena_free;
+			arena_free = block->next;
+		} else if ( arena_carved < BLOCKS ) {
+			block = &arena_blocks[ arena_carved++ ];
+		}
+		if ( block ) {
+			++arena_in_use;
+			return block;
+		}
+	}
+	
+	++arena_spills;
+	return ::operator new( size );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// return a coroutine frame
+void CoArena::Free( void* ptr ) {
+	if ( !in_arena( ptr ) ) {
+		::operator delete( ptr );
+		return;
+	}
+	
+	ArenaBlock* block = static_cast< ArenaBlock* >( ptr );
+	block->next = arena_free;
+	arena_free = block;
+	--arena_in_use;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t CoArena::InUse( ) { return arena_in_use; }
+unsigned long CoArena::Spills( ) { return arena_spills; }
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+CoFd::CoFd( EventLoop& loop, int fd, const char* trace_name )
+	:	loop_( loop )
+	,	fd_( fd )
+	,	trace_name_( trace_name )
+	,	registered_( false )
+	,	ready_( false )
+{ }
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+CoFd::~CoFd( ) {
+	if ( registered_ ) loop_.Remove( fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// became readable while nobody was waiting?
+bool CoFd::consumeReady_( ) {
+	const bool ready = ready_;
+	ready_ = false;
+	return ready;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// coroutine waiting for us
+void CoFd::wait_( std::coroutine_handle<> handle ) {
+	waiter_ = handle;
+	if ( !registered_ ) {
+		loop_.Add( fd_, this );
+		registered_ = true;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// coroutine waiting for us was destroyed
+void CoFd::cancel_( ) {
+	// (left registered: the next readable drops us from the loop)
+	waiter_ = nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// resume whoever is waiting
+void CoFd::OnReadable( int ) {
+	if ( !waiter_ ) {
+		// nobody to tell: stop watching until someone asks
+		loop_.Remove( fd_ );
+		registered_ = false;
+		ready_ = true;
+		return;
+	}
+	
+	std::coroutine_handle<> handle = waiter_;
+	waiter_ = nullptr;
+	handle.resume( );
+}
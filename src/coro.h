@@ -0,0 +1,245 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file coro.h
+///
+/// coroutines on the event loop (fd, timer and worker pool awaitables)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_CORO
+#define INCLUDED_CORO
+
+//- includes
+#include "event_loop.h"
+#include "worker_pool.h"
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// fixed pool that coroutine frames come from
+///
+/// Frames are carved from static storage in fixed size blocks, so starting
+/// a coroutine after start-up doesn't touch the heap. Anything too large,
+/// or arriving when the pool is exhausted, spills to operator new (and is
+/// counted). Loop thread only.
+class CoArena {
+public:
+	enum {
+		BLOCK_SIZE	= 1024,	///< largest frame we hold
+		BLOCKS		= 32,	///< frames we hold
+	};
+	
+	static void* Alloc( size_t size );
+	static void Free( void* ptr );
+	
+	/// blocks handed out
+	static size_t InUse( );
+	/// frames that went to the heap instead
+	static unsigned long Spills( );
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// a coroutine running on the event loop
+///
+/// It starts straight away and runs until its first co_await. Destroying
+/// the task destroys a suspended coroutine, along with whatever it was
+/// waiting on. Exceptions escape to whoever resumed it (the loop, so
+/// Run() throws just as a failing callback would).
+class CoTask {
+public:
+	struct promise_type {
+		CoTask get_return_object( ) { return CoTask( std::coroutine_handle< promise_type >::from_promise( *this ) ); }
+		std::suspend_never initial_suspend( ) noexcept { return std::suspend_never(); }
+		std::suspend_always final_suspend( ) noexcept { return std::suspend_always(); }
+		void return_void( ) { }
+		void unhandled_exception( ) { throw; }
+		
+		static void* operator new( size_t size ) { return CoArena::Alloc( size ); }
+		static void operator delete( void* ptr ) { CoArena::Free( ptr ); }
+	};
+	
+	CoTask( ) { }
+	CoTask( CoTask&& rhs ) : handle_( rhs.handle_ ) { rhs.handle_ = nullptr; }
+	CoTask& operator=( CoTask&& rhs ) {
+		if ( this != &rhs ) {
+			Reset( );
+			handle_ = rhs.handle_;
+			rhs.handle_ = nullptr;
+		}
+		return *this;
+	}
+	~CoTask( ) { Reset( ); }
+	
+	/// finished (or never started)
+	bool Done( ) const { return !handle_ || handle_.done(); }
+	
+	/// destroy the coroutine (wherever it is suspended)
+	void Reset( ) {
+		if ( handle_ ) handle_.destroy( );
+		handle_ = nullptr;
+	}
+	
+private:
+	explicit CoTask( std::coroutine_handle< promise_type > handle ) : handle_( handle ) { }
+	
+	std::coroutine_handle< promise_type > handle_;	///< our coroutine
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// file descriptor a coroutine waits on
+///
+/// Registered with the loop once, rather than on every wait. If it becomes
+/// readable while nobody is waiting, it is dropped from the loop (so a
+/// level triggered fd can't spin) and the next wait completes at once.
+class CoFd : public EventLoop::Handler {
+public:
+	CoFd( EventLoop& loop, int fd, const char* trace_name = "fd" );
+	~CoFd( );
+	
+	/// co_await Readable( ) suspends until there is something to read
+	///
+	/// The awaiter lives in the waiting frame, so destroying a suspended
+	/// coroutine stops us resuming it (the CoFd may outlive it).
+	struct Awaiter {
+		CoFd& fd;
+		bool waiting = false;
+		~Awaiter( ) { if ( waiting ) fd.cancel_( ); }
+		bool await_ready( ) { return fd.consumeReady_( ); }
+		void await_suspend( std::coroutine_handle<> handle ) { waiting = true; fd.wait_( handle ); }
+		void await_resume( ) { waiting = false; }
+	};
+	Awaiter Readable( ) { return Awaiter{ *this }; }
+	
+	void OnReadable( int fd );
+	const char* TraceName( ) const { return trace_name_; }
+	
+private:
+	// no copying
+	CoFd( const CoFd& rhs );
+	const CoFd& operator=( const CoFd& rhs );
+	
+	bool consumeReady_( );
+	void wait_( std::coroutine_handle<> handle );
+	void cancel_( );
+	
+	EventLoop&				loop_;			///< loop we are registered with
+	int						fd_;			///< what we watch
+	const char*				trace_name_;	///< for trace events
+	bool					registered_;	///< in the loop's epoll set
+	bool					ready_;			///< readable with nobody waiting
+	std::coroutine_handle<>	waiter_;		///< coroutine waiting on us
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// co_await CoSleep( loop, ns ) (or CoSleepUntil) suspends on a loop timer
+class CoSleepUntil : public EventLoop::Timer {
+public:
+	CoSleepUntil( EventLoop& loop, uint64_t deadline ) : loop_( loop ), deadline_( deadline ) { }
+	~CoSleepUntil( ) { if ( Armed() ) loop_.Cancel( this ); }
+	
+	bool await_ready( ) { return deadline_ <= loop_.Now( ); }
+	void await_suspend( std::coroutine_handle<> handle ) {
+		handle_ = handle;
+		loop_.Arm( this, deadline_ );
+	}
+	void await_resume( ) { }
+	
+	void OnTimer( uint64_t now ) { handle_.resume( ); }
+	const char* TraceName( ) const { return "sleep"; }
+	
+private:
+	EventLoop&				loop_;		///< loop with the timer
+	uint64_t				deadline_;	///< when to wake
+	std::coroutine_handle<>	handle_;	///< coroutine sleeping
+};
+
+class CoSleep : public CoSleepUntil {
+public:
+	CoSleep( EventLoop& loop, uint64_t ns ) : CoSleepUntil( loop, loop.Now( ) + ns ) { }
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// co_await CoOffload( pool, fn ) runs fn() on a worker thread and resumes
+/// with its result back on the loop thread
+///
+/// Throws JobAborted if the job was cancelled, rejected or missed its
+/// deadline. Destroying the coroutine forgets the job wherever it is
+/// (waiting for it if it is already running).
+template< typename Fn >
+class CoOffload : public WorkerPool::Job {
+public:
+	typedef decltype( std::declval< Fn& >()() ) Result;
+	
+	/// @param key Disk the work talks to (one job per disk at a time)
+	/// @param deadline Loop time after which the result is no use
+	CoOffload( WorkerPool& pool, Fn fn, long key = WorkerPool::NO_KEY, uint64_t deadline = Clock::NEVER )
+		:	pool_( pool )
+		,	fn_( fn )
+		,	key_( key )
+		,	deadline_( deadline )
+	{ }
+	~CoOffload( ) {
+		// even once final it may still be waiting for Complete() (and only
+		// the pool, under its lock, knows)
+		pool_.Forget( this );
+	}
+	
+	bool await_ready( ) { return false; }
+	void await_suspend( std::coroutine_handle<> handle ) {
+		handle_ = handle;
+		pool_.Submit( this, key_, deadline_ );
+	}
+	Result await_resume( ) {
+		if ( DONE != GetStatus( ) ) throw JobAborted( GetStatus( ) );
+		if ( error_ ) std::rethrow_exception( error_ );
+		if constexpr ( !std::is_void_v< Result > ) return result_;
+	}
+	
+	void Run( ) {
+		try {
+			if constexpr ( std::is_void_v< Result > ) fn_( );
+			else result_ = fn_( );
+		} catch ( ... ) {
+			error_ = std::current_exception( );
+		}
+	}
+	void Complete( ) { handle_.resume( ); }
+	
+private:
+	struct Nothing { };
+	typedef std::conditional_t< std::is_void_v< Result >, Nothing, Result > Stored;
+	
+	WorkerPool&				pool_;		///< where it runs
+	Fn						fn_;		///< what runs
+	long					key_;		///< disk
+	uint64_t				deadline_;	///< wanted by
+	std::coroutine_handle<>	handle_;	///< coroutine waiting
+	Stored					result_;	///< what it returned
+	std::exception_ptr		error_;		///< what it threw
+};
+
+#endif // INCLUDED_CORO
@@ -30,12 +30,17 @@
 
 //- includes
 #include "device_monitor.h"
+#include "activity_monitor.h"
 #include "errno_exception.h"
+#include "event_stream.h"
+#include "hook_runner.h"
+#include "journal.h"
 #include "mediasmartserverd.h"
+#include "probes.h"
+#include "worker_pool.h"
 #include <iostream>
 #include <map>
 #include <assert.h>
-#include <signal.h>
 #include <stdlib.h>
 extern "C" {
 #include <libudev.h>
@@ -44,17 +49,50 @@ extern "C" {
 //- types
 typedef std::tr1::shared_ptr< udev_device > UdevDevicePtr;
 
+/////////////////////////////////////////////////////////////////////////////
+/// NULL safe string
+static const char* safe_str( const char* str ) { return ( str ) ? str : ""; }
+
+/////////////////////////////////////////////////////////////////////////////
+/// capture what we need to know about a udev device
+static DeviceEvent make_device_event( udev_device* device, const char* action ) {
+	DeviceEvent event;
+	event.action	= safe_str( action );
+	event.devpath	= safe_str( udev_device_get_devpath(device) );
+	event.subsystem	= safe_str( udev_device_get_subsystem(device) );
+	event.devtype	= safe_str( udev_device_get_devtype(device) );
+	event.sysnum	= safe_str( udev_device_get_sysnum(device) );
+	event.model		= safe_str( udev_device_get_sysattr_value(device, "model") );
+	
+	// parent devices are owned by their child, so no unref
+	for ( udev_device* parent = udev_device_get_parent( device ); parent; parent = udev_device_get_parent( parent ) ) {
+		DeviceEvent::Parent info;
+		info.subsystem	= safe_str( udev_device_get_subsystem(parent) );
+		info.devtype	= safe_str( udev_device_get_devtype(parent) );
+		info.sysnum		= safe_str( udev_device_get_sysnum(parent) );
+		event.parents.push_back( info );
+	}
+	
+	return event;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// constructor
 DeviceMonitor::DeviceMonitor( )
 	:	dev_context_( 0 )
 	,	dev_monitor_( 0 )
 	,	led_index_ofs_( 0 )
+	,	activity_( 0 )
+	,	events_( 0 )
+	,	hooks_( 0 )
+	,	workers_( 0 )
+	,	enumerating_( false )
 { }
 	
 /////////////////////////////////////////////////////////////////////////////
 /// destructor
 DeviceMonitor::~DeviceMonitor( ) {
+	task_.Reset( ); // stops watching the monitor's fd before it goes
 	if ( dev_context_ ) udev_unref( dev_context_ );
 	if ( dev_monitor_ ) udev_monitor_unref( dev_monitor_ );
 }
@@ -62,7 +100,7 @@ DeviceMonitor::~DeviceMonitor( ) {
 /////////////////////////////////////////////////////////////////////////////
 /// intialise
 void DeviceMonitor::Init( const LedControlPtr& leds ) {
-	leds_ = leds;
+	Attach( leds );
 	
 	// get udev library context
 	dev_context_ = udev_new();
@@ -77,11 +115,19 @@ void DeviceMonitor::Init( const LedControlPtr& leds ) {
 		throw ErrnoException( "udev_monitor_filter_add_match_subsystem_devtype" );
 	}
 	
-	// enumerate existing devices
-	if ( verbose ) std::cout << "Enumerating attached devices...\n";
-	enumDevices_( );
+	// and their disks if we are showing activity
+	if ( activity_ && udev_monitor_filter_add_match_subsystem_devtype( dev_monitor_, "block", "disk" ) ) {
+		throw ErrnoException( "udev_monitor_filter_add_match_subsystem_devtype" );
+	}
 	
-	// then start monitoring
+	// enumerate existing devices (unless a worker does that once started)
+	if ( !workers_ ) {
+		if ( verbose ) std::cout << "Enumerating attached devices...\n";
+		enumDevices_( );
+	}
+	
+	// then start monitoring (with a worker scanning, what changes meanwhile
+	// waits for us on the monitor)
 	if ( verbose ) std::cout << "Monitoring devices...\n";
 	if ( udev_monitor_enable_receiving( dev_monitor_ ) ) {
 		throw ErrnoException( "udev_monitor_enable_receiving" );
@@ -89,107 +135,182 @@ void DeviceMonitor::Init( const LedControlPtr& leds ) {
 }
 
 /////////////////////////////////////////////////////////////////////////////
-/// main looop
-void DeviceMonitor::Main( ) {
+/// start monitoring on an event loop
+void DeviceMonitor::Start( EventLoop& loop ) {
 	assert( dev_monitor_ );
+	task_ = run_( loop );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// wait for udev events and handle them, one at a time, forever
+CoTask DeviceMonitor::run_( EventLoop& loop ) {
+	CoFd udev( loop, udev_monitor_get_fd( dev_monitor_ ), "udev" );
 	
-	const int fd_mon = udev_monitor_get_fd( dev_monitor_ );
-	const int nfds = fd_mon + 1;
-	
-	sigset_t sigempty;
-	sigemptyset( &sigempty );
-	while ( true ) {
-		fd_set fds_read;
-		FD_ZERO( &fds_read );
-		FD_SET( fd_mon, &fds_read );
-		
-		// block for something interesting to happen
-		int res = pselect( nfds, &fds_read, 0, 0, 0, &sigempty );
-		if ( res < 0 ) {
-			if ( EINTR != errno ) throw ErrnoException( "select" );
-			std::cout << "Exiting on signal\n";
-			return; // signalled
+	// the sysfs scan can stall (disks spinning up), so not on the loop
+	if ( workers_ ) {
+		if ( verbose ) std::cout << "Enumerating attached devices...\n";
+		ListDeviceEvents events;
+		bool scanned = true;
+		try {
+			co_await CoOffload( *workers_, [this, &events]( ) { scan_( events ); } );
+		} catch ( JobAborted& ) {
+			scanned = false; // (pool shutting down or full)
 		}
-		
-		// udev monitor notification?
-		if ( FD_ISSET( fd_mon, &fds_read ) ) {
-			UdevDevicePtr device( udev_monitor_receive_device( dev_monitor_ ), &udev_device_unref );
-			
-			const char* str = udev_device_get_action( device.get() );
-			if ( !str ) {
-			} else if ( 0 == strcasecmp( str, "add" ) ) {
-				deviceAdded_( device.get() );
-			} else if ( 0 == strcasecmp( str, "remove" ) ) {
-				deviceRemove_( device.get() );
-			} else {
-				if ( debug ) {
-					std::cout << "action: " << str << '\n';
-					std::cout << ' ' << udev_device_get_syspath(device.get()) << "' (" << udev_device_get_subsystem(device.get()) << ")\n";
-				}
-			}
+		if ( scanned ) found_( events );
+		else enumDevices_( );
+	}
+	
+	for ( ;; ) {
+		co_await udev.Readable( );
+		receive_( );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// take a device from the udev monitor
+void DeviceMonitor::receive_( ) {
+	UdevDevicePtr device( udev_monitor_receive_device( dev_monitor_ ), &udev_device_unref );
+	if ( !device ) return;
+	
+	const char* action = udev_device_get_action( device.get() );
+	if ( !action && !trace_ ) return;
+	
+	const DeviceEvent event = make_device_event( device.get(), action );
+	if ( trace_ ) trace_->Write( event );
+	
+	Dispatch( event );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// handle a device event
+void DeviceMonitor::Dispatch( const DeviceEvent& event ) {
+	const char* str = event.action.c_str();
+	MSSD_PROBE2( udev__event, str, event.devpath.c_str() );
+	Journal::Udev( event.action, event.devpath );
+	
+	if ( !*str ) {
+	} else if ( "block" == event.subsystem ) {
+		if ( 0 == strcasecmp( str, "add" ) ) blockChanged_( event, true );
+		else if ( 0 == strcasecmp( str, "remove" ) ) blockChanged_( event, false );
+	} else if ( 0 == strcasecmp( str, "add" ) ) {
+		deviceAdded_( event );
+	} else if ( 0 == strcasecmp( str, "remove" ) ) {
+		deviceRemove_( event );
+	} else {
+		if ( debug ) {
+			std::cout << "action: " << str << '\n';
+			std::cout << ' ' << event.devpath << "' (" << event.subsystem << ")\n";
 		}
 	}
 }
 
 /////////////////////////////////////////////////////////////////////////////
 /// device added
-void DeviceMonitor::deviceAdded_( udev_device* device ) {
-	deviceChanged_( device, true );
+void DeviceMonitor::deviceAdded_( const DeviceEvent& event ) {
+	deviceChanged_( event, true );
 }
 
 /////////////////////////////////////////////////////////////////////////////
 /// device removed
-void DeviceMonitor::deviceRemove_( udev_device* device ) {
-	deviceChanged_( device, false );
+void DeviceMonitor::deviceRemove_( const DeviceEvent& event ) {
+	deviceChanged_( event, false );
 }
 
 /////////////////////////////////////////////////////////////////////////////
 /// device has changed
-void DeviceMonitor::deviceChanged_( udev_device* device, bool state, int led_idx ) {
-	if ( debug || verbose > 1 ) std::cout << "Device " << (state ? "added" : "removed") << " '" << udev_device_get_syspath(device) << "'\n";
+void DeviceMonitor::deviceChanged_( const DeviceEvent& event, bool state, int led_idx ) {
+	if ( debug || verbose > 1 ) std::cout << "Device " << (state ? "added" : "removed") << " '" << event.devpath << "'\n";
 	
 	// retrieve LED index if needed
-	if ( led_idx <= 0 ) led_idx = getLedIndexForDevice_( device );
+	if ( led_idx <= 0 ) led_idx = getLedIndexForDevice_( event );
 	if ( led_idx <= 0 ) return;
 	
-	const char* model = udev_device_get_sysattr_value( device, "model" );
-	std::cout << (state ? "ADDED" : "REMOVED") << " [" << led_idx << "] '" << ((model) ? udev_device_get_sysattr_value(device, "model") : "") << "'\n";
+	MSSD_PROBE3( bay__resolved, led_idx, state, event.devpath.c_str() );
+	Journal::Bay( led_idx, state, event.devpath );
+	std::cout << (state ? "ADDED" : "REMOVED") << " [" << led_idx << "] '" << event.model << "'\n";
+	
+	// remember where disks go (for activity)
+	if ( activity_ ) {
+		if ( state ) {
+			present_devices_[ event.devpath ] = led_idx;
+		} else {
+			present_devices_.erase( event.devpath );
+			activity_->Unbind( led_idx - 1 ); // in case its disk went unnoticed
+		}
+	}
+	
+	// remember which bays are lit
+	if ( led_idx <= MAX_BAYS ) present_bays_[ led_idx - 1 ] = state;
+	if ( events_ ) events_->Bay( led_idx - 1, state, event.model );
+	if ( hooks_ && !enumerating_ ) hooks_->Bay( led_idx - 1, state, event.model );
 	
 	// set the appopriate LED
 	if ( leds_ ) leds_->Set( LED_BLUE, led_idx - 1, state );
 }
 
+/////////////////////////////////////////////////////////////////////////////
+/// disk added or removed (binds the activity LED of the bay its scsi device is in)
+void DeviceMonitor::blockChanged_( const DeviceEvent& event, bool state ) {
+	if ( !activity_ ) return;
+	
+	// the scsi device is an ancestor of its disk
+	std::map< std::string, int >::const_iterator it = present_devices_.upper_bound( event.devpath );
+	while ( it != present_devices_.begin() ) {
+		--it;
+		const std::string& parent = it->first;
+		if ( 0 != event.devpath.compare( 0, parent.size(), parent ) ) continue;
+		if ( event.devpath.size() <= parent.size() || '/' != event.devpath[ parent.size() ] ) continue;
+		
+		const std::string name = event.devpath.substr( event.devpath.rfind( '/' ) + 1 );
+		if ( debug || verbose > 1 ) std::cout << "Disk " << name << ( state ? " in" : " out of" ) << " bay [" << it->second << "]\n";
+		
+		if ( state ) activity_->Bind( it->second - 1, name );
+		else activity_->Unbind( it->second - 1 );
+		return;
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// retrieve LED index for device
 /// @returns led index or <= 0 if device is not the drive we are looking for
-int DeviceMonitor::getLedIndexForDevice_( udev_device* device ) {
+int DeviceMonitor::getLedIndexForDevice_( const DeviceEvent& event ) {
+	// interfaces that know their slots (e.g. enclosures) map the device themselves
+	if ( leds_ ) {
+		const int bay = leds_->BayForDevice( event.devpath );
+		if ( bay >= 0 ) return bay + 1;
+	}
+	
 	// find the scsi_host that device is on
-	udev_device* scsi_host = udev_device_get_parent_with_subsystem_devtype( device, "scsi", "scsi_host" );
-	if ( !scsi_host ) return 0;
+	const DeviceEvent::ListParents& parents = event.parents;
+	size_t host = 0;
+	for ( ; host < parents.size(); ++host ) {
+		if ( "scsi" == parents[host].subsystem && "scsi_host" == parents[host].devtype ) break;
+	}
+	if ( host >= parents.size() ) return 0;
 	
-	if ( debug ) std::cout << " scsi_host: '" << udev_device_get_syspath(scsi_host) << "' (" << udev_device_get_subsystem(scsi_host) << ")\n";
+	if ( debug ) std::cout << " scsi_host: '" << parents[host].sysnum << "' (" << parents[host].subsystem << ")\n";
 	
 	// system number indicates which bay
-	const char* sysnum = udev_device_get_sysnum( scsi_host );
-	if ( !sysnum ) return 0;
+	const std::string& sysnum = parents[host].sysnum;
+	if ( sysnum.empty() ) return 0;
 	
 	if ( debug || verbose > 1 ) std::cout << " sysnum: " << sysnum << '\n';
-	const int led_idx = atoi( sysnum ) - led_index_ofs_ + 1;
+	const int led_idx = atoi( sysnum.c_str() ) - led_index_ofs_ + 1;
+	
+	// scsi_host numbers only reach the built-in bays, not those of later interfaces
+	if ( leds_ && leds_->HostBays() < leds_->Count() && led_idx > int(leds_->HostBays()) ) return 0;
 	
 	// retrieve device parent
-	udev_device* scsi_host_parent = udev_device_get_parent( scsi_host );
-	if ( !scsi_host_parent ) return 0;
+	if ( host + 1 >= parents.size() ) return 0;
 	
-	if ( debug ) std::cout << " scsi_host_parent: '" << udev_device_get_syspath(scsi_host_parent) << '\n';
-    
     // retrieve parent subsystem
-    const char* scsi_host_parent_subsystem = udev_device_get_subsystem(scsi_host_parent);
-    if ( !scsi_host_parent_subsystem ) return led_idx; // could be NULL - #2 Acer H340 segfaults with kernel 3.5.0
+    const std::string& scsi_host_parent_subsystem = parents[host + 1].subsystem;
+    if ( scsi_host_parent_subsystem.empty() ) return led_idx; // could be NULL - #2 Acer H340 segfaults with kernel 3.5.0
     
     if ( debug ) std::cout << " subsystem: " << scsi_host_parent_subsystem << '\n';
 	
 	// ensure that scsi_host is attached to PCI (and not say USB)
-	return ( 0 == strcmp("pci", scsi_host_parent_subsystem) )
+	return ( "pci" == scsi_host_parent_subsystem )
 		?  led_idx
 		: -led_idx
 	;
@@ -198,19 +319,41 @@ int DeviceMonitor::getLedIndexForDevice_( udev_device* device ) {
 /////////////////////////////////////////////////////////////////////////////
 /// enumerate existing devices
 void DeviceMonitor::enumDevices_( ) {
+	ListDeviceEvents events;
+	scan_( events );
+	found_( events );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// find existing devices (any thread: only touches udev)
+void DeviceMonitor::scan_( ListDeviceEvents& events ) {
+	// only interested in scsi_device's (and their disks for activity)
+	enumMatching_( 0, "scsi_device", events );
+	if ( activity_ ) enumMatching_( "block", "disk", events );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// take on the devices a scan found
+void DeviceMonitor::found_( const ListDeviceEvents& events ) {
+	if ( trace_ ) {
+		for ( ListDeviceEvents::const_iterator it = events.begin(); it != events.end(); ++it ) trace_->Write( *it );
+	}
+	Enumerated( events );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// enumerate existing devices of a type
+/// @param subsystem Subsystem to match (or NULL for any)
+void DeviceMonitor::enumMatching_( const char* subsystem, const char* devtype, ListDeviceEvents& events ) {
 	assert( dev_context_ );
 	
 	// create udev enumeration interface
 	std::tr1::shared_ptr< udev_enumerate > dev_enum( udev_enumerate_new( dev_context_ ), &udev_enumerate_unref );
 	
-	// only interested in scsi_device's
-	udev_enumerate_add_match_property( dev_enum.get(), "DEVTYPE", "scsi_device" );
+	if ( subsystem ) udev_enumerate_add_match_subsystem( dev_enum.get(), subsystem );
+	udev_enumerate_add_match_property( dev_enum.get(), "DEVTYPE", devtype );
 	udev_enumerate_scan_devices( dev_enum.get() ); // start
 	
-	// list of devices (ordered by their sequence number)
-	typedef std::map< int, UdevDevicePtr > ListDevices;
-	ListDevices scsi_devices;
-	
 	//- enumerate list (assumes that this is ordered sequentially for us already)
 	udev_list_entry* list_entry = udev_enumerate_get_list_entry( dev_enum.get() );
 	for ( ; list_entry; list_entry = udev_list_entry_get_next( list_entry ) ) {
@@ -223,16 +366,36 @@ void DeviceMonitor::enumDevices_( ) {
 		);
 		if ( !device ) continue;
 		
+		events.push_back( make_device_event( device.get(), "enum" ) );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// process devices found by enumeration
+void DeviceMonitor::Enumerated( const ListDeviceEvents& events ) {
+	// hooks are for changes, not the disks we started with
+	enumerating_ = true;
+	
+	// list of devices (ordered by their sequence number)
+	typedef std::map< int, const DeviceEvent* > ListDevices;
+	ListDevices scsi_devices;
+	
+	for ( ListDeviceEvents::const_iterator it = events.begin(); it != events.end(); ++it ) {
+		MSSD_PROBE2( udev__event, it->action.c_str(), it->devpath.c_str() );
+		Journal::Udev( it->action, it->devpath );
+		
+		// disks come after we know where their scsi devices are
+		if ( "block" == it->subsystem ) continue;
+		
 		//	
-		if ( debug || verbose > 1 ) std::cout << "Device '" << udev_device_get_syspath(device.get()) << "'\n";
+		if ( debug || verbose > 1 ) std::cout << "Device '" << it->devpath << "'\n";
 		
 		// retrieve led index
-		const int led_idx = getLedIndexForDevice_( device.get() );
+		const int led_idx = getLedIndexForDevice_( *it );
 		if ( 0 == led_idx ) continue; // invalid device (missing information)
-		if ( led_idx < 0 ) device.reset(); // invalid device (USB stick or something?)
 		
-		// add to our ordered map
-		scsi_devices.insert( std::make_pair( abs(led_idx), device ) );
+		// add to our ordered map (USB stick or something is invalid)
+		scsi_devices.insert( std::make_pair( abs(led_idx), ( led_idx > 0 ) ? &*it : 0 ) );
 	}
 	
 	// iterate collected scsi devices
@@ -246,6 +409,13 @@ void DeviceMonitor::enumDevices_( ) {
 		if ( !found_valid && debug ) std::cout << "led_index_ofs = " << led_index_ofs_ << '\n';
 		found_valid = true;
 		
-		deviceChanged_( it->second.get(), true, it->first );
+		deviceChanged_( *it->second, true, it->first );
+	}
+	
+	// disks of the devices we found
+	for ( ListDeviceEvents::const_iterator it = events.begin(); it != events.end(); ++it ) {
+		if ( "block" == it->subsystem ) blockChanged_( *it, true );
 	}
+	
+	enumerating_ = false;
 }
@@ -31,9 +31,18 @@
 #define INCLUDED_DEVICE_MONITOR
 
 //- includes
+#include "coro.h"
+#include "device_trace.h"
+#include "event_loop.h"
 #include "led_control_base.h"
+#include <map>
+#include <string>
 
 //- forwards
+class ActivityMonitor;
+class EventStream;
+class HookRunner;
+class WorkerPool;
 struct udev;
 struct udev_device;
 struct udev_monitor;
@@ -46,20 +55,60 @@ public:
 	~DeviceMonitor( );
 	
 	void Init( const LedControlPtr& leds );
-	void Main( );
+	void Start( EventLoop& loop );
+	
+	/// record every event seen to a trace
+	void Record( const DeviceTraceWriterPtr& trace ) { trace_ = trace; }
+	
+	/// show disk activity (follows block devices as well)
+	void Activity( ActivityMonitor* activity ) { activity_ = activity; }
+	
+	/// tell subscribers about bays filling and emptying
+	void Events( EventStream* events ) { events_ = events; }
+	
+	/// run site scripts when bays fill and empty
+	void Hooks( HookRunner* hooks ) { hooks_ = hooks; }
+	
+	/// scan for attached devices on a worker thread once started, instead
+	/// of blocking in Init
+	void Workers( WorkerPool* workers ) { workers_ = workers; }
+	
+	//- event processing (used by Main and when replaying a trace)
+	void Attach( const LedControlPtr& leds ) { leds_ = leds; }
+	void Dispatch( const DeviceEvent& event );
+	void Enumerated( const ListDeviceEvents& events );
+	
+	/// bays we have turned on
+	const BaySet& PresentBays( ) const { return present_bays_; }
 	
 protected:
-	void deviceAdded_( udev_device* device );
-	void deviceRemove_( udev_device* device );
-	void deviceChanged_( udev_device* device, bool state, int led_idx = 0 );
+	void deviceAdded_( const DeviceEvent& event );
+	void deviceRemove_( const DeviceEvent& event );
+	void deviceChanged_( const DeviceEvent& event, bool state, int led_idx = 0 );
+	void blockChanged_( const DeviceEvent& event, bool state );
 	void enumDevices_( );
-	int  getLedIndexForDevice_( udev_device* device );
+	void scan_( ListDeviceEvents& events );
+	void found_( const ListDeviceEvents& events );
+	void enumMatching_( const char* subsystem, const char* devtype, ListDeviceEvents& events );
+	int  getLedIndexForDevice_( const DeviceEvent& event );
+	
+	CoTask run_( EventLoop& loop );
+	void receive_( );
 	
 	udev*			dev_context_;	///< udev library context
 	udev_monitor*	dev_monitor_;	///< udev monitor context
 	int				led_index_ofs_;	///< offset led index to bay zero
+	BaySet			present_bays_;	///< bays we have turned on
+	std::map< std::string, int > present_devices_; ///< devpath -> led index
 	
 	LedControlPtr	leds_;			///< led control interface
+	DeviceTraceWriterPtr trace_;	///< event recorder (optional)
+	ActivityMonitor*	activity_;	///< activity LEDs (optional)
+	EventStream*	events_;		///< subscribers (optional)
+	HookRunner*		hooks_;			///< site scripts (optional)
+	WorkerPool*		workers_;		///< runs the device scan (optional)
+	bool			enumerating_;	///< taking on the devices we started with
+	CoTask			task_;			///< udev monitor coroutine (once started)
 };
 
 #endif // INCLUDED_DEVICE_MONITOR
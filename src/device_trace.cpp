@@ -0,0 +1,182 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file device_trace.cpp
+///
+/// udev event trace capture and replay
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "device_trace.h"
+#include "errno_exception.h"
+#include <sstream>
+#include <stdlib.h>
+
+// Trace files are plain text, one record per line with tab separated fields:
+//
+//   E <action> <devpath> <subsystem> <devtype> <sysnum> <model> <parents>
+//   S <blue mask> <red mask>
+//
+// where <parents> is a space separated list of subsystem:devtype:sysnum
+// (nearest parent first). Lines starting with '#' are comments.
+
+/////////////////////////////////////////////////////////////////////////////
+/// remove characters that would break the line format
+static std::string sanitise( const std::string& str ) {
+	std::string res = str;
+	for ( size_t i = 0; i < res.size(); ++i ) {
+		if ( '\t' == res[i] || '\n' == res[i] || '\r' == res[i] ) res[i] = ' ';
+	}
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// split a string on a delimiter (empty fields are kept)
+static std::vector< std::string > split( const std::string& str, char delim ) {
+	std::vector< std::string > res;
+	size_t start = 0;
+	while ( true ) {
+		const size_t end = str.find( delim, start );
+		res.push_back( str.substr( start, end - start ) );
+		if ( std::string::npos == end ) break;
+		start = end + 1;
+	}
+	return res;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a disk (scsi_device) event on scsi_host<host> attached to bus (pci, usb)
+DeviceEvent SyntheticDeviceEvent( const char* action, int host, const char* bus ) {
+	std::ostringstream path;
+	path << "/devices/pci0000:00/0000:00:1f.2/host" << host << "/target" << host << ":0:0/" << host << ":0:0:0";
+	
+	DeviceEvent event;
+	event.action	= action;
+	event.devpath	= path.str();
+	event.subsystem	= "scsi";
+	event.devtype	= "scsi_device";
+	event.sysnum	= "0";
+	event.model		= "SYNTHETIC DISK";
+	
+	std::ostringstream host_num;
+	host_num << host;
+	const char* const PARENTS[][3] = {
+		{ "scsi", "scsi_target", "0" },
+		{ "scsi", "scsi_host", 0 },
+		{ bus, "", "2" },
+		{ "pci", "", "0" },
+	};
+	for ( size_t i = 0; i < sizeof(PARENTS) / sizeof(PARENTS[0]); ++i ) {
+		DeviceEvent::Parent parent;
+		parent.subsystem	= PARENTS[i][0];
+		parent.devtype		= PARENTS[i][1];
+		parent.sysnum		= ( PARENTS[i][2] ) ? PARENTS[i][2] : host_num.str();
+		event.parents.push_back( parent );
+	}
+	return event;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// load a trace file (throws on error)
+void LoadDeviceTrace( const std::string& path, DeviceTrace& trace ) {
+	std::ifstream in( path.c_str() );
+	if ( !in ) throw ErrnoException( path );
+	
+	std::string line;
+	for ( size_t line_no = 1; std::getline( in, line ); ++line_no ) {
+		if ( line.empty() || '#' == line[0] ) continue;
+		
+		const std::vector< std::string > fields = split( line, '\t' );
+		if ( "E" == fields[0] && fields.size() >= 7 ) {
+			DeviceEvent event;
+			event.action	= fields[1];
+			event.devpath	= fields[2];
+			event.subsystem	= fields[3];
+			event.devtype	= fields[4];
+			event.sysnum	= fields[5];
+			event.model		= fields[6];
+			
+			if ( fields.size() > 7 && !fields[7].empty() ) {
+				const std::vector< std::string > parents = split( fields[7], ' ' );
+				for ( size_t i = 0; i < parents.size(); ++i ) {
+					const std::vector< std::string > parts = split( parents[i], ':' );
+					if ( parts.size() != 3 ) continue;
+					
+					DeviceEvent::Parent parent;
+					parent.subsystem	= parts[0];
+					parent.devtype		= parts[1];
+					parent.sysnum		= parts[2];
+					event.parents.push_back( parent );
+				}
+			}
+			
+			trace.events.push_back( event );
+		} else if ( "S" == fields[0] && fields.size() >= 3 ) {
+			trace.has_state = true;
+			trace.blue = BaySet( strtoull( fields[1].c_str(), 0, 0 ) );
+			trace.red  = BaySet( strtoull( fields[2].c_str(), 0, 0 ) );
+		} else {
+			std::ostringstream ss;
+			ss << path << ':' << line_no << ": malformed trace record";
+			throw std::runtime_error( ss.str() );
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+DeviceTraceWriter::DeviceTraceWriter( const std::string& path )
+	:	out_( path.c_str() )
+{
+	if ( !out_ ) throw ErrnoException( path );
+	out_ << "# mediasmartserverd device trace\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// record an event
+void DeviceTraceWriter::Write( const DeviceEvent& event ) {
+	out_ << "E\t" << sanitise(event.action)
+		<< '\t' << sanitise(event.devpath)
+		<< '\t' << sanitise(event.subsystem)
+		<< '\t' << sanitise(event.devtype)
+		<< '\t' << sanitise(event.sysnum)
+		<< '\t' << sanitise(event.model)
+		<< '\t';
+	
+	for ( size_t i = 0; i < event.parents.size(); ++i ) {
+		const DeviceEvent::Parent& parent = event.parents[i];
+		if ( i ) out_ << ' ';
+		out_ << parent.subsystem << ':' << parent.devtype << ':' << parent.sysnum;
+	}
+	out_ << '\n';
+	out_.flush( ); // keep what we have if we are killed
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// record expected final LED state
+void DeviceTraceWriter::WriteState( const BaySet& blue, const BaySet& red ) {
+	out_ << "S\t0x" << std::hex << blue.to_ulong() << "\t0x" << red.to_ulong() << std::dec << '\n';
+	out_.flush( );
+}
@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file device_trace.h
+///
+/// udev event trace capture and replay
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_DEVICE_TRACE
+#define INCLUDED_DEVICE_TRACE
+
+//- includes
+#include "led_control_base.h"
+#include <fstream>
+#include <string>
+#include <vector>
+#include <tr1/memory>
+
+/////////////////////////////////////////////////////////////////////////////
+/// everything DeviceMonitor needs to know about a udev event
+struct DeviceEvent {
+	/// a parent device (nearest first)
+	struct Parent {
+		std::string	subsystem;
+		std::string	devtype;
+		std::string	sysnum;
+	};
+	typedef std::vector< Parent > ListParents;
+	
+	std::string	action;		///< add, remove, change, ... or "enum" when enumerated
+	std::string	devpath;	///< device path (relative to /sys)
+	std::string	subsystem;	///< device subsystem
+	std::string	devtype;	///< device type
+	std::string	sysnum;		///< device system number
+	std::string	model;		///< model sysattr
+	ListParents	parents;	///< parent chain up to the root
+};
+typedef std::vector< DeviceEvent > ListDeviceEvents;
+
+/////////////////////////////////////////////////////////////////////////////
+/// a recorded trace
+struct DeviceTrace {
+	DeviceTrace( ) : has_state( false ) { }
+	
+	ListDeviceEvents	events;		///< events in the order they were seen
+	bool				has_state;	///< whether an expected final state was recorded
+	BaySet				blue;		///< expected bays with blue LEDs lit
+	BaySet				red;		///< expected bays with red LEDs lit
+};
+
+/// a disk (scsi_device) event on scsi_host<host> attached to bus (pci, usb)
+DeviceEvent SyntheticDeviceEvent( const char* action, int host, const char* bus );
+
+/// load a trace file (throws on error)
+void LoadDeviceTrace( const std::string& path, DeviceTrace& trace );
+
+/////////////////////////////////////////////////////////////////////////////
+/// records udev events to a trace file
+class DeviceTraceWriter {
+public:
+	DeviceTraceWriter( const std::string& path );
+	
+	void Write( const DeviceEvent& event );
+	void WriteState( const BaySet& blue, const BaySet& red );
+	
+private:
+	std::ofstream	out_;	///< trace file
+};
+typedef std::tr1::shared_ptr< DeviceTraceWriter > DeviceTraceWriterPtr;
+
+#endif // INCLUDED_DEVICE_TRACE
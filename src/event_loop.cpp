@@ -0,0 +1,192 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_loop.cpp
+///
+/// epoll based event loop with file descriptor handlers and timers
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "event_loop.h"
+#include "errno_exception.h"
+#include "mediasmartserverd.h"
+#include "trace_events.h"
+#include <algorithm>
+#include <iostream>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+EventLoop::EventLoop( const ClockPtr& clock )
+	:	clock_( clock )
+	,	epoll_fd_( -1 )
+	,	wakeups_( 0 )
+	,	stop_( false )
+{
+	epoll_fd_ = epoll_create1( EPOLL_CLOEXEC );
+	if ( epoll_fd_ < 0 ) throw ErrnoException( "epoll_create1" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+EventLoop::~EventLoop( ) {
+	if ( epoll_fd_ >= 0 ) close( epoll_fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// watch a file descriptor for readability
+void EventLoop::Add( int fd, Handler* handler ) {
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if ( epoll_ctl( epoll_fd_, EPOLL_CTL_ADD, fd, &ev ) ) throw ErrnoException( "epoll_ctl" );
+	
+	if ( handlers_.size() <= size_t(fd) ) handlers_.resize( fd + 1, 0 );
+	handlers_[fd] = handler;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// also (or no longer) be told when a watched descriptor can be written
+void EventLoop::Writable( int fd, bool want ) {
+	struct epoll_event ev;
+	ev.events = ( want ) ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.fd = fd;
+	if ( epoll_ctl( epoll_fd_, EPOLL_CTL_MOD, fd, &ev ) ) throw ErrnoException( "epoll_ctl" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop watching a file descriptor
+void EventLoop::Remove( int fd ) {
+	epoll_ctl( epoll_fd_, EPOLL_CTL_DEL, fd, 0 );
+	if ( size_t(fd) < handlers_.size() ) handlers_[fd] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// (re)arm a timer
+void EventLoop::Arm( Timer* timer, uint64_t deadline ) {
+	if ( !timer->Armed() ) timers_.push_back( timer );
+	timer->deadline_ = deadline;
+	if ( Clock::NEVER == deadline ) Cancel( timer );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// disarm a timer
+void EventLoop::Cancel( Timer* timer ) {
+	timer->deadline_ = Clock::NEVER;
+	timers_.erase( std::remove( timers_.begin(), timers_.end(), timer ), timers_.end() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// be told about every wakeup
+void EventLoop::Observe( Observer* observer ) {
+	if ( observers_.end() == std::find( observers_.begin(), observers_.end(), observer ) ) {
+		observers_.push_back( observer );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop being told about wakeups
+void EventLoop::Unobserve( Observer* observer ) {
+	observers_.erase( std::remove( observers_.begin(), observers_.end(), observer ), observers_.end() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// fire any timers that are due
+void EventLoop::runTimers_( ) {
+	const uint64_t now = clock_->Now( );
+	for ( size_t i = 0; i < timers_.size(); ) {
+		Timer* timer = timers_[i];
+		if ( timer->deadline_ > now ) {
+			++i;
+			continue;
+		}
+		
+		// disarm before calling so it can re-arm itself
+		timer->deadline_ = Clock::NEVER;
+		timers_.erase( timers_.begin() + i );
+		
+		TraceScope scope( timer->TraceName(), "timer" );
+		timer->OnTimer( now );
+		i = 0; // timers may have been added or removed
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// wait for and dispatch one round of events
+/// @returns false if we should stop (signal, Stop or end of simulated time)
+bool EventLoop::RunOnce( ) {
+	if ( stop_ ) return false;
+	TraceScope scope( "loop.iteration", "loop" );
+	
+	// earliest timer
+	uint64_t deadline = Clock::NEVER;
+	for ( size_t i = 0; i < timers_.size(); ++i ) deadline = std::min( deadline, timers_[i]->deadline_ );
+	clock_->Arm( deadline );
+	
+	// block for something interesting to happen
+	struct epoll_event events[16];
+	int res;
+	for ( ;; ) {
+		{
+			TraceScope wait_scope( "loop.wait", "loop" );
+			res = clock_->Wait( epoll_fd_, events, sizeof(events) / sizeof(events[0]) );
+		}
+		if ( res >= 0 ) break;
+		if ( ETIME == errno ) return false; // simulation finished
+		if ( EINTR != errno ) throw ErrnoException( "epoll_wait" );
+		if ( TraceEvents::PollSignal() ) return true; // asked to write out the trace
+		if ( exit_signalled ) {
+			std::cout << "Exiting on signal\n";
+			return false; // signalled
+		}
+		// interrupted by nothing we handle (io_uring teardown does this)
+	}
+	++wakeups_;
+	
+	for ( int i = 0; i < res; ++i ) {
+		const int fd = events[i].data.fd;
+		if ( size_t(fd) >= handlers_.size() || !handlers_[fd] ) continue;
+		
+		TraceScope handler_scope( handlers_[fd]->TraceName(), "fd" );
+		if ( events[i].events & ~EPOLLOUT ) handlers_[fd]->OnReadable( fd );
+		if ( ( events[i].events & EPOLLOUT ) && handlers_[fd] ) handlers_[fd]->OnWritable( fd );
+	}
+	
+	runTimers_( );
+	
+	if ( !observers_.empty() ) {
+		const uint64_t now = clock_->Now( );
+		for ( size_t i = 0; i < observers_.size(); ++i ) observers_[i]->OnWakeup( now );
+	}
+	
+	return !stop_;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run until signalled or stopped
+void EventLoop::Run( ) {
+	while ( RunOnce( ) ) { }
+}
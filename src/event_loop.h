@@ -0,0 +1,116 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_loop.h
+///
+/// epoll based event loop with file descriptor handlers and timers
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_EVENT_LOOP
+#define INCLUDED_EVENT_LOOP
+
+//- includes
+#include "clock.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// epoll based event loop with file descriptor handlers and timers
+class EventLoop {
+public:
+	/////////////////////////////////////////////////////////////////////////
+	/// something interested in a file descriptor becoming readable (or
+	/// writable, once asked for with Writable)
+	class Handler {
+	public:
+		virtual ~Handler( ) { }
+		virtual void OnReadable( int fd ) = 0;
+		virtual void OnWritable( int ) { }
+		virtual const char* TraceName( ) const { return "handler"; }
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// one-shot timer (re-arm from OnTimer to make it periodic)
+	class Timer {
+	public:
+		Timer( ) : deadline_( Clock::NEVER ) { }
+		virtual ~Timer( ) { }
+		virtual void OnTimer( uint64_t now ) = 0;
+		virtual const char* TraceName( ) const { return "timer"; }
+		
+		uint64_t Deadline( ) const { return deadline_; }
+		bool Armed( ) const { return Clock::NEVER != deadline_; }
+		
+	private:
+		friend class EventLoop;
+		uint64_t deadline_;	///< when we are due
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// told about every wakeup (after its handlers and timers have run)
+	class Observer {
+	public:
+		virtual ~Observer( ) { }
+		virtual void OnWakeup( uint64_t now ) = 0;
+	};
+	
+	EventLoop( const ClockPtr& clock );
+	~EventLoop( );
+	
+	void Add( int fd, Handler* handler );
+	void Writable( int fd, bool want );
+	void Remove( int fd );
+	
+	void Arm( Timer* timer, uint64_t deadline );
+	void Cancel( Timer* timer );
+	
+	void Observe( Observer* observer );
+	void Unobserve( Observer* observer );
+	
+	bool RunOnce( );
+	void Run( );
+	void Stop( ) { stop_ = true; }
+	
+	uint64_t Now( ) { return clock_->Now( ); }
+	const ClockPtr& GetClock( ) const { return clock_; }
+	
+	/// number of times we have woken up
+	unsigned long Wakeups( ) const { return wakeups_; }
+	
+private:
+	// no copying
+	EventLoop( const EventLoop& rhs );
+	const EventLoop& operator=( const EventLoop& rhs );
+	
+	void runTimers_( );
+	
+	ClockPtr				clock_;		///< time source
+	int						epoll_fd_;	///< epoll set
+	std::vector< Handler* >	handlers_;	///< handlers indexed by fd
+	std::vector< Timer* >	timers_;	///< armed timers
+	std::vector< Observer* >	observers_;	///< wakeup observers
+	unsigned long			wakeups_;	///< wakeup count
+	bool					stop_;		///< stop requested
+};
+
+#endif // INCLUDED_EVENT_LOOP
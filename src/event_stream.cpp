@@ -0,0 +1,423 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_stream.cpp
+///
+/// pushes daemon events to clients of a local socket
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "event_stream.h"
+#include "errno_exception.h"
+#include "journal.h"
+#include "mediasmartserverd.h"
+#include "trace_events.h"
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/////////////////////////////////////////////////////////////////////////////
+const char* const EventStream::DEFAULT_PATH = "/run/mediasmartserverd.sock";
+
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+	/// LedState (or 0 for never set) as a word
+	const char* state_name( int state ) {
+		switch ( state ) {
+		case LED_OFF:	return "off";
+		case LED_ON:	return "on";
+		case LED_BLINK:	return "blink";
+		}
+		return "unset";
+	}
+	
+	/// append a number
+	void append_num( std::string& out, long long val ) {
+		char buf[ 24 ];
+		out.append( buf, snprintf( buf, sizeof(buf), "%lld", val ) );
+	}
+	
+	/// append a bay set as a hex mask string
+	void append_bays( std::string& out, const BaySet& bays ) {
+		char buf[ 24 ];
+		out.append( buf, snprintf( buf, sizeof(buf), "\"0x%llx\"", (unsigned long long)bays.to_ullong() ) );
+	}
+	
+	/// append a JSON string
+	void append_str( std::string& out, const std::string& str ) {
+		out += '"';
+		for ( size_t i = 0; i < str.size(); ++i ) {
+			const unsigned char c = str[i];
+			if ( '"' == c || '\\' == c ) {
+				out += '\\';
+				out += c;
+			} else if ( c < 0x20 ) {
+				char buf[ 8 ];
+				out.append( buf, snprintf( buf, sizeof(buf), "\\u%04x", c ) );
+			} else {
+				out += c;
+			}
+		}
+		out += '"';
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (creates the socket, replacing a stale one)
+EventStream::EventStream( const std::string& path )
+	:	path_( path )
+	,	listen_fd_( -1 )
+	,	loop_( 0 )
+	,	clients_( MAX_CLIENTS )
+	,	seq_( 0 )
+	,	dropped_( 0 )
+	,	pending_( false )
+	,	models_( MAX_BAYS )
+	,	has_frame_( false )
+	,	has_busy_( false )
+{
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if ( path_.size() >= sizeof(addr.sun_path) ) throw std::runtime_error( "Socket path too long: " + path_ );
+	strcpy( addr.sun_path, path_.c_str() );
+	
+	listen_fd_ = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if ( listen_fd_ < 0 ) throw ErrnoException( "socket" );
+	
+	unlink( path_.c_str() );
+	if ( bind( listen_fd_, (struct sockaddr*)&addr, sizeof(addr) ) || listen( listen_fd_, MAX_CLIENTS ) ) {
+		const ErrnoException e( path_ );
+		close( listen_fd_ );
+		throw e;
+	}
+	chmod( path_.c_str(), 0660 );
+	
+	for ( size_t i = 0; i < clients_.size(); ++i ) clients_[i].fd = -1;
+	if ( debug || verbose > 0 ) std::cout << "Serving events on " << path_ << '\n';
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+EventStream::~EventStream( ) {
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( clients_[i].fd >= 0 ) disconnect_( clients_[i] );
+	}
+	if ( loop_ ) {
+		loop_->Remove( listen_fd_ );
+		loop_->Unobserve( this );
+	}
+	close( listen_fd_ );
+	unlink( path_.c_str() ); // may fail without root, leaving it for next time
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start accepting clients
+void EventStream::Start( EventLoop& loop ) {
+	loop_ = &loop;
+	loop_->Add( listen_fd_, this );
+	loop_->Observe( this );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a disk was added to or removed from a bay
+void EventStream::Bay( size_t bay, bool present, const std::string& model ) {
+	if ( bay >= MAX_BAYS ) return;
+	present_[ bay ] = present;
+	models_[ bay ] = ( present ) ? model : std::string( );
+	bayEvent_( bay, false );
+	end_( BAY );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// an LED frame was committed (only changes are sent)
+void EventStream::Leds( const LedSnapshot& snap ) {
+	if ( has_frame_ && 0 == memcmp( snap.words, frame_.words, sizeof(snap.words) ) ) return;
+	frame_ = snap;
+	has_frame_ = true;
+	ledEvent_( false );
+	end_( LED );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the bays showing activity changed
+void EventStream::Activity( const BaySet& busy ) {
+	if ( has_busy_ && busy == busy_ ) return;
+	busy_ = busy;
+	has_busy_ = true;
+	activityEvent_( false );
+	end_( ACTIVITY );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a client connected, sent a command or went away
+void EventStream::OnReadable( int fd ) {
+	if ( fd == listen_fd_ ) {
+		accept_( );
+		return;
+	}
+	
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( fd == clients_[i].fd ) command_( clients_[i] );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a client's socket has room again
+void EventStream::OnWritable( int fd ) {
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( fd == clients_[i].fd ) flush_( clients_[i] );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// send whatever this wakeup published (one write per client)
+void EventStream::OnWakeup( uint64_t ) {
+	if ( !pending_ ) return;
+	pending_ = false;
+	
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		Client& client = clients_[i];
+		if ( client.fd >= 0 && client.len && !client.waiting ) flush_( client );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+size_t EventStream::Clients( ) const {
+	size_t cnt = 0;
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( clients_[i].fd >= 0 ) ++cnt;
+	}
+	return cnt;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// take a new client, bringing it up to date
+void EventStream::accept_( ) {
+	const int fd = accept4( listen_fd_, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC );
+	if ( fd < 0 ) return;
+	
+	Client* client = 0;
+	for ( size_t i = 0; i < clients_.size() && !client; ++i ) {
+		if ( clients_[i].fd < 0 ) client = &clients_[i];
+	}
+	if ( !client ) {
+		if ( debug || verbose > 0 ) std::cerr << "Too many event clients\n";
+		close( fd );
+		return;
+	}
+	
+	client->fd		= fd;
+	client->mask	= ALL;
+	client->ring.resize( RING_SIZE );
+	client->head	= 0;
+	client->len		= 0;
+	client->waiting	= false;
+	client->input.clear( );
+	loop_->Add( fd, this );
+	if ( debug || verbose > 1 ) std::cout << "Event client connected (fd " << fd << ")\n";
+	
+	// what a poller would have had to ask for
+	line_ = "{\"type\":\"hello\",\"version\":1,\"seq\":";
+	append_num( line_, seq_ );
+	line_ += "}\n";
+	send_( *client, ALL );
+	for ( size_t bay = present_._Find_first(); bay < MAX_BAYS; bay = present_._Find_next( bay ) ) {
+		bayEvent_( bay, true );
+		send_( *client, BAY );
+	}
+	if ( has_frame_ ) {
+		ledEvent_( true );
+		send_( *client, LED );
+	}
+	if ( has_busy_ ) {
+		activityEvent_( true );
+		send_( *client, ACTIVITY );
+	}
+	
+	if ( client->fd >= 0 ) flush_( *client );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a client's commands ("subscribe bay led activity")
+void EventStream::command_( Client& client ) {
+	char buf[ 256 ];
+	const ssize_t len = read( client.fd, buf, sizeof(buf) );
+	if ( len <= 0 ) {
+		if ( len < 0 && ( EAGAIN == errno || EINTR == errno ) ) return;
+		disconnect_( client );
+		return;
+	}
+	
+	client.input.append( buf, len );
+	size_t eol;
+	while ( std::string::npos != ( eol = client.input.find( '\n' ) ) ) {
+		std::string cmd = client.input.substr( 0, eol );
+		client.input.erase( 0, eol + 1 );
+		
+		if ( 0 != cmd.compare( 0, 9, "subscribe" ) ) continue;
+		int mask = 0;
+		if ( std::string::npos != cmd.find( "bay" ) ) mask |= BAY;
+		if ( std::string::npos != cmd.find( "led" ) ) mask |= LED;
+		if ( std::string::npos != cmd.find( "activity" ) ) mask |= ACTIVITY;
+		client.mask = ( mask ) ? mask : ALL;
+	}
+	
+	// nobody needs commands this long
+	if ( client.input.size() > sizeof(buf) ) disconnect_( client );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// hang up on a client
+void EventStream::disconnect_( Client& client ) {
+	if ( debug || verbose > 1 ) std::cout << "Event client disconnected (fd " << client.fd << ")\n";
+	loop_->Remove( client.fd );
+	close( client.fd );
+	client.fd = -1;
+	std::vector< char >().swap( client.ring );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start an event (numbered, unless it is replaying state to a new client)
+void EventStream::begin_( const char* type, bool replay ) {
+	if ( replay ) {
+		line_ = "{\"replay\":true";
+	} else {
+		line_ = "{\"seq\":";
+		append_num( line_, seq_ );
+	}
+	line_ += ",\"t_ms\":";
+	append_num( line_, ( loop_ ) ? loop_->Now() / 1000000 : 0 );
+	line_ += ",\"type\":\"";
+	line_ += type;
+	line_ += '"';
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// finish an event and queue it for everyone who wants it
+void EventStream::end_( int type ) {
+	++seq_;
+	for ( size_t i = 0; i < clients_.size(); ++i ) {
+		if ( clients_[i].fd >= 0 ) send_( clients_[i], type );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// copy the built line into a client's ring, dropping the client if it
+/// has fallen too far behind
+void EventStream::send_( Client& client, int type ) {
+	if ( client.fd < 0 || !( client.mask & type ) ) return;
+	
+	const size_t size = client.ring.size();
+	if ( client.len + line_.size() > size ) {
+		if ( debug || verbose > 0 ) std::cerr << "Dropping slow event client (fd " << client.fd << ")\n";
+		++dropped_;
+		Journal::Alert( client.fd, "slow event client dropped" );
+		disconnect_( client );
+		return;
+	}
+	
+	size_t tail = ( client.head + client.len ) % size;
+	const size_t first = std::min( line_.size(), size - tail );
+	memcpy( &client.ring[ tail ], line_.data(), first );
+	memcpy( &client.ring[0], line_.data() + first, line_.size() - first );
+	client.len += line_.size();
+	pending_ = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write as much of a client's ring as its socket takes
+void EventStream::flush_( Client& client ) {
+	const size_t size = client.ring.size();
+	while ( client.len ) {
+		const size_t chunk = std::min( client.len, size - client.head );
+		const ssize_t res = send( client.fd, &client.ring[ client.head ], chunk, MSG_NOSIGNAL );
+		if ( res < 0 ) {
+			if ( EINTR == errno ) continue;
+			if ( EAGAIN != errno ) {
+				disconnect_( client );
+				return;
+			}
+			break;
+		}
+		client.head = ( client.head + res ) % size;
+		client.len -= res;
+	}
+	if ( !client.len ) client.head = 0;
+	
+	// wait for room only while there is something left to send
+	const bool waiting = ( client.len > 0 );
+	if ( waiting != client.waiting ) {
+		loop_->Writable( client.fd, waiting );
+		client.waiting = waiting;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// build a bay event
+void EventStream::bayEvent_( size_t bay, bool replay ) {
+	begin_( "bay", replay );
+	line_ += ",\"bay\":";
+	append_num( line_, bay + 1 );
+	line_ += ",\"state\":";
+	line_ += ( present_[ bay ] ) ? "\"added\"" : "\"removed\"";
+	if ( present_[ bay ] ) {
+		line_ += ",\"model\":";
+		append_str( line_, models_[ bay ] );
+	}
+	line_ += "}\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// build an LED frame event
+void EventStream::ledEvent_( bool replay ) {
+	begin_( "led", replay );
+	line_ += ",\"blue\":";
+	append_bays( line_, frame_.Lit( LED_BLUE ) );
+	line_ += ",\"red\":";
+	append_bays( line_, frame_.Lit( LED_RED ) );
+	line_ += ",\"system_blue\":\"";
+	line_ += state_name( frame_.System( LED_BLUE ) );
+	line_ += "\",\"system_red\":\"";
+	line_ += state_name( frame_.System( LED_RED ) );
+	line_ += "\",\"brightness\":";
+	append_num( line_, frame_.Brightness() );
+	line_ += ",\"usb\":";
+	append_num( line_, frame_.Usb() );
+	line_ += "}\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// build an activity event
+void EventStream::activityEvent_( bool replay ) {
+	begin_( "activity", replay );
+	line_ += ",\"busy\":";
+	append_bays( line_, busy_ );
+	line_ += "}\n";
+}
@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file event_stream.h
+///
+/// pushes daemon events to clients of a local socket
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_EVENT_STREAM
+#define INCLUDED_EVENT_STREAM
+
+//- includes
+#include "event_loop.h"
+#include "led_control_base.h"
+#include "led_state.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// pushes what the daemon sees to subscribers on a Unix socket
+///
+/// One JSON object per line, e.g.
+///   {"seq":7,"t_ms":5120,"type":"bay","bay":2,"state":"added","model":"WDC WD20EARS"}
+/// A new client is sent a hello and then the current state (present bays,
+/// LEDs, activity) as events marked "replay" rather than numbered, so it
+/// never has to poll. It may then send "subscribe bay led activity" (any
+/// of them) to narrow the live events it gets.
+///
+/// Each client has a bounded ring that lines are copied into and written
+/// out of as the socket allows. A client too slow to keep its ring from
+/// filling is disconnected, never waited for.
+class EventStream : public EventLoop::Handler, public EventLoop::Observer {
+public:
+	/// where the socket goes by default
+	static const char* const DEFAULT_PATH;
+	
+	enum {
+		MAX_CLIENTS	= 8,			///< more are turned away
+		RING_SIZE	= 64 * 1024,	///< bytes a client may fall behind by
+		
+		// event types (subscription mask)
+		BAY			= 1 << 0,	///< disk added to or removed from a bay
+		LED			= 1 << 1,	///< committed LED frame changed
+		ACTIVITY	= 1 << 2,	///< bays showing disk activity changed
+		ALL			= BAY | LED | ACTIVITY,
+	};
+	
+	explicit EventStream( const std::string& path );
+	~EventStream( );
+	
+	void Start( EventLoop& loop );
+	
+	//- publishers
+	void Bay( size_t bay, bool present, const std::string& model );
+	void Leds( const LedSnapshot& snap );
+	void Activity( const BaySet& busy );
+	
+	//- event loop
+	void OnReadable( int fd );
+	void OnWritable( int fd );
+	void OnWakeup( uint64_t now );
+	const char* TraceName( ) const { return "event_stream"; }
+	
+	/// connected clients
+	size_t Clients( ) const;
+	/// clients disconnected for falling behind
+	unsigned long Dropped( ) const { return dropped_; }
+	/// events published
+	unsigned long Published( ) const { return seq_; }
+	
+private:
+	// no copying
+	EventStream( const EventStream& rhs );
+	const EventStream& operator=( const EventStream& rhs );
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// a subscriber
+	struct Client {
+		int					fd;			///< connection (-1 if slot unused)
+		int					mask;		///< event types wanted
+		std::vector< char >	ring;		///< unsent bytes
+		size_t				head;		///< first unsent byte
+		size_t				len;		///< unsent byte count
+		bool				waiting;	///< asked the loop for writability
+		std::string			input;		///< partial command line
+	};
+	
+	void accept_( );
+	void command_( Client& client );
+	void disconnect_( Client& client );
+	
+	void begin_( const char* type, bool replay );
+	void end_( int type );
+	void send_( Client& client, int type );
+	void flush_( Client& client );
+	
+	void bayEvent_( size_t bay, bool replay );
+	void ledEvent_( bool replay );
+	void activityEvent_( bool replay );
+	
+	std::string				path_;		///< socket path
+	int						listen_fd_;	///< listening socket
+	EventLoop*				loop_;		///< loop we serve from
+	std::vector< Client >	clients_;	///< MAX_CLIENTS slots
+	std::string				line_;		///< event being built
+	unsigned long			seq_;		///< events so far
+	unsigned long			dropped_;	///< clients dropped
+	bool					pending_;	///< some client has unsent bytes
+	
+	//- current state (replayed to new clients)
+	BaySet					present_;	///< bays with disks
+	std::vector< std::string >	models_;	///< model per bay
+	LedSnapshot				frame_;		///< last LED frame
+	bool					has_frame_;	///< had a frame
+	BaySet					busy_;		///< bays showing activity
+	bool					has_busy_;	///< activity is being monitored
+};
+
+#endif // INCLUDED_EVENT_STREAM
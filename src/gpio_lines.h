@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file gpio_lines.h
+///
+/// GPIO line access through the GPIO character device (v2 uAPI)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_GPIO_LINES
+#define INCLUDED_GPIO_LINES
+
+//- includes
+#include "errno_exception.h"
+#include "probes.h"
+#include <string>
+#include <vector>
+#include <tr1/memory>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// a set of GPIO output lines requested together
+/// (bit i of a mask is the i'th requested line, so drivers can run against a mock)
+class GpioLines {
+public:
+	virtual ~GpioLines( ) { }
+	
+	/// request lines as outputs (physical levels, no active-low)
+	/// @param initial Initial level of each line (bit mask)
+	virtual void Request( const std::vector< unsigned int >& offsets, uint64_t initial ) = 0;
+	
+	/// set the lines in mask to bits (all at once)
+	virtual void Set( uint64_t mask, uint64_t bits ) = 0;
+	/// current levels of the lines in mask
+	virtual uint64_t Get( uint64_t mask ) = 0;
+	
+protected:
+	GpioLines( ) { }
+	
+private:
+	// no copying
+	GpioLines( const GpioLines& rhs );
+	const GpioLines& operator=( const GpioLines& rhs );
+};
+typedef std::tr1::shared_ptr< GpioLines > GpioLinesPtr;
+
+/////////////////////////////////////////////////////////////////////////////
+/// lines of a /dev/gpiochipN
+class ChipGpioLines : public GpioLines {
+public:
+	/// constructor
+	/// @param path Chip device (e.g. /dev/gpiochip0)
+	ChipGpioLines( const std::string& path )
+		:	path_( path )
+		,	fd_chip_( open( path.c_str(), O_RDWR | O_CLOEXEC ) )
+		,	fd_lines_( -1 )
+	{
+		if ( fd_chip_ < 0 ) throw ErrnoException( path );
+	}
+	
+	/// destructor
+	~ChipGpioLines( ) {
+		if ( fd_lines_ >= 0 ) close( fd_lines_ );
+		close( fd_chip_ );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// request every line in one go (GPIO_V2_GET_LINE_IOCTL)
+	void Request( const std::vector< unsigned int >& offsets, uint64_t initial ) {
+		if ( offsets.size() > GPIO_V2_LINES_MAX ) throw std::runtime_error( path_ + ": too many GPIO lines" );
+		
+		gpio_v2_line_request req;
+		memset( &req, 0, sizeof(req) );
+		std::copy( offsets.begin(), offsets.end(), req.offsets );
+		strncpy( req.consumer, "mediasmartserverd", sizeof(req.consumer) - 1 );
+		req.num_lines = offsets.size();
+		req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		
+		// start with the levels the caller asked for (not all low)
+		const uint64_t all = ( offsets.size() < 64 ) ? ( 1ULL << offsets.size() ) - 1 : ~0ULL;
+		req.config.num_attrs = 1;
+		req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		req.config.attrs[0].attr.values = initial & all;
+		req.config.attrs[0].mask = all;
+		
+		if ( ioctl( fd_chip_, GPIO_V2_GET_LINE_IOCTL, &req ) < 0 ) throw ErrnoException( path_ + ": GPIO_V2_GET_LINE_IOCTL" );
+		fd_lines_ = req.fd;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	void Set( uint64_t mask, uint64_t bits ) {
+		gpio_v2_line_values vals;
+		vals.mask = mask;
+		vals.bits = bits;
+		MSSD_PROBE2( gpio__write, mask, bits );
+		if ( ioctl( fd_lines_, GPIO_V2_LINE_SET_VALUES_IOCTL, &vals ) < 0 ) throw ErrnoException( path_ + ": GPIO_V2_LINE_SET_VALUES_IOCTL" );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	uint64_t Get( uint64_t mask ) {
+		gpio_v2_line_values vals;
+		vals.mask = mask;
+		vals.bits = 0;
+		if ( ioctl( fd_lines_, GPIO_V2_LINE_GET_VALUES_IOCTL, &vals ) < 0 ) throw ErrnoException( path_ + ": GPIO_V2_LINE_GET_VALUES_IOCTL" );
+		return vals.bits & mask;
+	}
+	
+private:
+	std::string	path_;		///< chip device
+	int			fd_chip_;	///< chip
+	int			fd_lines_;	///< line request
+};
+
+#endif // INCLUDED_GPIO_LINES
@@ -0,0 +1,516 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file hook_runner.cpp
+///
+/// runs site scripts on events through a helper process
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "hook_runner.h"
+#include "errno_exception.h"
+#include "journal.h"
+#include "mediasmartserverd.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//- globals
+extern char** environ;
+
+/////////////////////////////////////////////////////////////////////////////
+const char* const HookRunner::DEFAULT_DIR = "/etc/mediasmartserverd/hooks";
+
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+	/// monotonic time in nanoseconds (the helper always runs in real time)
+	uint64_t mono_ns( ) {
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+	
+	/// a hook name can't leave the hooks directory
+	bool valid_name( const std::string& name ) {
+		if ( name.empty() || '.' == name[0] ) return false;
+		for ( size_t i = 0; i < name.size(); ++i ) {
+			const char c = name[i];
+			if ( !isalnum( (unsigned char)c ) && '-' != c && '_' != c && '.' != c ) return false;
+		}
+		return true;
+	}
+	
+	/// tell the daemon how a run went ("<status> <code> <hook>")
+	void reply( const char* status, int code, const std::string& hook ) {
+		char buf[ HookRunner::MAX_LINE ];
+		const int len = snprintf( buf, sizeof(buf), "%s %d %s\n", status, code, hook.c_str() );
+		if ( len > 0 && write( STDOUT_FILENO, buf, std::min< size_t >( len, sizeof(buf) - 1 ) ) < 0 ) { } // daemon gone
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// a script the helper is running
+	struct Child {
+		pid_t		pid;		///< also its process group
+		std::string	hook;		///< script name
+		uint64_t	deadline;	///< when to signal it next
+		bool		killed;		///< sent SIGTERM already
+	};
+	
+	/// start a script for a request line ("hook\targ\targ")
+	void spawn_hook( const std::string& dir, const std::string& line, uint64_t deadline, std::vector< Child >& children ) {
+		std::vector< std::string > args;
+		std::istringstream in( line );
+		std::string field;
+		while ( std::getline( in, field, '\t' ) ) args.push_back( field );
+		if ( args.empty() ) return;
+		
+		const std::string hook = args[0];
+		if ( !valid_name( hook ) ) {
+			reply( "unsafe", 0, hook );
+			return;
+		}
+		args[0] = dir + '/' + hook;
+		
+		// only scripts nobody else could have put there
+		struct stat st;
+		if ( stat( args[0].c_str(), &st ) ) {
+			reply( "missing", errno, hook );
+			return;
+		}
+		if ( !S_ISREG( st.st_mode ) || !( st.st_mode & S_IXUSR ) ) {
+			reply( "missing", 0, hook );
+			return;
+		}
+		if ( ( 0 != st.st_uid && geteuid() != st.st_uid ) || ( st.st_mode & ( S_IWGRP | S_IWOTH ) ) ) {
+			reply( "unsafe", 0, hook );
+			return;
+		}
+		
+		std::vector< char* > argv;
+		for ( size_t i = 0; i < args.size(); ++i ) argv.push_back( const_cast< char* >( args[i].c_str() ) );
+		argv.push_back( 0 );
+		
+		const std::string env_hook = "MEDIASMARTSERVERD_HOOK=" + hook;
+		char* envp[] = {
+			const_cast< char* >( "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin" ),
+			const_cast< char* >( env_hook.c_str() ),
+			0,
+		};
+		
+		// own process group (so a timeout gets everything it started),
+		// default signals, nothing to read, output only when debugging
+		posix_spawnattr_t attr;
+		posix_spawnattr_init( &attr );
+		posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF );
+		posix_spawnattr_setpgroup( &attr, 0 );
+		sigset_t none, all;
+		sigemptyset( &none );
+		sigfillset( &all );
+		posix_spawnattr_setsigmask( &attr, &none );
+		posix_spawnattr_setsigdefault( &attr, &all );
+		
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init( &actions );
+		posix_spawn_file_actions_addopen( &actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0 );
+		if ( debug ) {
+			posix_spawn_file_actions_adddup2( &actions, STDERR_FILENO, STDOUT_FILENO );
+		} else {
+			posix_spawn_file_actions_addopen( &actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0 );
+			posix_spawn_file_actions_adddup2( &actions, STDOUT_FILENO, STDERR_FILENO );
+		}
+		
+		Child child;
+		const int rc = posix_spawn( &child.pid, argv[0], &actions, &attr, &argv[0], envp );
+		posix_spawn_file_actions_destroy( &actions );
+		posix_spawnattr_destroy( &attr );
+		if ( rc ) {
+			reply( "error", rc, hook );
+			return;
+		}
+		
+		child.hook = hook;
+		child.deadline = deadline;
+		child.killed = false;
+		children.push_back( child );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (spawns the helper: a fresh copy of ourselves)
+HookRunner::HookRunner( const std::string& dir, int timeout )
+	:	dir_( dir )
+	,	pid_( -1 )
+	,	cmd_fd_( -1 )
+	,	res_fd_( -1 )
+	,	loop_( 0 )
+	,	running_( 0 )
+	,	ran_( 0 )
+	,	failed_( 0 )
+	,	timed_out_( 0 )
+	,	deduped_( 0 )
+	,	dropped_( 0 )
+{
+	int cmd[2], res[2];
+	if ( pipe2( cmd, O_CLOEXEC ) ) throw ErrnoException( "pipe2" );
+	if ( pipe2( res, O_CLOEXEC ) ) {
+		const ErrnoException e( "pipe2" );
+		close( cmd[0] );
+		close( cmd[1] );
+		throw e;
+	}
+	
+	std::ostringstream timeout_arg;
+	timeout_arg << "--hook-timeout=" << timeout;
+	const std::string dir_arg = "--hook-helper=" + dir_;
+	const std::string timeout_str = timeout_arg.str( );
+	char* argv[] = {
+		const_cast< char* >( "mediasmartserverd" ),
+		const_cast< char* >( dir_arg.c_str() ),
+		const_cast< char* >( timeout_str.c_str() ),
+		const_cast< char* >( ( debug ) ? "--debug" : 0 ),
+		0,
+	};
+	
+	// requests on its stdin, results from its stdout
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_adddup2( &actions, cmd[0], STDIN_FILENO );
+	posix_spawn_file_actions_adddup2( &actions, res[1], STDOUT_FILENO );
+	const int rc = posix_spawn( &pid_, "/proc/self/exe", &actions, 0, argv, environ );
+	posix_spawn_file_actions_destroy( &actions );
+	
+	close( cmd[0] );
+	close( res[1] );
+	if ( rc ) {
+		close( cmd[1] );
+		close( res[0] );
+		throw ErrnoException( "posix_spawn(hook helper)", rc );
+	}
+	
+	cmd_fd_ = cmd[1];
+	res_fd_ = res[0];
+	fcntl( cmd_fd_, F_SETFL, O_NONBLOCK );
+	fcntl( res_fd_, F_SETFL, O_NONBLOCK );
+	
+	if ( debug || verbose > 0 ) std::cout << "Running hooks from " << dir_ << " (helper pid " << pid_ << ")\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor (the helper finishes what it is running, then exits)
+HookRunner::~HookRunner( ) {
+	if ( loop_ ) {
+		if ( res_fd_ >= 0 ) loop_->Remove( res_fd_ );
+		if ( Armed() ) loop_->Cancel( this );
+	}
+	if ( cmd_fd_ >= 0 ) close( cmd_fd_ );
+	if ( res_fd_ >= 0 ) close( res_fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start handing runs over (anything queued before goes now)
+void HookRunner::Start( EventLoop& loop ) {
+	loop_ = &loop;
+	if ( res_fd_ >= 0 ) loop_->Add( res_fd_, this );
+	pump_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a disk was added to or removed from a bay (runs bay-added/bay-removed)
+void HookRunner::Bay( size_t bay, bool present, const std::string& model ) {
+	std::ostringstream num;
+	num << bay + 1;
+	
+	std::vector< std::string > args;
+	args.push_back( num.str() );
+	args.push_back( model );
+	Queue( ( present ) ? "bay-added" : "bay-removed", args );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run a hook with arguments (when the helper and rate limit allow)
+void HookRunner::Queue( const std::string& hook, const std::vector< std::string >& args ) {
+	if ( res_fd_ < 0 ) {
+		++dropped_;
+		return;
+	}
+	
+	// one line, tab separated (arguments can't contain either)
+	Pending run;
+	run.hook = hook;
+	run.line = hook;
+	for ( size_t i = 0; i < args.size(); ++i ) {
+		run.line += '\t';
+		for ( size_t j = 0; j < args[i].size(); ++j ) {
+			const unsigned char c = args[i][j];
+			run.line += ( c < 0x20 ) ? ' ' : (char)c;
+		}
+	}
+	if ( run.line.size() >= MAX_LINE ) run.line.resize( MAX_LINE - 1 );
+	run.line += '\n';
+	
+	for ( size_t i = 0; i < queue_.size(); ++i ) {
+		if ( queue_[i].line == run.line ) {
+			++deduped_;
+			return;
+		}
+	}
+	if ( queue_.size() >= MAX_QUEUED ) {
+		if ( debug || verbose > 0 ) std::cout << "Hook queue full, dropping " << hook << '\n';
+		++dropped_;
+		return;
+	}
+	
+	queue_.push_back( run );
+	pump_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// results from the helper
+void HookRunner::OnReadable( int ) {
+	char buf[ MAX_LINE ];
+	const ssize_t len = read( res_fd_, buf, sizeof(buf) );
+	if ( len <= 0 ) {
+		if ( len < 0 && ( EAGAIN == errno || EINTR == errno ) ) return;
+		lost_( );
+		return;
+	}
+	
+	input_.append( buf, len );
+	size_t eol;
+	while ( std::string::npos != ( eol = input_.find( '\n' ) ) ) {
+		result_( input_.substr( 0, eol ) );
+		input_.erase( 0, eol + 1 );
+	}
+	
+	pump_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a rate limited hook can run again
+void HookRunner::OnTimer( uint64_t ) {
+	pump_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void HookRunner::Report( std::ostream& os ) const {
+	os << "Hooks: " << ran_ << " ran, " << failed_ << " failed, " << timed_out_ << " timed out, "
+		<< deduped_ << " merged, " << dropped_ << " dropped, " << queue_.size() << " waiting\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// spend one of a hook's runs
+bool HookRunner::take_( Bucket& bucket, uint64_t now ) {
+	if ( BURST == bucket.tokens ) {
+		bucket.refilled = now; // starts earning once it is spent from
+	} else {
+		const uint64_t earned = ( now - bucket.refilled ) / REFILL;
+		bucket.tokens = std::min< uint64_t >( BURST, bucket.tokens + earned );
+		bucket.refilled += earned * REFILL;
+	}
+	
+	if ( !bucket.tokens ) return false;
+	--bucket.tokens;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// hand over as many runs as the helper has room for and limits allow
+void HookRunner::pump_( ) {
+	if ( !loop_ || cmd_fd_ < 0 ) return;
+	
+	const uint64_t now = loop_->Now( );
+	uint64_t next = Clock::NEVER;
+	for ( std::deque< Pending >::iterator it = queue_.begin(); it != queue_.end() && running_ < MAX_RUNNING; ) {
+		Bucket& bucket = buckets_[ it->hook ];
+		if ( !take_( bucket, now ) ) {
+			next = std::min( next, bucket.refilled + REFILL );
+			++it;
+			continue;
+		}
+		
+		// shorter than PIPE_BUF, so all or nothing
+		if ( write( cmd_fd_, it->line.data(), it->line.size() ) < 0 ) {
+			++bucket.tokens;
+			break;
+		}
+		++running_;
+		it = queue_.erase( it );
+	}
+	
+	if ( Clock::NEVER != next && running_ < MAX_RUNNING ) {
+		loop_->Arm( this, next );
+	} else if ( Armed() ) {
+		loop_->Cancel( this );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// how a run went ("<status> <code> <hook>")
+void HookRunner::result_( const std::string& line ) {
+	std::istringstream in( line );
+	std::string status, hook;
+	int code = 0;
+	in >> status >> code >> hook;
+	if ( running_ ) --running_;
+	if ( "ok" != status && "missing" != status ) Journal::Alert( code, "hook " + hook + ' ' + status );
+	
+	if ( "ok" == status ) {
+		++ran_;
+		if ( debug || verbose > 1 ) std::cout << "Hook " << hook << " ran\n";
+	} else if ( "exit" == status ) {
+		++failed_;
+		std::cout << "Hook " << hook << " exited with " << code << '\n';
+	} else if ( "signal" == status ) {
+		++failed_;
+		std::cout << "Hook " << hook << " killed by signal " << code << '\n';
+	} else if ( "timeout" == status ) {
+		++timed_out_;
+		std::cout << "Hook " << hook << " timed out and was killed\n";
+	} else if ( "error" == status ) {
+		++failed_;
+		std::cout << "Hook " << hook << " failed to start: " << strerror( code ) << '\n';
+	} else if ( "unsafe" == status ) {
+		++failed_;
+		std::cout << "Hook " << hook << " ignored: must be owned by root and writable only by its owner\n";
+	} else if ( debug || verbose > 1 ) {
+		std::cout << "No hook " << hook << " in " << dir_ << '\n';
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the helper went away (hooks are off from now on)
+void HookRunner::lost_( ) {
+	std::cout << "Hook helper exited, no more hooks will run\n";
+	Journal::Alert( 0, "hook helper exited" );
+	loop_->Remove( res_fd_ );
+	if ( Armed() ) loop_->Cancel( this );
+	close( res_fd_ );
+	close( cmd_fd_ );
+	res_fd_ = cmd_fd_ = -1;
+	
+	dropped_ += queue_.size( );
+	queue_.clear( );
+	running_ = 0;
+	waitpid( pid_, 0, WNOHANG );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run scripts as the daemon asks until it closes our stdin
+int HookRunner::Helper( const std::string& dir, int timeout ) {
+	// nothing of the daemon's but the two pipes
+	for ( int fd = STDERR_FILENO + 1, max = getdtablesize(); fd < max; ++fd ) close( fd );
+	if ( chdir( "/" ) ) { }
+	
+	// ^C on the daemon's terminal is for the daemon (it closes our stdin)
+	signal( SIGINT, SIG_IGN );
+	signal( SIGPIPE, SIG_IGN );
+	
+	sigset_t chld;
+	sigemptyset( &chld );
+	sigaddset( &chld, SIGCHLD );
+	sigprocmask( SIG_BLOCK, &chld, 0 );
+	const int sig_fd = signalfd( -1, &chld, SFD_NONBLOCK | SFD_CLOEXEC );
+	if ( sig_fd < 0 ) throw ErrnoException( "signalfd" );
+	
+	const uint64_t limit = sec_to_ns( std::max( 1, timeout ) );
+	std::vector< Child > children;
+	std::string input;
+	bool open = true;
+	
+	while ( open || !children.empty() ) {
+		// wait for a request, a child exiting or the next deadline
+		uint64_t now = mono_ns( );
+		int wait_ms = -1;
+		for ( size_t i = 0; i < children.size(); ++i ) {
+			const int ms = ( children[i].deadline > now ) ? ( children[i].deadline - now ) / 1000000 + 1 : 0;
+			if ( wait_ms < 0 || ms < wait_ms ) wait_ms = ms;
+		}
+		
+		struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { sig_fd, POLLIN, 0 } };
+		if ( !open ) fds[0].fd = -1;
+		if ( poll( fds, 2, wait_ms ) < 0 && EINTR != errno ) throw ErrnoException( "poll" );
+		now = mono_ns( );
+		
+		if ( fds[0].revents ) {
+			char buf[ MAX_LINE ];
+			const ssize_t len = read( STDIN_FILENO, buf, sizeof(buf) );
+			if ( len > 0 ) {
+				input.append( buf, len );
+				size_t eol;
+				while ( std::string::npos != ( eol = input.find( '\n' ) ) ) {
+					spawn_hook( dir, input.substr( 0, eol ), now + limit, children );
+					input.erase( 0, eol + 1 );
+				}
+			} else if ( 0 == len || EINTR != errno ) {
+				open = false;
+			}
+		}
+		
+		// reap
+		if ( fds[1].revents ) {
+			struct signalfd_siginfo info;
+			while ( read( sig_fd, &info, sizeof(info) ) > 0 ) { }
+		}
+		int status;
+		pid_t pid;
+		while ( ( pid = waitpid( -1, &status, WNOHANG ) ) > 0 ) {
+			for ( size_t i = 0; i < children.size(); ++i ) {
+				if ( pid != children[i].pid ) continue;
+				
+				const Child& child = children[i];
+				if ( child.killed ) reply( "timeout", 0, child.hook );
+				else if ( WIFSIGNALED( status ) ) reply( "signal", WTERMSIG( status ), child.hook );
+				else if ( WEXITSTATUS( status ) ) reply( "exit", WEXITSTATUS( status ), child.hook );
+				else reply( "ok", 0, child.hook );
+				
+				children.erase( children.begin() + i );
+				break;
+			}
+		}
+		
+		// overrunning scripts get SIGTERM, then SIGKILL
+		for ( size_t i = 0; i < children.size(); ++i ) {
+			Child& child = children[i];
+			if ( child.deadline > now ) continue;
+			kill( -child.pid, ( child.killed ) ? SIGKILL : SIGTERM );
+			child.deadline = now + sec_to_ns( ( child.killed ) ? 1 : KILL_GRACE );
+			child.killed = true;
+		}
+	}
+	
+	return 0;
+}
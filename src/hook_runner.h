@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file hook_runner.h
+///
+/// runs site scripts on events through a helper process
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_HOOK_RUNNER
+#define INCLUDED_HOOK_RUNNER
+
+//- includes
+#include "event_loop.h"
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// runs scripts from a hooks directory when things happen (e.g. DIR/bay-added)
+///
+/// A helper is spawned once at startup, while we are still root, and is
+/// sent one line per run over a pipe. It starts the script, kills it (and
+/// anything it started) if it runs too long, and writes back how it went.
+/// The daemon never forks or waits: runs are queued in memory and handed
+/// over as the helper has room.
+///
+/// - A run identical to one still queued is dropped.
+/// - Each hook may run BURST times back to back, then once every REFILL.
+///   Runs over the limit wait; past MAX_QUEUED they are dropped.
+/// - Scripts must be owned by root (or us) and not writable by others.
+class HookRunner : public EventLoop::Handler, public EventLoop::Timer {
+public:
+	/// where hooks are looked for by default
+	static const char* const DEFAULT_DIR;
+	
+	/// a hook earns another run this often (5s)
+	static const uint64_t REFILL = 5000000000ULL;
+	
+	enum {
+		DEFAULT_TIMEOUT	= 30,	///< seconds a script may run
+		KILL_GRACE		= 2,	///< seconds from SIGTERM to SIGKILL
+		BURST			= 4,	///< runs of one hook allowed back to back
+		MAX_RUNNING		= 2,	///< scripts running at once
+		MAX_QUEUED		= 64,	///< runs waiting beyond this are dropped
+		MAX_LINE		= 512,	///< longest request (below PIPE_BUF: one write)
+	};
+	
+	/// spawn the helper
+	/// @param timeout Seconds a script may run before it is killed
+	HookRunner( const std::string& dir, int timeout );
+	~HookRunner( );
+	
+	void Start( EventLoop& loop );
+	
+	//- publishers
+	void Bay( size_t bay, bool present, const std::string& model );
+	void Queue( const std::string& hook, const std::vector< std::string >& args );
+	
+	//- event loop
+	void OnReadable( int fd );
+	void OnTimer( uint64_t now );
+	const char* TraceName( ) const { return "hooks"; }
+	
+	//- counters
+	unsigned long Ran( ) const { return ran_; }
+	unsigned long Failed( ) const { return failed_; }
+	unsigned long TimedOut( ) const { return timed_out_; }
+	unsigned long Deduped( ) const { return deduped_; }
+	unsigned long Dropped( ) const { return dropped_; }
+	
+	void Report( std::ostream& os ) const;
+	
+	/// body of the helper process (reads runs on stdin, results to stdout)
+	static int Helper( const std::string& dir, int timeout );
+	
+private:
+	// no copying
+	HookRunner( const HookRunner& rhs );
+	const HookRunner& operator=( const HookRunner& rhs );
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// a run waiting to be handed over
+	struct Pending {
+		std::string		hook;		///< script name
+		std::string		line;		///< request as sent
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// rate limit for one hook
+	struct Bucket {
+		Bucket( ) : tokens( BURST ), refilled( 0 ) { }
+		unsigned int	tokens;		///< runs allowed now
+		uint64_t		refilled;	///< when tokens were last added
+	};
+	
+	bool take_( Bucket& bucket, uint64_t now );
+	void pump_( );
+	void result_( const std::string& line );
+	void lost_( );
+	
+	std::string				dir_;		///< hooks directory
+	pid_t					pid_;		///< helper
+	int						cmd_fd_;	///< requests to the helper
+	int						res_fd_;	///< results from the helper
+	EventLoop*				loop_;		///< loop we run from
+	std::deque< Pending >	queue_;		///< runs not yet handed over
+	std::map< std::string, Bucket > buckets_;	///< per hook rate limits
+	std::string				input_;		///< partial result line
+	unsigned int			running_;	///< runs handed over, not finished
+	
+	unsigned long			ran_;		///< scripts that exited 0
+	unsigned long			failed_;	///< scripts that failed to start or exited non-zero
+	unsigned long			timed_out_;	///< scripts killed
+	unsigned long			deduped_;	///< runs merged into a queued one
+	unsigned long			dropped_;	///< runs lost to a full queue or dead helper
+};
+
+#endif // INCLUDED_HOOK_RUNNER
@@ -0,0 +1,247 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file journal.cpp
+///
+/// crash-safe ring journal of what the daemon saw and did
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "journal.h"
+#include "errno_exception.h"
+#include "led_state.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/////////////////////////////////////////////////////////////////////////////
+const char* const Journal::DEFAULT_PATH = "/var/log/mediasmartserverd.journal";
+const char Journal::MAGIC[ 8 ] = { 'M', 'S', 'S', 'D', 'J', 'N', 'L', 1 };
+
+JournalHeader* Journal::header_ = 0;
+JournalRecord* Journal::records_ = 0;
+size_t Journal::size_ = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+namespace {
+	/// record layout is part of the file format
+	typedef char record_is_a_cache_line[ ( sizeof(JournalRecord) == Journal::RECORD_SIZE ) ? 1 : -1 ];
+	
+	LedSnapshot	last_frame;		///< last LED frame journaled
+	bool		has_frame = false;
+	
+	/// nanoseconds from a clock (vDSO, no system call)
+	uint64_t clock_ns( clockid_t id ) {
+		struct timespec ts;
+		clock_gettime( id, &ts );
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// map the journal, carrying on from its last record if the layout matches
+/// (no output: mediasmartserverd-journal links this too)
+void Journal::Enable( const std::string& path, size_t size ) {
+	Disable( );
+	
+	const uint64_t capacity = ( size > HEADER_SIZE ) ? ( size - HEADER_SIZE ) / RECORD_SIZE : 0;
+	if ( capacity < 64 ) throw std::runtime_error( path + ": journal too small" );
+	const size_t bytes = HEADER_SIZE + capacity * RECORD_SIZE;
+	
+	const int fd = open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0640 );
+	if ( fd < 0 ) throw ErrnoException( path );
+	
+	// keep an existing journal we can make sense of, otherwise start afresh
+	JournalHeader old;
+	struct stat st;
+	const bool reuse = ( 0 == fstat( fd, &st ) && size_t(st.st_size) == bytes
+		&& sizeof(old) == pread( fd, &old, sizeof(old), 0 )
+		&& 0 == memcmp( old.magic, MAGIC, sizeof(MAGIC) ) && HEADER_SIZE == old.header_size
+		&& RECORD_SIZE == old.record_size && capacity == old.capacity );
+	if ( !reuse && ( ftruncate( fd, 0 ) || ftruncate( fd, bytes ) ) ) {
+		const ErrnoException e( path );
+		close( fd );
+		throw e;
+	}
+	
+	// populated up front so records don't fault pages in
+	void* map = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == map ) throw ErrnoException( path );
+	
+	header_ = static_cast< JournalHeader* >( map );
+	if ( !reuse ) {
+		header_->header_size = HEADER_SIZE;
+		header_->record_size = RECORD_SIZE;
+		header_->capacity = capacity;
+		header_->next = 0;
+		memcpy( header_->magic, MAGIC, sizeof(MAGIC) ); // valid from here
+	}
+	records_ = reinterpret_cast< JournalRecord* >( static_cast< char* >( map ) + HEADER_SIZE );
+	size_ = bytes;
+	has_frame = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// unmap (the kernel writes back whatever is dirty)
+void Journal::Disable( ) {
+	if ( !header_ ) return;
+	munmap( header_, size_ );
+	header_ = 0;
+	records_ = 0;
+	size_ = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the daemon is up (after detaching, so the pid is right)
+void Journal::Start( const std::string& desc ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( START, seq );
+	if ( !rec ) return;
+	rec->value = getpid( );
+	rec->words[0] = clock_ns( CLOCK_REALTIME );
+	text_( rec, desc, sizeof(rec->words[0]) );
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Journal::Stop( ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( STOP, seq );
+	if ( !rec ) return;
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Journal::Udev( const std::string& action, const std::string& devpath ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( UDEV, seq );
+	if ( !rec ) return;
+	if      ( "enum"   == action ) rec->flag = ENUM;
+	else if ( "add"    == action ) rec->flag = ADD;
+	else if ( "remove" == action ) rec->flag = REMOVE;
+	else if ( "change" == action ) rec->flag = CHANGE;
+	text_( rec, devpath, 0, true );
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a device was mapped to a bay (1 based, like the log)
+void Journal::Bay( int bay, bool present, const std::string& devpath ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( BAY, seq );
+	if ( !rec ) return;
+	rec->value = bay;
+	rec->flag = present;
+	text_( rec, devpath, 0, true );
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a frame was committed (only changes are journaled)
+void Journal::Leds( const LedSnapshot& snap ) {
+	if ( !records_ ) return;
+	if ( has_frame && 0 == memcmp( snap.words, last_frame.words, sizeof(snap.words) ) ) return;
+	last_frame = snap;
+	has_frame = true;
+	
+	uint64_t seq;
+	JournalRecord* rec = begin_( LED, seq );
+	memcpy( rec->words, snap.words, sizeof(snap.words) );
+	rec->len = sizeof(snap.words);
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Journal::Alert( int code, const std::string& what ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( ALERT, seq );
+	if ( !rec ) return;
+	rec->value = code;
+	text_( rec, what );
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void Journal::Error( int code, const std::string& what ) {
+	uint64_t seq;
+	JournalRecord* rec = begin_( ERROR, seq );
+	if ( !rec ) return;
+	rec->value = code;
+	text_( rec, what );
+	end_( rec, seq );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const char* Journal::TypeName( int type ) {
+	switch ( type ) {
+	case START:	return "START";
+	case STOP:	return "STOP";
+	case UDEV:	return "UDEV";
+	case BAY:	return "BAY";
+	case LED:	return "LED";
+	case ALERT:	return "ALERT";
+	case ERROR:	return "ERROR";
+	}
+	return "?";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// claim the next slot, marking it as being written
+JournalRecord* Journal::begin_( int type, uint64_t& seq ) {
+	if ( !records_ ) return 0;
+	
+	seq = __atomic_fetch_add( &header_->next, 1, __ATOMIC_RELAXED );
+	JournalRecord* rec = &records_[ seq % header_->capacity ];
+	__atomic_store_n( &rec->seq, 0, __ATOMIC_RELAXED );
+	__atomic_signal_fence( __ATOMIC_SEQ_CST ); // invalid before it changes
+	
+	rec->time	= clock_ns( CLOCK_MONOTONIC );
+	rec->type	= type;
+	rec->flag	= 0;
+	rec->len	= 0;
+	rec->value	= 0;
+	memset( rec->words, 0, sizeof(rec->words) );
+	return rec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// publish a record (its sequence number goes last)
+void Journal::end_( JournalRecord* rec, uint64_t seq ) {
+	__atomic_store_n( &rec->seq, seq + 1, __ATOMIC_RELEASE );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// copy text into a record (the end of it if too long and tail is set)
+void Journal::text_( JournalRecord* rec, const std::string& str, size_t offset, bool tail ) {
+	const size_t room = sizeof(rec->text) - offset;
+	const size_t len = std::min( str.size(), room );
+	memcpy( rec->text + offset, str.data() + ( ( tail ) ? str.size() - len : 0 ), len );
+	rec->len = offset + len;
+}
@@ -0,0 +1,127 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file journal.h
+///
+/// crash-safe ring journal of what the daemon saw and did
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_JOURNAL
+#define INCLUDED_JOURNAL
+
+//- includes
+#include <string>
+#include <stdint.h>
+
+//- forwards
+struct LedSnapshot;
+
+/////////////////////////////////////////////////////////////////////////////
+/// journal file header (the first HEADER_SIZE bytes)
+struct JournalHeader {
+	char		magic[ 8 ];		///< Journal::MAGIC
+	uint32_t	header_size;	///< bytes before the first record
+	uint32_t	record_size;	///< bytes per record
+	uint64_t	capacity;		///< records in the ring
+	uint64_t	next;			///< sequence number of the next record
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// one record (record seq lives in slot seq % capacity)
+struct JournalRecord {
+	uint64_t	seq;			///< sequence number + 1 (0 while being written)
+	uint64_t	time;			///< CLOCK_MONOTONIC nanoseconds
+	uint8_t		type;			///< Journal::Type
+	uint8_t		flag;			///< UDEV action, BAY state
+	uint16_t	len;			///< bytes of text used
+	int32_t		value;			///< bay, pid, error code
+	union {
+		char		text[ 40 ];	///< devpath (its tail), message
+		uint64_t	words[ 5 ];	///< LED frame, START's wall clock
+	};
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// fixed size journal file mapped into memory, for looking back at what
+/// happened after the fact (mediasmartserverd-journal decodes it)
+///
+/// Records are plain stores into a shared mapping of the file: no system
+/// calls, and the page cache keeps them if we crash. A record's sequence
+/// number is written last, so one torn by a crash is recognisable. The
+/// ring carries on across restarts; each run begins with a START record
+/// and a clean exit ends with STOP.
+class Journal {
+public:
+	/// where the journal goes by default
+	static const char* const DEFAULT_PATH;
+	/// header magic ("MSSDJNL" and the layout version)
+	static const char MAGIC[ 8 ];
+	
+	enum Type {
+		START	= 1,	///< daemon started (value pid, words[0] wall clock ns, text from words[1])
+		STOP,			///< clean exit
+		UDEV,			///< device event (flag Action, text devpath)
+		BAY,			///< device mapped to a bay (value bay, flag present, text devpath)
+		LED,			///< committed LED frame changed (words LedSnapshot::words)
+		ALERT,			///< something went wrong outside the daemon (value code, text)
+		ERROR,			///< the daemon failed (value code, text)
+	};
+	
+	/// UDEV record flag
+	enum Action { OTHER, ENUM, ADD, REMOVE, CHANGE };
+	
+	enum {
+		HEADER_SIZE		= 4096,			///< one page
+		RECORD_SIZE		= 64,			///< one cache line
+		DEFAULT_SIZE	= 1024 * 1024,	///< whole file (16320 records)
+	};
+	
+	/// map (creating or resizing) the journal
+	static void Enable( const std::string& path, size_t size = DEFAULT_SIZE );
+	static void Disable( );
+	static bool Enabled( ) { return 0 != records_; }
+	
+	//- records (ignored unless enabled)
+	static void Start( const std::string& desc );
+	static void Stop( );
+	static void Udev( const std::string& action, const std::string& devpath );
+	static void Bay( int bay, bool present, const std::string& devpath );
+	static void Leds( const LedSnapshot& snap );
+	static void Alert( int code, const std::string& what );
+	static void Error( int code, const std::string& what );
+	
+	/// name of a record type (for the decoder)
+	static const char* TypeName( int type );
+	
+private:
+	static JournalRecord* begin_( int type, uint64_t& seq );
+	static void end_( JournalRecord* rec, uint64_t seq );
+	static void text_( JournalRecord* rec, const std::string& str, size_t offset = 0, bool tail = false );
+	
+	static JournalHeader*	header_;	///< mapped header
+	static JournalRecord*	records_;	///< mapped ring (0 if disabled)
+	static size_t			size_;		///< bytes mapped
+};
+
+#endif // INCLUDED_JOURNAL
@@ -0,0 +1,219 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file journal_decode.cpp
+///
+/// prints a mediasmartserverd journal (mediasmartserverd-journal)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "journal.h"
+#include "led_state.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::cout;
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// LedState (or 0 for never set) as a word
+const char* state_name( int state ) {
+	switch ( state ) {
+	case LED_OFF:	return "off";
+	case LED_ON:	return "on";
+	case LED_BLINK:	return "blink";
+	}
+	return "unset";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// UDEV record flag as the udev action
+const char* action_name( int action ) {
+	switch ( action ) {
+	case Journal::ENUM:		return "enum";
+	case Journal::ADD:		return "add";
+	case Journal::REMOVE:	return "remove";
+	case Journal::CHANGE:	return "change";
+	}
+	return "other";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// wall clock time (local, to the microsecond)
+std::string wall_time( uint64_t ns ) {
+	const time_t secs = ns / 1000000000ULL;
+	struct tm tm;
+	localtime_r( &secs, &tm );
+	char buf[ 40 ];
+	const size_t len = strftime( buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm );
+	snprintf( buf + len, sizeof(buf) - len, ".%06u", unsigned( ns % 1000000000ULL / 1000 ) );
+	return buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a record's text
+std::string text( const JournalRecord& rec, size_t offset = 0 ) {
+	const size_t len = std::min< size_t >( rec.len, sizeof(rec.text) );
+	return ( len > offset ) ? std::string( rec.text + offset, len - offset ) : std::string( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a record's devpath (only its tail was kept if it didn't fit)
+std::string devpath( const JournalRecord& rec ) {
+	return ( rec.len >= sizeof(rec.text) ) ? "..." + text( rec ) : text( rec );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// what a record says
+void print_details( const JournalRecord& rec ) {
+	switch ( rec.type ) {
+	case Journal::START:
+		cout << "pid " << rec.value << ": " << text( rec, sizeof(rec.words[0]) );
+		break;
+	case Journal::UDEV:
+		cout << action_name( rec.flag ) << ' ' << devpath( rec );
+		break;
+	case Journal::BAY:
+		cout << "bay " << rec.value << ( ( rec.flag ) ? " added" : " removed" ) << ' ' << devpath( rec );
+		break;
+	case Journal::LED: {
+		LedSnapshot snap;
+		memcpy( snap.words, rec.words, sizeof(snap.words) );
+		cout << "blue 0x" << std::hex << snap.Lit( LED_BLUE ).to_ullong()
+			<< " red 0x" << snap.Lit( LED_RED ).to_ullong() << std::dec
+			<< " system blue " << state_name( snap.System( LED_BLUE ) )
+			<< " red " << state_name( snap.System( LED_RED ) )
+			<< " brightness " << snap.Brightness( ) << " usb " << snap.Usb( );
+		break;
+	}
+	case Journal::ALERT:
+	case Journal::ERROR:
+		cout << text( rec );
+		if ( rec.value ) cout << " (" << rec.value << ')';
+		break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// sort by sequence number
+bool by_seq( const JournalRecord* lhs, const JournalRecord* rhs ) {
+	return lhs->seq < rhs->seq;
+}
+
+} // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+/// print every record still in a journal, oldest first
+int main( int argc, char* argv[] ) {
+	const std::string path = ( argc > 1 ) ? argv[1] : Journal::DEFAULT_PATH;
+	if ( argc > 2 || ( argc > 1 && '-' == argv[1][0] ) ) {
+		cout << "Usage: mediasmartserverd-journal [FILE]   (default " << Journal::DEFAULT_PATH << ")\n";
+		return 1;
+	}
+	
+	const int fd = open( path.c_str(), O_RDONLY );
+	struct stat st;
+	if ( fd < 0 || fstat( fd, &st ) ) {
+		std::cerr << path << ": " << strerror( errno ) << '\n';
+		return 1;
+	}
+	if ( size_t(st.st_size) < sizeof(JournalHeader) ) {
+		std::cerr << path << ": not a journal\n";
+		return 1;
+	}
+	const void* map = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( MAP_FAILED == map ) {
+		std::cerr << path << ": " << strerror( errno ) << '\n';
+		return 1;
+	}
+	
+	const JournalHeader& header = *static_cast< const JournalHeader* >( map );
+	if ( 0 != memcmp( header.magic, Journal::MAGIC, sizeof(Journal::MAGIC) ) || Journal::RECORD_SIZE != header.record_size
+		|| uint64_t(st.st_size) < header.header_size + header.capacity * header.record_size || !header.capacity ) {
+		std::cerr << path << ": not a journal (or from another version)\n";
+		return 1;
+	}
+	const JournalRecord* records = reinterpret_cast< const JournalRecord* >( static_cast< const char* >( map ) + header.header_size );
+	
+	// records whose sequence number belongs in their slot (others are torn)
+	std::vector< const JournalRecord* > valid;
+	unsigned long torn = 0;
+	for ( uint64_t slot = 0; slot < header.capacity; ++slot ) {
+		const JournalRecord& rec = records[ slot ];
+		if ( !rec.seq ) continue;
+		if ( ( rec.seq - 1 ) % header.capacity == slot && rec.seq <= header.next ) valid.push_back( &rec );
+		else ++torn;
+	}
+	std::sort( valid.begin(), valid.end(), by_seq );
+	
+	cout << path << ": " << header.next << " records written, last " << valid.size() << " kept";
+	if ( torn ) cout << ", " << torn << " torn";
+	cout << '\n';
+	
+	// wall clock from the latest START (its monotonic time is our anchor)
+	uint64_t mono_base = 0, wall_base = 0;
+	bool running = false;
+	int last_type = 0;
+	uint64_t expected = ( valid.empty() ) ? 0 : valid.front()->seq;
+	for ( size_t i = 0; i < valid.size(); ++i ) {
+		const JournalRecord& rec = *valid[i];
+		
+		if ( rec.seq != expected ) cout << "  ... " << rec.seq - expected << " record(s) missing\n";
+		expected = rec.seq + 1;
+		
+		if ( Journal::START == rec.type ) {
+			if ( running ) cout << ( ( Journal::ERROR == last_type ) ? "  ... exited on the error above\n" : "  ... no STOP: the previous run crashed or was killed\n" );
+			mono_base = rec.time;
+			wall_base = rec.words[0];
+			running = true;
+		}
+		
+		cout << std::setw(10) << rec.seq - 1 << "  ";
+		if ( wall_base && rec.time >= mono_base ) cout << wall_time( wall_base + ( rec.time - mono_base ) );
+		else cout << std::setw(26) << std::left << std::fixed << std::setprecision(6) << rec.time / 1e9 << std::right;
+		cout << "  " << std::setw(5) << std::left << Journal::TypeName( rec.type ) << std::right << "  ";
+		print_details( rec );
+		cout << '\n';
+		
+		if ( Journal::STOP == rec.type ) running = false;
+		last_type = rec.type;
+	}
+	if ( running ) cout << ( ( Journal::ERROR == last_type ) ? "  ... exited on the error above\n" : "  ... no STOP: still running, or crashed or was killed\n" );
+	
+	return 0;
+}
@@ -40,7 +40,7 @@
 class LedAcerH340 : public LedControlSCH5127Base {
 public:
 	/// constructor
-	LedAcerH340( ) { }
+	LedAcerH340( const PortIoPtr& io, unsigned char sio_id ) : LedControlSCH5127Base( io, sio_id ) { }
 	
 	/// destructor
 	virtual ~LedAcerH340( ) { }
@@ -55,21 +55,21 @@ public:
 		if ( !LedControlSCH5127Base::Init() ) return false;
 		
 		// set up io permissions to other ports we may use
-		if ( ioperm(io_sch5127_regs_ + REG_HWM_INDEX, 1, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_HWM_DATA,  1, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP1,       4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP2,       4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP3,       4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP4,       4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP5,       4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_sch5127_regs_ + REG_GP6,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_HWM_INDEX, 1, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_HWM_DATA,  1, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP1,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP2,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP3,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP4,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP5,       4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_GP6,       4, 1) ) throw ErrnoException("ioperm");
 		
 		//
-		if ( ioperm(io_lpc_gpiobase_ + GPO_BLINK,	4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_lpc_gpiobase_ + GP_IO_SEL,	4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_lpc_gpiobase_ + GP_IO_SEL2,	4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_lpc_gpiobase_ + GP_LVL,		4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(io_lpc_gpiobase_ + GP_LVL2,		4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_lpc_gpiobase_ + GPO_BLINK,	4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_lpc_gpiobase_ + GP_IO_SEL,	4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_lpc_gpiobase_ + GP_IO_SEL2,	4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_lpc_gpiobase_ + GP_LVL,		4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_lpc_gpiobase_ + GP_LVL2,		4, 1) ) throw ErrnoException("ioperm");
 		
 		enableLeds_( );
 		
@@ -105,8 +105,8 @@ public:
 		};
 		val = std::max( 0, std::min<int>( val, sizeof(LED_BRIGHTNESS) / sizeof(LED_BRIGHTNESS[0]) - 1 ) );
 		
-		outb( HWM_PWM3_DUTY_CYCLE, io_sch5127_regs_ + REG_HWM_INDEX );
-		outb( LED_BRIGHTNESS[val], io_sch5127_regs_ + REG_HWM_DATA  );
+		io_->Outb( HWM_PWM3_DUTY_CYCLE, io_sch5127_regs_ + REG_HWM_INDEX );
+		io_->Outb( LED_BRIGHTNESS[val], io_sch5127_regs_ + REG_HWM_DATA  );
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
@@ -121,6 +121,23 @@ public:
 		if ( led_type & LED_RED  ) setGpRegsLvl_( ioLedRed_(led_idx),  state );
 	}
 	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve LED state (read back from the GPIO level registers)
+	/// @param led_idx Which LED to query (0 -> 3)
+	/// @returns LED_BLUE, LED_RED, LED_BLUE | LED_RED or zero if off
+	virtual int Get( size_t led_idx ) {
+		if ( led_idx >= MAX_HDD_LEDS ) return 0;
+		
+		int led_type = 0;
+		if ( getGpRegsLvl_(ioLedBlue_(led_idx)) ) led_type |= LED_BLUE;
+		if ( getGpRegsLvl_(ioLedRed_(led_idx))  ) led_type |= LED_RED;
+		return led_type;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// number of drive bays
+	virtual size_t Count( ) const { return MAX_HDD_LEDS; }
+	
 protected:
 	/////////////////////////////////////////////////////////////////////////
 	/// mappings for LEDs
@@ -0,0 +1,241 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_committer.cpp
+///
+/// single stage applying queued LED intents to the hardware
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "led_committer.h"
+#include "errno_exception.h"
+#include "event_stream.h"
+#include "journal.h"
+#include "mediasmartserverd.h"
+#include "trace_events.h"
+#include <algorithm>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (on the loop thread)
+LedCommitter::LedCommitter( const LedControlPtr& leds, EventLoop& loop, size_t queue_size )
+	:	leds_( leds )
+	,	loop_( loop )
+	,	queue_( queue_size )
+	,	owner_( pthread_self( ) )
+	,	event_fd_( -1 )
+	,	wake_pending_( 0 )
+	,	frames_( 0 )
+	,	reported_( 0 )
+	,	events_( 0 )
+	,	brightness_( -1 )
+	,	usb_( -1 )
+{
+	system_[0] = system_[1] = 0;
+	
+	event_fd_ = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if ( event_fd_ < 0 ) throw ErrnoException( "eventfd" );
+	
+	loop_.Add( event_fd_, this );
+	loop_.Observe( this );
+	
+	// start from what the hardware is showing (the last port reads we do)
+	const size_t cnt = std::min( leds_->Count( ), size_t(MAX_BAYS) );
+	for ( size_t i = 0; i < cnt; ++i ) frame_.Set( leds_->Get( i ), i, true );
+	state_.Publish( frame_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+LedCommitter::~LedCommitter( ) {
+	loop_.Unobserve( this );
+	loop_.Remove( event_fd_ );
+	close( event_fd_ );
+	
+	if ( Dropped( ) && ( debug || verbose > 0 ) ) std::cerr << "LedCommitter: " << Dropped( ) << " intents dropped\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// committed bay LEDs (from the state model, not the hardware)
+int LedCommitter::Get( size_t led_idx ) {
+	LedSnapshot snap;
+	state_.Read( snap );
+	return snap.Get( led_idx );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// bays showing a colour (all from one snapshot)
+BaySet LedCommitter::Lit( int led_type ) {
+	LedSnapshot snap;
+	state_.Read( snap );
+	return snap.Lit( led_type );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// queue an intent (any thread, never blocks or touches the hardware)
+void LedCommitter::push_( LedIntent::Op op, int led_type, size_t led_idx, int value ) {
+	if ( led_idx >= MAX_BAYS ) return;
+	
+	LedIntent intent;
+	intent.op		= op;
+	intent.led_type	= led_type & ( LED_BLUE | LED_RED );
+	intent.led_idx	= led_idx;
+	intent.value	= value;
+	if ( !queue_.Push( intent ) ) return;
+	
+	// the loop thread commits at the end of its wakeup anyway
+	if ( pthread_equal( pthread_self( ), owner_ ) ) return;
+	if ( __atomic_exchange_n( &wake_pending_, 1, __ATOMIC_ACQ_REL ) ) return;
+	
+	const uint64_t one = 1;
+	if ( write( event_fd_, &one, sizeof(one) ) < 0 && EAGAIN != errno ) throw ErrnoException( "write" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// another thread queued something
+void LedCommitter::OnReadable( int fd ) {
+	uint64_t cnt;
+	if ( read( event_fd_, &cnt, sizeof(cnt) ) < 0 && EAGAIN != errno ) throw ErrnoException( "read" );
+	
+	// clear before draining so anything pushed after this wakes us again
+	__atomic_store_n( &wake_pending_, 0, __ATOMIC_RELEASE );
+	
+	// (committed once the wakeup is over)
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// end of a loop wakeup
+void LedCommitter::OnWakeup( uint64_t now ) {
+	Commit( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// fold everything queued so far into one frame and write it out
+void LedCommitter::Commit( ) {
+	LedIntent intent;
+	bool any = false;
+	while ( queue_.Pop( intent ) ) {
+		fold_( intent );
+		any = true;
+	}
+	if ( any ) apply_( );
+	if ( Dropped( ) != reported_ ) reportDropped_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the queue overflowed since the last commit (once per commit at most)
+void LedCommitter::reportDropped_( ) {
+	const unsigned long dropped = Dropped( );
+	if ( !reported_ || debug || verbose > 0 ) std::cerr << "LedCommitter: queue full, " << dropped << " intents dropped\n";
+	Journal::Alert( dropped - reported_, "LED intents dropped (queue full)" );
+	reported_ = dropped;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// later intents replace earlier ones for the same LED
+void LedCommitter::fold_( const LedIntent& intent ) {
+	switch ( intent.op ) {
+	case LedIntent::SET:
+		for ( int c = 0; c < 2; ++c ) {
+			if ( !( intent.led_type & ( 1 << c ) ) ) continue;
+			touched_[c].set( intent.led_idx );
+			value_[c][ intent.led_idx ] = !!intent.value;
+		}
+		// activity drives blue without its own LED, so keep their order
+		if ( ( intent.led_type & LED_BLUE ) && act_touched_[ intent.led_idx ] ) act_first_.set( intent.led_idx );
+		break;
+	case LedIntent::ACTIVITY:
+		act_touched_.set( intent.led_idx );
+		act_first_.reset( intent.led_idx );
+		act_value_[ intent.led_idx ] = !!intent.value;
+		break;
+	case LedIntent::SYSTEM:
+		for ( int c = 0; c < 2; ++c ) {
+			if ( intent.led_type & ( 1 << c ) ) system_[c] = intent.value;
+		}
+		break;
+	case LedIntent::BRIGHTNESS:
+		brightness_ = intent.value;
+		break;
+	case LedIntent::USB:
+		usb_ = intent.value;
+		break;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write the folded frame to the real interface
+void LedCommitter::apply_( ) {
+	TraceScope scope( "led.commit", "led" );
+	++frames_;
+	
+	leds_->BeginFrame( );
+	
+	const BaySet touched = touched_[0] | touched_[1] | act_touched_;
+	for ( size_t i = touched._Find_first(); i < MAX_BAYS; i = touched._Find_next( i ) ) {
+		if ( act_first_[i] ) leds_->SetActivity( i, act_value_[i] );
+		
+		// both colours going the same way is a single call
+		if ( touched_[0][i] && touched_[1][i] && value_[0][i] == value_[1][i] ) {
+			leds_->Set( LED_BLUE | LED_RED, i, value_[0][i] );
+			frame_.Set( LED_BLUE | LED_RED, i, value_[0][i] );
+		} else {
+			if ( touched_[0][i] ) { leds_->Set( LED_BLUE, i, value_[0][i] ); frame_.Set( LED_BLUE, i, value_[0][i] ); }
+			if ( touched_[1][i] ) { leds_->Set( LED_RED,  i, value_[1][i] ); frame_.Set( LED_RED,  i, value_[1][i] ); }
+		}
+		if ( act_touched_[i] && !act_first_[i] ) leds_->SetActivity( i, act_value_[i] );
+	}
+	touched_[0].reset( );
+	touched_[1].reset( );
+	act_touched_.reset( );
+	act_first_.reset( );
+	
+	const int SYSTEM_LEDS[] = { LED_BLUE, LED_RED };
+	for ( int c = 0; c < 2; ++c ) {
+		if ( system_[c] ) {
+			leds_->SetSystemLed( SYSTEM_LEDS[c], LedState( system_[c] ) );
+			frame_.SetSystem( SYSTEM_LEDS[c], LedState( system_[c] ) );
+		}
+		system_[c] = 0;
+	}
+	if ( brightness_ >= 0 ) {
+		leds_->SetBrightness( brightness_ );
+		frame_.SetBrightness( brightness_ );
+	}
+	if ( usb_ >= 0 ) {
+		leds_->MountUsb( !!usb_ );
+		frame_.SetUsb( !!usb_ );
+	}
+	brightness_ = usb_ = -1;
+	
+	leds_->CommitFrame( );
+	
+	// readers see the whole frame or none of it
+	state_.Publish( frame_ );
+	if ( events_ ) events_->Leds( frame_ );
+	Journal::Leds( frame_ );
+}
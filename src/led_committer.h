@@ -0,0 +1,131 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_committer.h
+///
+/// single stage applying queued LED intents to the hardware
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_COMMITTER
+#define INCLUDED_LED_COMMITTER
+
+//- includes
+#include "event_loop.h"
+#include "led_control_base.h"
+#include "led_queue.h"
+#include "led_state.h"
+#include <pthread.h>
+
+//- forwards
+class EventStream;
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED interface that queues changes for the event loop thread to apply
+///
+/// Anything may call Set and friends from any thread: they only push an
+/// intent onto a lock-free queue. At the end of every loop wakeup the queue
+/// is drained, folded (the last intent for each bay and colour wins) and
+/// written to the real interface as one frame, so port I/O only ever
+/// happens on the loop thread. Other threads wake the loop with an eventfd;
+/// the loop thread's own changes are picked up without one.
+///
+/// Each committed frame is also published to a packed state model, so Get
+/// and Lit answer from memory (any thread, no port reads). Other queries
+/// (Count, BayForDevice, ...) and SetActivityTrigger go straight to the
+/// real interface and belong on the loop thread.
+class LedCommitter : public LedControlBase, public EventLoop::Handler, public EventLoop::Observer {
+public:
+	/// default queue capacity
+	enum { QUEUE_SIZE = 1024 };
+	
+	LedCommitter( const LedControlPtr& leds, EventLoop& loop, size_t queue_size = QUEUE_SIZE );
+	~LedCommitter( );
+	
+	//- LedControlBase
+	const char* Desc( ) const { return leds_->Desc( ); }
+	bool Init( ) { return true; }
+	
+	void MountUsb( bool state )								{ push_( LedIntent::USB, 0, 0, state ); }
+	void Set( int led_type, size_t led_idx, bool state )	{ push_( LedIntent::SET, led_type, led_idx, state ); }
+	void SetActivity( size_t led_idx, bool state )			{ push_( LedIntent::ACTIVITY, 0, led_idx, state ); }
+	void SetBrightness( int val )							{ push_( LedIntent::BRIGHTNESS, 0, 0, val ); }
+	void SetSystemLed( int led_type, LedState state )		{ push_( LedIntent::SYSTEM, led_type, 0, state ); }
+	using LedControlBase::SetSystemLed;
+	
+	int  Get( size_t led_idx );
+	BaySet Lit( int led_type );
+	size_t Count( ) const			{ return leds_->Count( ); }
+	size_t HostBays( ) const		{ return leds_->HostBays( ); }
+	int BayForDevice( const std::string& devpath ) { return leds_->BayForDevice( devpath ); }
+	bool SetActivityTrigger( size_t led_idx, const std::string& devnode ) { return leds_->SetActivityTrigger( led_idx, devnode ); }
+	
+	//- event loop
+	void OnReadable( int fd );
+	void OnWakeup( uint64_t now );
+	const char* TraceName( ) const { return "led_commit"; }
+	
+	void Commit( );
+	
+	/// tell subscribers about each changed frame
+	void Events( EventStream* events ) { events_ = events; }
+	
+	/// consistent copy of the committed state (any thread)
+	void Snapshot( LedSnapshot& snap ) const { state_.Read( snap ); }
+	
+	/// frames written to the real interface
+	unsigned long Frames( ) const { return frames_; }
+	/// intents lost to a full queue
+	unsigned long Dropped( ) const { return queue_.Dropped( ); }
+	
+private:
+	void push_( LedIntent::Op op, int led_type, size_t led_idx, int value );
+	void fold_( const LedIntent& intent );
+	void apply_( );
+	void reportDropped_( );
+	
+	LedControlPtr	leds_;			///< real interface
+	EventLoop&		loop_;			///< loop we commit on
+	LedIntentQueue	queue_;			///< pending intents
+	pthread_t		owner_;			///< loop thread (doesn't need waking)
+	int				event_fd_;		///< wakes the loop for other threads
+	int				wake_pending_;	///< event_fd_ has been written
+	unsigned long	frames_;		///< frames committed
+	unsigned long	reported_;		///< drops already logged
+	EventStream*	events_;		///< subscribers (optional)
+	
+	LedSnapshot		frame_;			///< committed state (loop thread's copy)
+	LedStateModel	state_;			///< committed state (published)
+	
+	//- folded frame
+	BaySet			touched_[2];	///< blue/red set this frame
+	BaySet			value_[2];		///< blue/red state
+	BaySet			act_touched_;	///< activity set this frame
+	BaySet			act_value_;		///< activity state
+	BaySet			act_first_;		///< activity queued before the blue set
+	int				system_[2];		///< blue/red system LED state (0 if untouched)
+	int				brightness_;	///< brightness (-1 if untouched)
+	int				usb_;			///< USB state (-1 if untouched)
+};
+
+#endif // INCLUDED_LED_COMMITTER
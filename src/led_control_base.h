@@ -31,6 +31,9 @@
 #define INCLUDED_LED_CONTROL_BASE
 
 //- includes
+#include <algorithm>
+#include <bitset>
+#include <string>
 #include <tr1/memory>
 
 //- constants
@@ -39,6 +42,12 @@ enum {
 	LED_RED		= 1 << 1,
 };
 
+/// most bays we keep state for (built-in bays plus enclosure slots)
+enum { MAX_BAYS = 64 };
+
+/// one bit per bay
+typedef std::bitset< MAX_BAYS > BaySet;
+
 enum LedState {
 	LED_OFF		= 1 << 0,
 	LED_ON		= 1 << 1,
@@ -56,9 +65,49 @@ public:
 	
 	virtual void MountUsb( bool state ) = 0;
 	virtual void Set( int led_type, size_t led_idx, bool state ) = 0;
+	virtual int  Get( size_t led_idx ) = 0;
 	virtual void SetBrightness( int val ) = 0;
 	virtual void SetSystemLed( int led_type, LedState state ) = 0;
 	
+	/// number of bays
+	virtual size_t Count( ) const = 0;
+	
+	/// bays numbered by scsi_host (the rest are found via BayForDevice)
+	virtual size_t HostBays( ) const { return Count( ); }
+	
+	/// bay holding a device, if the interface knows (-1 otherwise)
+	/// @param devpath Device path relative to sysfs
+	virtual int BayForDevice( const std::string& devpath ) { return -1; }
+	
+	/// group LED changes so they are applied together (where the hardware can)
+	virtual void BeginFrame( ) { }
+	virtual void CommitFrame( ) { }
+	
+	/// let the kernel blink a bay's activity LED for a block device
+	/// @param devnode Block device (e.g. /dev/sda), empty to stop
+	/// @returns false if we can't (activity is then sampled in userspace)
+	virtual bool SetActivityTrigger( size_t led_idx, const std::string& devnode ) { return false; }
+	
+	/// show disk activity on a bay (by default flickering the blue LED off)
+	virtual void SetActivity( size_t led_idx, bool state ) { Set( LED_BLUE, led_idx, !state ); }
+	
+	/// keep the board's hardware watchdog armed (call before dropping root)
+	/// @param secs Seconds without a kick before the board resets
+	/// @returns false if there is no watchdog we can drive
+	virtual bool ArmWatchdog( unsigned int secs ) { return false; }
+	/// restart the watchdog countdown
+	virtual void KickWatchdog( ) { }
+	/// stop the watchdog (so we can exit without a reset)
+	virtual void DisarmWatchdog( ) { }
+	
+	/// bays showing an LED colour (as read back from the interface)
+	virtual BaySet Lit( int led_type ) {
+		BaySet lit;
+		const size_t cnt = std::min( Count( ), size_t(MAX_BAYS) );
+		for ( size_t i = 0; i < cnt; ++i ) lit[i] = !!( Get( i ) & led_type );
+		return lit;
+	}
+	
 	/// wrapper if someone gives us a bool
 	virtual void SetSystemLed( int led_type, bool state ) {
 		SetSystemLed( led_type, ( state ) ? LED_ON : LED_OFF );
@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_control_composite.h
+///
+/// several LED control interfaces as one contiguous set of bays
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_CONTROL_COMPOSITE
+#define INCLUDED_LED_CONTROL_COMPOSITE
+
+//- includes
+#include "led_control_base.h"
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// several LED control interfaces as one contiguous set of bays
+///
+/// Bays are numbered through the interfaces in the order they were added,
+/// e.g. the four built-in bays followed by enclosure slots. System LEDs,
+/// brightness and USB go to every interface.
+class LedControlComposite : public LedControlBase {
+public:
+	/// constructor
+	LedControlComposite( ) { }
+	
+	/// add an (initialised) interface after the bays we already have
+	void Add( const LedControlPtr& leds ) {
+		if ( !desc_.empty() ) desc_ += " + ";
+		desc_ += leds->Desc( );
+		list_.push_back( leds );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	const char* Desc( ) const { return desc_.c_str(); }
+	virtual bool Init( ) { return !list_.empty(); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	virtual void MountUsb( bool state ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->MountUsb( state );
+	}
+	virtual void SetBrightness( int val ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->SetBrightness( val );
+	}
+	virtual void SetSystemLed( int led_type, LedState state ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->SetSystemLed( led_type, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	virtual void Set( int led_type, size_t led_idx, bool state ) {
+		size_t idx = led_idx;
+		LedControlBase* leds = find_( idx );
+		if ( leds ) leds->Set( led_type, idx, state );
+	}
+	virtual int Get( size_t led_idx ) {
+		size_t idx = led_idx;
+		LedControlBase* leds = find_( idx );
+		return ( leds ) ? leds->Get( idx ) : 0;
+	}
+	virtual bool SetActivityTrigger( size_t led_idx, const std::string& devnode ) {
+		size_t idx = led_idx;
+		LedControlBase* leds = find_( idx );
+		return ( leds ) ? leds->SetActivityTrigger( idx, devnode ) : false;
+	}
+	virtual void SetActivity( size_t led_idx, bool state ) {
+		size_t idx = led_idx;
+		LedControlBase* leds = find_( idx );
+		if ( leds ) leds->SetActivity( idx, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	virtual void BeginFrame( ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->BeginFrame( );
+	}
+	virtual void CommitFrame( ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->CommitFrame( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// watchdog on whichever interface has one
+	virtual bool ArmWatchdog( unsigned int secs ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) {
+			if ( list_[i]->ArmWatchdog( secs ) ) return true;
+		}
+		return false;
+	}
+	virtual void KickWatchdog( ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->KickWatchdog( );
+	}
+	virtual void DisarmWatchdog( ) {
+		for ( size_t i = 0; i < list_.size(); ++i ) list_[i]->DisarmWatchdog( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// total bays
+	virtual size_t Count( ) const {
+		size_t cnt = 0;
+		for ( size_t i = 0; i < list_.size(); ++i ) cnt += list_[i]->Count( );
+		return cnt;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// only the first interface's bays are numbered by scsi_host
+	virtual size_t HostBays( ) const {
+		return ( list_.empty() ) ? 0 : list_.front()->HostBays( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	virtual int BayForDevice( const std::string& devpath ) {
+		size_t ofs = 0;
+		for ( size_t i = 0; i < list_.size(); ++i ) {
+			const int bay = list_[i]->BayForDevice( devpath );
+			if ( bay >= 0 ) return ofs + bay;
+			ofs += list_[i]->Count( );
+		}
+		return -1;
+	}
+	
+protected:
+	/// interface for a bay (adjusting the index to be relative to it)
+	LedControlBase* find_( size_t& led_idx ) const {
+		for ( size_t i = 0; i < list_.size(); ++i ) {
+			const size_t cnt = list_[i]->Count( );
+			if ( led_idx < cnt ) return list_[i].get();
+			led_idx -= cnt;
+		}
+		return 0;
+	}
+	
+	std::vector< LedControlPtr >	list_;	///< interfaces in bay order
+	std::string						desc_;	///< combined description
+};
+
+#endif // INCLUDED_LED_CONTROL_COMPOSITE
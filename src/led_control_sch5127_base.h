@@ -31,21 +31,30 @@
 #define INCLUDED_LED_CONTROL_SCH5127_BASE
 
 //- includes
+#include "errno_exception.h"
 #include "led_control_base.h"
 #include "mediasmartserverd.h"
+#include "port_io.h"
+#include "probe_cache.h"
+#include "probes.h"
+#include "trace_events.h"
 #include <algorithm>
 #include <assert.h>
 #include <iostream>
-#include <sys/io.h>
 
 /////////////////////////////////////////////////////////////////////////////
 /// base class for LED control over systems using the SCH5127 chipset
 class LedControlSCH5127Base : public LedControlBase {
 public:
 	/// constructor
-	LedControlSCH5127Base( )
-		:	io_lpc_gpiobase_( 0 )
+	/// @param sio_id SuperIO device id the board should have
+	LedControlSCH5127Base( const PortIoPtr& io, unsigned char sio_id )
+		:	io_( io )
+		,	sio_id_( sio_id )
+		,	io_lpc_gpiobase_( 0 )
 		,	io_sch5127_regs_( 0 )
+		,	wdt_port_( 0 )
+		,	wdt_val_( 0 )
 	{ }
 	
 	/// destructor
@@ -54,14 +63,64 @@ public:
 	/////////////////////////////////////////////////////////////////////////
 	/// attempt to initialise device
 	virtual bool Init( ) {
-		if ( !initPciLpc_( )  ) return false;
-		if ( !initSch5127_( ) ) return false;
+		ProbeResult cached;
+		if ( ProbeCache::Lookup( cached ) && chkPciDeviceVendorId_( cached.did_vid ) && chkPciLpc_( cached.did_vid ) ) {
+			// same boot, same board: take the addresses we found last time
+			if ( debug ) std::cout << "LedControlSCH5127Base: using cached probe results\n";
+			probe_ = cached;
+			io_lpc_gpiobase_ = cached.lpc_gpiobase;
+			io_sch5127_regs_ = cached.sch5127_regs;
+		} else {
+			if ( !initPciLpc_( )  ) return false;
+			if ( !initSch5127_( ) ) return false;
+			
+			probe_.lpc_gpiobase = io_lpc_gpiobase_;
+			probe_.sch5127_regs = io_sch5127_regs_;
+			ProbeCache::Store( probe_ );
+		}
 		
 		disableWatchDog_( );
 		
 		return true;
 	}
 	
+	/////////////////////////////////////////////////////////////////////////
+	/// arm the SCH5127 watchdog (it resets the board when it counts down)
+	virtual bool ArmWatchdog( unsigned int secs ) {
+		if ( !io_sch5127_regs_ || !secs ) return false;
+		
+		// counts in seconds up to 255, minutes beyond that (rounded up)
+		const bool minutes = ( secs > 255 );
+		const unsigned int val = ( minutes ) ? std::min( 255u, ( secs + 59 ) / 60 ) : secs;
+		
+		// keep access to the registers: kicking happens after we drop root
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_WDT_TIME_OUT, WDT_REG_CNT, 1) ) throw ErrnoException("ioperm");
+		
+		io_->Outb( 0, io_sch5127_regs_ + REG_WDT_CFG );
+		io_->Outb( 0, io_sch5127_regs_ + REG_WDT_CTRL );
+		io_->Outb( ( minutes ) ? 0x00 : 0x80, io_sch5127_regs_ + REG_WDT_TIME_OUT );
+		io_->Outb( val, io_sch5127_regs_ + REG_WDT_VAL ); // starts counting
+		
+		wdt_port_ = io_sch5127_regs_ + REG_WDT_VAL;
+		wdt_val_  = val;
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// reload the countdown (one write, nothing re-probed)
+	virtual void KickWatchdog( ) {
+		if ( wdt_port_ ) io_->Outb( wdt_val_, wdt_port_ );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// stop the countdown and give up the registers
+	virtual void DisarmWatchdog( ) {
+		if ( !wdt_port_ ) return;
+		zeroWatchDog_( );
+		io_->Ioperm( io_sch5127_regs_ + REG_WDT_TIME_OUT, WDT_REG_CNT, 0 );
+		wdt_port_ = 0;
+	}
+	
 protected:
 	/////////////////////////////////////////////////////////////////////////
 	/// IHR9 General Purpose I/O Registers
@@ -97,6 +156,7 @@ protected:
 		REG_WDT_VAL			= 0x66,	///< Watch-dog Timer Time-out Value
 		REG_WDT_CFG			= 0x67,	///< Watch-dog timer Configuration
 		REG_WDT_CTRL		= 0x68,	///< Watch-dog timer Control
+		WDT_REG_CNT			= REG_WDT_CTRL - REG_WDT_TIME_OUT + 1,
 		
 		REG_HWM_INDEX		= 0x70,	///< HWM Index Register (SCH5127 runtime register)
 		REG_HWM_DATA		= 0x71,	///< HWM Data Register (SCH5127 runtime register)
@@ -112,31 +172,45 @@ protected:
 	virtual bool chkPciDeviceVendorId_( unsigned int did_vid ) const = 0;
 	
 	
+	/// PCI configuration space access to the LPC bridge (device 31:0)
+	enum {
+		PCI_CONFIG_ADDRESS	= 0x0CF8,
+		PCI_CONFIG_DATA		= 0x0CFC,
+		
+		CONF_VENDOR_ID		= 0x8000F800,	///< Vendor Identification (enable, bus 0, device 31, function 0, register 0x00)
+		CONF_GPIOBASE		= 0x8000F848,	///< GPIO Base address     (enable, bus 0, device 31, function 0, register 0x48)
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// is the LPC bridge (still) the one we expect? (a single config read)
+	bool chkPciLpc_( unsigned int did_vid ) {
+		if ( io_->Ioperm(PCI_CONFIG_DATA,    4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(PCI_CONFIG_ADDRESS, 4, 1) ) throw ErrnoException("ioperm");
+		
+		io_->Outl( CONF_VENDOR_ID, PCI_CONFIG_ADDRESS );
+		const bool ok = ( did_vid == io_->Inl( PCI_CONFIG_DATA ) );
+		
+		io_->Ioperm( PCI_CONFIG_DATA,    4, 0 );
+		io_->Ioperm( PCI_CONFIG_ADDRESS, 4, 0 );
+		return ok;
+	}
+	
 	/////////////////////////////////////////////////////////////////////////
 	/// initialise LPC Interface controller via PCI
 	bool initPciLpc_( ) {
 		// The LPC bridge function of the ICH9 resides in PCI Device 31:Function 0
-		enum {
-			CONF_VENDOR_ID	= 0x8000F800,   ///< Vendor Identification (enable, bus 0, device 31, function 0, register 0x00)
-			CONF_GPIOBASE	= 0x8000F848,   ///< GPIO Base address     (enable, bus 0, device 31, function 0, register 0x48)
-		};
-		
-		// PCI configuration space
-		const unsigned int PCI_CONFIG_ADDRESS	= 0x0CF8;
-		const unsigned int PCI_CONFIG_DATA		= 0x0CFC;
-		
-		//
-		if ( ioperm(PCI_CONFIG_DATA,    4, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(PCI_CONFIG_ADDRESS, 4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(PCI_CONFIG_DATA,    4, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(PCI_CONFIG_ADDRESS, 4, 1) ) throw ErrnoException("ioperm");
 		
 		// retrieve vendor and device identification
-		outl( CONF_VENDOR_ID, PCI_CONFIG_ADDRESS );
-		const unsigned int did_vid = inl( PCI_CONFIG_DATA );
+		io_->Outl( CONF_VENDOR_ID, PCI_CONFIG_ADDRESS );
+		const unsigned int did_vid = io_->Inl( PCI_CONFIG_DATA );
 		if ( !chkPciDeviceVendorId_(did_vid) ) return false;
+		probe_.did_vid = did_vid;
 		
 		// retrieve GPIO Base Address
-		outl( CONF_GPIOBASE, PCI_CONFIG_ADDRESS );
-		io_lpc_gpiobase_ = inl( PCI_CONFIG_DATA );
+		io_->Outl( CONF_GPIOBASE, PCI_CONFIG_ADDRESS );
+		io_lpc_gpiobase_ = io_->Inl( PCI_CONFIG_DATA );
 		
 		// sanity check the address
 		// (only bits 15:6 provide an address while the rest are reserved as always being zero)
@@ -147,8 +221,8 @@ protected:
 		io_lpc_gpiobase_ &= ~0x1; // remove hardwired 1 which indicates I/O space
 		
 		// finished with these ports
-		ioperm( PCI_CONFIG_DATA,    4, 0 );
-		ioperm( PCI_CONFIG_ADDRESS, 4, 0 );
+		io_->Ioperm( PCI_CONFIG_DATA,    4, 0 );
+		io_->Ioperm( PCI_CONFIG_ADDRESS, 4, 0 );
 		
 		return true;
 	}	
@@ -168,84 +242,90 @@ protected:
 		// try LPC SIO @ 0x2e
 		unsigned int sio_addr = 0x2e;
 		unsigned int sio_data = sio_addr + 1;
-		if ( ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
-		if ( ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
 		
 		// enter configuration mode
-		outb( IDX_ENTER, sio_addr );
-		
-		// retrieve identification
-		outb( IDX_ID, sio_addr );
-		const unsigned int device_id = inb( sio_data );
-		if ( debug ) std::cout << "LedHpEx48X: Device 0x" << std::hex << device_id << std::dec << "\n";
+		io_->Outb( IDX_ENTER, sio_addr );
 		
 		// 
 		{
-			outb( 0x26, sio_addr );
-			const unsigned int in = inb( sio_data );
+			io_->Outb( 0x26, sio_addr );
+			const unsigned int in = io_->Inb( sio_data );
 			if ( 0x4e == in ) {
-				outb( IDX_EXIT, sio_addr );
+				io_->Outb( IDX_EXIT, sio_addr );
 				
 				// finished with these ports
-				ioperm( sio_addr, 1, 0 );
-				ioperm( sio_data, 1, 0 );
+				io_->Ioperm( sio_addr, 1, 0 );
+				io_->Ioperm( sio_data, 1, 0 );
 				
 				// and switch to these if we are told to
 				if ( debug ) std::cout << "LedHpEx48X: Using 0x4e\n";
 				sio_addr = 0x4e;
 				sio_data = sio_addr + 1;
 				
-				if ( ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
-		        if ( ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
+				if ( io_->Ioperm(sio_addr, 1, 1) ) throw ErrnoException("ioperm");
+		        if ( io_->Ioperm(sio_data, 1, 1) ) throw ErrnoException("ioperm");
 				
-				outb( IDX_ENTER, sio_addr );
+				io_->Outb( IDX_ENTER, sio_addr );
 			}
 		}
 		
+		// retrieve identification (not our chip: leave it alone)
+		io_->Outb( IDX_ID, sio_addr );
+		const unsigned int device_id = io_->Inb( sio_data );
+		if ( debug ) std::cout << "LedHpEx48X: Device 0x" << std::hex << device_id << std::dec << "\n";
+		if ( sio_id_ != device_id ) {
+			if ( debug || verbose > 0 ) std::cerr << "LedControlSCH5127Base: Expected SuperIO device 0x" << std::hex << unsigned(sio_id_) << " but got 0x" << device_id << std::dec << '\n';
+			io_->Outb( IDX_EXIT, sio_addr );
+			io_->Ioperm( sio_data, 1, 0 );
+			io_->Ioperm( sio_addr, 1, 0 );
+			return false;
+		}
+		
 		// select logical device 0x0a (base address?)
-		outb( IDX_LDN, sio_addr );
-		outb( 0x0a, sio_data );
+		io_->Outb( IDX_LDN, sio_addr );
+		io_->Outb( 0x0a, sio_data );
 		
 		// get base address of runtime registers
-		outb( IDX_BASE_MSB, sio_addr );
-		const unsigned int index_msb = inb( sio_data );
-		outb( IDX_BASE_LSB, sio_addr );
-		const unsigned int index_lsb = inb( sio_data );
+		io_->Outb( IDX_BASE_MSB, sio_addr );
+		const unsigned int index_msb = io_->Inb( sio_data );
+		io_->Outb( IDX_BASE_LSB, sio_addr );
+		const unsigned int index_lsb = io_->Inb( sio_data );
 		
 		io_sch5127_regs_ = index_msb << 8 | index_lsb;
 		
 		// exit configuration
-		outb( IDX_EXIT, sio_addr );
+		io_->Outb( IDX_EXIT, sio_addr );
 		
 		// finished with SuperI/O ports
-		ioperm(sio_data, 1, 0);
-		ioperm(sio_addr, 1, 0);
+		io_->Ioperm(sio_data, 1, 0);
+		io_->Ioperm(sio_addr, 1, 0);
 		
+		probe_.sio_addr = sio_addr;
 		return true;
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
 	/// disable watchdog timer
 	void disableWatchDog_( ) {
-		// watchdog registers to zero out
-		const int WDT_REGS[] = { REG_WDT_VAL, REG_WDT_TIME_OUT, REG_WDT_CFG, REG_WDT_CTRL };
-		const size_t WDT_REGS_CNT = sizeof(WDT_REGS) / sizeof(WDT_REGS[0]);
-		
-		// determine the I/O range of those registers
-		const int reg_min = *std::min_element( WDT_REGS, WDT_REGS + WDT_REGS_CNT );
-		const int reg_max = *std::max_element( WDT_REGS, WDT_REGS + WDT_REGS_CNT );
-		const int reg_cnt = reg_max - reg_min + 1;
-		
 		// get access to the entire range
-		if ( ioperm(io_sch5127_regs_ + reg_min, reg_cnt, 1) ) throw ErrnoException("ioperm");
+		if ( io_->Ioperm(io_sch5127_regs_ + REG_WDT_TIME_OUT, WDT_REG_CNT, 1) ) throw ErrnoException("ioperm");
 		
-		// zero them out
-		for ( size_t i = 0; i < WDT_REGS_CNT; ++i ) {
-			outb( 0, io_sch5127_regs_ + WDT_REGS[i] );
-		}
+		zeroWatchDog_( );
 		
 		// done
-		ioperm(io_sch5127_regs_ + reg_min, reg_cnt, 0);
+		io_->Ioperm(io_sch5127_regs_ + REG_WDT_TIME_OUT, WDT_REG_CNT, 0);
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// zero out the watchdog registers (value first so it stops counting)
+	void zeroWatchDog_( ) {
+		const int WDT_REGS[] = { REG_WDT_VAL, REG_WDT_TIME_OUT, REG_WDT_CFG, REG_WDT_CTRL };
+		const size_t WDT_REGS_CNT = sizeof(WDT_REGS) / sizeof(WDT_REGS[0]);
+		for ( size_t i = 0; i < WDT_REGS_CNT; ++i ) {
+			io_->Outb( 0, io_sch5127_regs_ + WDT_REGS[i] );
+		}
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
@@ -257,12 +337,32 @@ protected:
 	/////////////////////////////////////////////////////////////////////////
 	/// set/clear bit state
 	void doBits_( unsigned int bits, unsigned int port, bool state ) {
-		const unsigned int val = inl( port );
+		TraceScope scope( "port.batch", "port" );
+		const unsigned int val = io_->Inl( port );
 		const unsigned int new_val = ( state )
 			?	val | bits
 			:	val & ~bits
 		;
-		if ( val != new_val ) outl( new_val, port );
+		if ( val == new_val ) return;
+		
+		io_->Outl( new_val, port );
+		MSSD_PROBE3( led__commit, port, bits, new_val );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve GPIO level via io_lpc_gpiobase_
+	bool getGpLpcLvl_( int bit ) {
+		const unsigned int port = io_lpc_gpiobase_ + ((bit < 32) ? GP_LVL : GP_LVL2);
+		return io_->Inl( port ) & (1 << (bit % 32));
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve GPIO level via io_sch5127_regs_ runtime regs
+	bool getGpRegsLvl_( int bit ) {
+		const int reg = ((bit >> 4) & 0xF) - 1;
+		assert( reg >= 0 );
+		
+		return io_->Inl( io_sch5127_regs_ + REG_GP1 + reg ) & (1 << (bit & 0xF));
 	}
 	
 	/////////////////////////////////////////////////////////////////////////
@@ -295,32 +395,37 @@ protected:
 		{
 			const unsigned int gpio_use_sel  = io_lpc_gpiobase_ + GPIO_USE_SEL;
 			const unsigned int gpio_use_sel2 = io_lpc_gpiobase_ + GPIO_USE_SEL2;
-			if ( ioperm(gpio_use_sel,  4, 1) ) throw ErrnoException("ioperm");
-			if ( ioperm(gpio_use_sel2, 4, 1) ) throw ErrnoException("ioperm");
+			if ( io_->Ioperm(gpio_use_sel,  4, 1) ) throw ErrnoException("ioperm");
+			if ( io_->Ioperm(gpio_use_sel2, 4, 1) ) throw ErrnoException("ioperm");
 			
-			outl( inl(gpio_use_sel)  | bits1, gpio_use_sel  );
-			outl( inl(gpio_use_sel2) | bits2, gpio_use_sel2 );
+			io_->Outl( io_->Inl(gpio_use_sel)  | bits1, gpio_use_sel  );
+			io_->Outl( io_->Inl(gpio_use_sel2) | bits2, gpio_use_sel2 );
 			
-			ioperm( gpio_use_sel, 4, 0 );
-			ioperm( gpio_use_sel2, 4, 0 );
+			io_->Ioperm( gpio_use_sel, 4, 0 );
+			io_->Ioperm( gpio_use_sel2, 4, 0 );
 		}
 		// Input/Output select (0 = Output, 1 = Input)
 		{
 			const unsigned int gp_io_sel  = io_lpc_gpiobase_ + GP_IO_SEL;
 			const unsigned int gp_io_sel2 = io_lpc_gpiobase_ + GP_IO_SEL2;
-			if ( ioperm(gp_io_sel,  4, 1) ) throw ErrnoException("ioperm");
-			if ( ioperm(gp_io_sel2, 4, 1) ) throw ErrnoException("ioperm");
+			if ( io_->Ioperm(gp_io_sel,  4, 1) ) throw ErrnoException("ioperm");
+			if ( io_->Ioperm(gp_io_sel2, 4, 1) ) throw ErrnoException("ioperm");
 			
-			outl( inl(gp_io_sel)  & ~bits1, gp_io_sel  );
-			outl( inl(gp_io_sel2) & ~bits2, gp_io_sel2 );
+			io_->Outl( io_->Inl(gp_io_sel)  & ~bits1, gp_io_sel  );
+			io_->Outl( io_->Inl(gp_io_sel2) & ~bits2, gp_io_sel2 );
 			
-			ioperm( gp_io_sel, 4, 0 );
-			ioperm( gp_io_sel2, 4, 0 );
+			io_->Ioperm( gp_io_sel, 4, 0 );
+			io_->Ioperm( gp_io_sel2, 4, 0 );
 		}
 	}
 	
+	PortIoPtr	 io_;				///< port I/O access
+	unsigned char sio_id_;			///< SuperIO device id we expect
 	unsigned int io_lpc_gpiobase_;	///< I/O offset to LPC GPIO on the IHR9
 	unsigned int io_sch5127_regs_;	///< I/O offset to SCH5127 runtime registers
+	unsigned int wdt_port_;			///< watchdog value register while armed (0 otherwise)
+	unsigned int wdt_val_;			///< value a kick reloads
+	ProbeResult	 probe_;			///< what probing found (or the cache said)
 };
 
 #endif // INCLUDED_LED_CONTROL_SCH5127_BASE
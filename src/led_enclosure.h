@@ -0,0 +1,198 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_enclosure.h
+///
+/// LED control for SCSI Enclosure Services (SES) slots via sysfs
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_ENCLOSURE
+#define INCLUDED_LED_ENCLOSURE
+
+//- includes
+#include "errno_exception.h"
+#include "led_control_base.h"
+#include "mediasmartserverd.h"
+#include "sysfs.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED control for SCSI Enclosure Services (SES) slots via sysfs
+///
+/// Every slot of every /sys/class/enclosure device becomes a bay: blue
+/// drives the slot's "active" indicator and red its "fault" indicator.
+/// Attribute files are held open and only written when the state changes.
+class LedEnclosure : public LedControlBase {
+public:
+	/// constructor
+	/// @param sysfs_root Where sysfs is mounted (a fabricated tree for testing)
+	LedEnclosure( const std::string& sysfs_root = "/sys" )
+		:	sysfs_root_( sysfs_root )
+	{ }
+	
+	/// destructor
+	virtual ~LedEnclosure( ) {
+		for ( size_t i = 0; i < slots_.size(); ++i ) {
+			if ( slots_[i].fd_active >= 0 ) close( slots_[i].fd_active );
+			if ( slots_[i].fd_fault  >= 0 ) close( slots_[i].fd_fault  );
+		}
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	const char* Desc( ) const { return "SCSI enclosure slots"; }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// find enclosure slots
+	virtual bool Init( ) {
+		// the sysfs root as the kernel would resolve it (to map device links)
+		char real_root[ PATH_MAX ];
+		if ( !realpath( sysfs_root_.c_str(), real_root ) ) return false;
+		real_root_ = real_root;
+		
+		const std::string class_dir = sysfs_root_ + "/class/enclosure";
+		std::vector< std::string > enclosures = sysfs_list_dir( class_dir );
+		std::sort( enclosures.begin(), enclosures.end() );
+		
+		for ( size_t i = 0; i < enclosures.size(); ++i ) {
+			const std::string encl_dir = class_dir + '/' + enclosures[i];
+			
+			// slots are the sub directories with indicator attributes
+			std::vector< Slot > encl_slots;
+			std::vector< std::string > entries = sysfs_list_dir( encl_dir );
+			for ( size_t j = 0; j < entries.size(); ++j ) {
+				Slot slot;
+				slot.path = encl_dir + '/' + entries[j];
+				if ( !sysfs_is_file( slot.path + "/fault" ) && !sysfs_is_file( slot.path + "/active" ) ) continue;
+				
+				slot.number		= sysfs_read_number( slot.path + "/slot", int(j) );
+				slot.fd_active	= open( (slot.path + "/active").c_str(), O_RDWR | O_CLOEXEC );
+				slot.fd_fault	= open( (slot.path + "/fault").c_str(),  O_RDWR | O_CLOEXEC );
+				slot.state		= readState_( slot );
+				encl_slots.push_back( slot );
+			}
+			
+			// order slots within an enclosure by their slot number
+			std::sort( encl_slots.begin(), encl_slots.end() );
+			slots_.insert( slots_.end(), encl_slots.begin(), encl_slots.end() );
+		}
+		
+		if ( debug ) std::cout << "LedEnclosure: " << slots_.size() << " slots\n";
+		return !slots_.empty();
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// nothing to do for these
+	virtual void MountUsb( bool ) { }
+	virtual void SetBrightness( int ) { }
+	virtual void SetSystemLed( int, LedState ) { }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// control leds
+	/// @param led_type LED type to turn on/off LED_BLUE, LED_RED, LED_BLUE | LED_RED
+	/// @param led_idx Which slot
+	/// @param state Whether we are turning LED on (true) or off (false)
+	virtual void Set( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= slots_.size() ) return;
+		Slot& slot = slots_[ led_idx ];
+		
+		if ( led_type & LED_BLUE ) writeState_( slot, LED_BLUE, slot.fd_active, state );
+		if ( led_type & LED_RED  ) writeState_( slot, LED_RED,  slot.fd_fault,  state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve LED state (as last written)
+	virtual int Get( size_t led_idx ) {
+		return ( led_idx < slots_.size() ) ? slots_[ led_idx ].state : 0;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// number of slots
+	virtual size_t Count( ) const { return slots_.size(); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// which slot holds a device (via the slot's device link)
+	/// @param devpath Device path relative to sysfs (e.g. /devices/.../0:0:0:0
+	///                or a child of it such as its block device)
+	virtual int BayForDevice( const std::string& devpath ) {
+		const std::string path = real_root_ + devpath;
+		for ( size_t i = 0; i < slots_.size(); ++i ) {
+			char target[ PATH_MAX ];
+			if ( !realpath( (slots_[i].path + "/device").c_str(), target ) ) continue; // empty slot
+			
+			const size_t len = strlen( target );
+			if ( 0 == path.compare( 0, len, target ) && ( path.size() == len || '/' == path[len] ) ) return i;
+		}
+		return -1;
+	}
+	
+protected:
+	/////////////////////////////////////////////////////////////////////////
+	/// an enclosure slot
+	struct Slot {
+		std::string	path;		///< slot directory
+		int			number;		///< slot number (for ordering)
+		int			fd_active;	///< "active" attribute
+		int			fd_fault;	///< "fault" attribute
+		int			state;		///< LED_BLUE | LED_RED as last written
+		
+		bool operator<( const Slot& rhs ) const { return number < rhs.number; }
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// write an indicator attribute if it changed
+	void writeState_( Slot& slot, int led_type, int fd, bool state ) {
+		if ( fd < 0 || !(slot.state & led_type) == !state ) return;
+		
+		if ( pwrite( fd, state ? "1" : "0", 1, 0 ) < 0 ) {
+			if ( debug || verbose > 0 ) std::cerr << "LedEnclosure: " << slot.path << ": " << strerror(errno) << '\n';
+			return;
+		}
+		slot.state = ( state ) ? slot.state | led_type : slot.state & ~led_type;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// current indicator state
+	static int readState_( const Slot& slot ) {
+		int state = 0;
+		char ch;
+		if ( slot.fd_active >= 0 && 1 == pread( slot.fd_active, &ch, 1, 0 ) && '1' == ch ) state |= LED_BLUE;
+		if ( slot.fd_fault  >= 0 && 1 == pread( slot.fd_fault,  &ch, 1, 0 ) && '1' == ch ) state |= LED_RED;
+		return state;
+	}
+	
+	std::string			sysfs_root_;	///< where sysfs is mounted
+	std::string			real_root_;		///< sysfs_root_ with links resolved
+	std::vector< Slot >	slots_;			///< every slot (bay order)
+};
+
+#endif // INCLUDED_LED_ENCLOSURE
@@ -0,0 +1,210 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_gpio.h
+///
+/// LED control through a GPIO chip (kernel GPIO driver owns the pins)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_GPIO
+#define INCLUDED_LED_GPIO
+
+//- includes
+#include "gpio_lines.h"
+#include "led_control_base.h"
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// which GPIO lines drive which LEDs (-1 if a board doesn't have one)
+struct GpioPinMap {
+	enum { MAX_BAYS = 8 };
+	
+	const char*	desc;				///< board description
+	size_t		bays;				///< number of bays
+	int			blue[ MAX_BAYS ];	///< bay blue LEDs
+	int			red[ MAX_BAYS ];	///< bay red LEDs
+	int			system_blue;		///< system LEDs
+	int			system_red;
+	int			usb;				///< USB device (active high)
+	bool		active_low;			///< LEDs light when the line is low
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED control through a GPIO chip (e.g. the gpio-ich kernel driver)
+///
+/// Every LED line is requested once as a single line request, and all the
+/// changes made between BeginFrame and CommitFrame go out together as one
+/// GPIO_V2_LINE_SET_VALUES_IOCTL. No port access (or root) needed.
+class LedGpio : public LedControlBase {
+public:
+	/// the ICH9 GPIOs of the HP MediaSmart Server ex48X (line = GPIO number)
+	static const GpioPinMap& HpEx48X( ) {
+		static const GpioPinMap MAP = {
+			"HP MediaSmart Server 48X (GPIO chip)", 4,
+			{ 22, 21, 13, 57, -1, -1, -1, -1 },
+			{  4,  5, 38, 39, -1, -1, -1, -1 },
+			28, 27, 7, true,
+		};
+		return MAP;
+	}
+	
+	/// constructor
+	LedGpio( const GpioLinesPtr& lines, const GpioPinMap& map = HpEx48X() )
+		:	lines_( lines )
+		,	map_( map )
+		,	system_blue_( 0 )
+		,	system_red_( 0 )
+		,	usb_( 0 )
+		,	invert_( 0 )
+		,	levels_( 0 )
+		,	applied_( 0 )
+		,	frame_depth_( 0 )
+	{
+		for ( size_t i = 0; i < GpioPinMap::MAX_BAYS; ++i ) blue_[i] = red_[i] = 0;
+	}
+	
+	/// destructor
+	virtual ~LedGpio( ) { }
+	
+	/////////////////////////////////////////////////////////////////////////
+	const char* Desc( ) const { return map_.desc; }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// request every line (all LEDs off)
+	virtual bool Init( ) {
+		const size_t bays = std::min< size_t >( map_.bays, GpioPinMap::MAX_BAYS );
+		for ( size_t i = 0; i < bays; ++i ) {
+			blue_[i] = addLine_( map_.blue[i], map_.active_low );
+			red_[i]  = addLine_( map_.red[i],  map_.active_low );
+		}
+		system_blue_ = addLine_( map_.system_blue, map_.active_low );
+		system_red_  = addLine_( map_.system_red,  map_.active_low );
+		usb_         = addLine_( map_.usb, false );
+		if ( offsets_.empty() ) return false;
+		
+		lines_->Request( offsets_, levels_ ^ invert_ );
+		applied_ = levels_;
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// (un)mount USB device
+	virtual void MountUsb( bool state ) {
+		setBits_( usb_, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// brightness is a SuperIO PWM, not a GPIO
+	virtual void SetBrightness( int ) { }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set system LED (no hardware blink through a GPIO chip, so blink is on)
+	virtual void SetSystemLed( int led_type, LedState state ) {
+		uint64_t mask = 0;
+		if ( led_type & LED_BLUE ) mask |= system_blue_;
+		if ( led_type & LED_RED  ) mask |= system_red_;
+		setBits_( mask, LED_OFF != state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// control leds
+	/// @param led_type LED type to turn on/off LED_BLUE, LED_RED, LED_BLUE | LED_RED
+	/// @param led_idx Which bay
+	/// @param state Whether we are turning LED on (true) or off (false)
+	virtual void Set( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= Count() ) return;
+		
+		uint64_t mask = 0;
+		if ( led_type & LED_BLUE ) mask |= blue_[ led_idx ];
+		if ( led_type & LED_RED  ) mask |= red_[ led_idx ];
+		setBits_( mask, state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve LED state (as requested, we own the lines)
+	virtual int Get( size_t led_idx ) {
+		if ( led_idx >= Count() ) return 0;
+		
+		int led_type = 0;
+		if ( levels_ & blue_[ led_idx ] ) led_type |= LED_BLUE;
+		if ( levels_ & red_[ led_idx ]  ) led_type |= LED_RED;
+		return led_type;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// number of drive bays
+	virtual size_t Count( ) const { return std::min< size_t >( map_.bays, GpioPinMap::MAX_BAYS ); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// hold changes back until the frame is committed
+	virtual void BeginFrame( ) { ++frame_depth_; }
+	virtual void CommitFrame( ) {
+		if ( frame_depth_ > 0 && 0 == --frame_depth_ ) flush_( );
+	}
+	
+protected:
+	/////////////////////////////////////////////////////////////////////////
+	/// add a line to the request
+	/// @returns its bit in our masks (zero if there is no such line)
+	uint64_t addLine_( int offset, bool active_low ) {
+		if ( offset < 0 || offsets_.size() >= GPIO_V2_LINES_MAX ) return 0;
+		
+		const uint64_t bit = 1ULL << offsets_.size();
+		offsets_.push_back( offset );
+		if ( active_low ) invert_ |= bit;
+		return bit;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// turn lines on or off (logically)
+	void setBits_( uint64_t mask, bool state ) {
+		levels_ = ( state ) ? levels_ | mask : levels_ & ~mask;
+		if ( 0 == frame_depth_ ) flush_( );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// write whatever changed in one go
+	void flush_( ) {
+		const uint64_t changed = levels_ ^ applied_;
+		if ( !changed ) return;
+		
+		lines_->Set( changed, levels_ ^ invert_ );
+		applied_ = levels_;
+	}
+	
+	GpioLinesPtr				lines_;			///< GPIO lines
+	const GpioPinMap&			map_;			///< pin map
+	std::vector< unsigned int >	offsets_;		///< requested lines
+	uint64_t					blue_[ GpioPinMap::MAX_BAYS ];	///< bits for bay LEDs
+	uint64_t					red_[ GpioPinMap::MAX_BAYS ];
+	uint64_t					system_blue_;	///< bits for system LEDs
+	uint64_t					system_red_;
+	uint64_t					usb_;			///< bit for USB device
+	uint64_t					invert_;		///< active low lines
+	uint64_t					levels_;		///< logical levels (1 = lit)
+	uint64_t					applied_;		///< levels last written
+	int							frame_depth_;	///< nested BeginFrame calls
+};
+
+#endif // INCLUDED_LED_GPIO
@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_queue.h
+///
+/// bounded lock-free queue of LED intents (many producers, one committer)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_QUEUE
+#define INCLUDED_LED_QUEUE
+
+//- includes
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// something a producer wants the LEDs to show
+struct LedIntent {
+	enum Op {
+		SET,			///< bay LED(s) on/off
+		ACTIVITY,		///< bay activity on/off
+		SYSTEM,			///< system LED state
+		BRIGHTNESS,		///< LED brightness
+		USB,			///< USB device mounted/unmounted
+	};
+	
+	uint8_t		op;			///< what to do
+	uint8_t		led_type;	///< LED_BLUE and/or LED_RED
+	uint16_t	led_idx;	///< bay
+	int32_t		value;		///< state, LedState or brightness
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// bounded multi-producer, single-consumer queue of LED intents
+///
+/// Every cell carries a sequence number saying whose turn it is: producers
+/// claim a cell by advancing tail_ with a compare-and-swap and publish it by
+/// bumping the cell's sequence, so Push never locks and a slow producer
+/// only holds up the consumer at its own cell. Storage is allocated once.
+class LedIntentQueue {
+public:
+	/// @param capacity Cells (rounded up to a power of two)
+	LedIntentQueue( size_t capacity )
+		:	head_( 0 )
+		,	tail_( 0 )
+		,	dropped_( 0 )
+	{
+		size_t cnt = 2;
+		while ( cnt < capacity ) cnt <<= 1;
+		mask_ = cnt - 1;
+		
+		cells_.resize( cnt );
+		for ( size_t i = 0; i < cnt; ++i ) cells_[i].seq = i;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// add an intent (any thread)
+	/// @returns false if the queue is full (the intent is dropped)
+	bool Push( const LedIntent& intent ) {
+		unsigned long pos = __atomic_load_n( &tail_, __ATOMIC_RELAXED );
+		Cell* cell;
+		for ( ;; ) {
+			cell = &cells_[ pos & mask_ ];
+			const unsigned long seq = __atomic_load_n( &cell->seq, __ATOMIC_ACQUIRE );
+			const long dif = long(seq) - long(pos);
+			if ( 0 == dif ) {
+				// our turn: claim it (pos is refreshed if someone beat us)
+				if ( __atomic_compare_exchange_n( &tail_, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) break;
+			} else if ( dif < 0 ) {
+				// consumer hasn't freed it yet
+				__atomic_fetch_add( &dropped_, 1, __ATOMIC_RELAXED );
+				return false;
+			} else {
+				pos = __atomic_load_n( &tail_, __ATOMIC_RELAXED );
+			}
+		}
+		
+		cell->intent = intent;
+		__atomic_store_n( &cell->seq, pos + 1, __ATOMIC_RELEASE );
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// take the oldest published intent (committer thread only)
+	bool Pop( LedIntent& intent ) {
+		Cell& cell = cells_[ head_ & mask_ ];
+		if ( __atomic_load_n( &cell.seq, __ATOMIC_ACQUIRE ) != head_ + 1 ) return false;
+		
+		intent = cell.intent;
+		__atomic_store_n( &cell.seq, head_ + mask_ + 1, __ATOMIC_RELEASE );
+		++head_;
+		return true;
+	}
+	
+	/// intents lost to a full queue
+	unsigned long Dropped( ) const { return __atomic_load_n( &dropped_, __ATOMIC_RELAXED ); }
+	
+	size_t Capacity( ) const { return mask_ + 1; }
+	
+private:
+	// no copying
+	LedIntentQueue( const LedIntentQueue& rhs );
+	const LedIntentQueue& operator=( const LedIntentQueue& rhs );
+	
+	/////////////////////////////////////////////////////////////////////////
+	struct Cell {
+		unsigned long	seq;	///< pos + 1 once published, pos + capacity once free again
+		LedIntent		intent;	///< payload
+	};
+	
+	enum { CACHE_LINE = 64 };
+	
+	std::vector< Cell >	cells_;		///< ring storage
+	size_t				mask_;		///< capacity - 1
+	char				pad0_[ CACHE_LINE ];
+	unsigned long		head_;		///< next cell to consume (consumer only)
+	char				pad1_[ CACHE_LINE ];
+	unsigned long		tail_;		///< next cell to claim (producers)
+	char				pad2_[ CACHE_LINE ];
+	unsigned long		dropped_;	///< intents lost to a full queue
+};
+
+#endif // INCLUDED_LED_QUEUE
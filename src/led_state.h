@@ -0,0 +1,159 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_state.h
+///
+/// packed LED state published with a sequence counter
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_STATE
+#define INCLUDED_LED_STATE
+
+//- includes
+#include "led_control_base.h"
+#include <stdint.h>
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// every LED we drive, packed into a few words
+///
+/// Bays take two bits each (blue, red), 32 bays to a word. The last word
+/// holds the system LEDs, brightness and USB state; zero there means we
+/// haven't been told.
+struct LedSnapshot {
+	enum {
+		BAY_WORDS	= MAX_BAYS * 2 / 64,
+		SYS_WORD	= BAY_WORDS,
+		WORDS		= BAY_WORDS + 1,
+		
+		// SYS_WORD layout
+		SYS_BLUE_SHIFT		= 0,	///< LedState of the blue system LED (3 bits)
+		SYS_RED_SHIFT		= 3,	///< LedState of the red system LED (3 bits)
+		SYS_STATE_MASK		= 0x7,
+		BRIGHTNESS_SHIFT	= 8,	///< brightness + 1 (4 bits)
+		BRIGHTNESS_MASK		= 0xF,
+		USB_SHIFT			= 12,	///< 1 unmounted, 2 mounted (2 bits)
+		USB_MASK			= 0x3,
+	};
+	
+	LedSnapshot( ) { memset( words, 0, sizeof(words) ); }
+	
+	/// LED_BLUE and/or LED_RED lit on a bay
+	int Get( size_t led_idx ) const {
+		if ( led_idx >= MAX_BAYS ) return 0;
+		return ( words[ led_idx / 32 ] >> ( 2 * (led_idx % 32) ) ) & ( LED_BLUE | LED_RED );
+	}
+	void Set( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= MAX_BAYS ) return;
+		const uint64_t bits = uint64_t( led_type & ( LED_BLUE | LED_RED ) ) << ( 2 * (led_idx % 32) );
+		uint64_t& word = words[ led_idx / 32 ];
+		word = ( state ) ? word | bits : word & ~bits;
+	}
+	
+	/// bays showing a colour
+	BaySet Lit( int led_type ) const {
+		BaySet lit;
+		for ( size_t i = 0; i < MAX_BAYS; ++i ) lit[i] = !!( Get( i ) & led_type );
+		return lit;
+	}
+	
+	/// system LED state (0 if never set)
+	int System( int led_type ) const {
+		return field_( ( LED_RED == led_type ) ? SYS_RED_SHIFT : SYS_BLUE_SHIFT, SYS_STATE_MASK );
+	}
+	void SetSystem( int led_type, LedState state ) {
+		if ( led_type & LED_BLUE ) setField_( SYS_BLUE_SHIFT, SYS_STATE_MASK, state );
+		if ( led_type & LED_RED  ) setField_( SYS_RED_SHIFT,  SYS_STATE_MASK, state );
+	}
+	
+	/// brightness (-1 if never set)
+	int Brightness( ) const { return int( field_( BRIGHTNESS_SHIFT, BRIGHTNESS_MASK ) ) - 1; }
+	void SetBrightness( int val ) { setField_( BRIGHTNESS_SHIFT, BRIGHTNESS_MASK, val + 1 ); }
+	
+	/// USB device mounted (-1 if never set)
+	int Usb( ) const { return int( field_( USB_SHIFT, USB_MASK ) ) - 1; }
+	void SetUsb( bool state ) { setField_( USB_SHIFT, USB_MASK, ( state ) ? 2 : 1 ); }
+	
+	uint64_t words[ WORDS ];	///< packed state
+	
+private:
+	unsigned int field_( int shift, unsigned int mask ) const {
+		return ( words[ SYS_WORD ] >> shift ) & mask;
+	}
+	void setField_( int shift, unsigned int mask, unsigned int val ) {
+		words[ SYS_WORD ] &= ~( uint64_t(mask) << shift );
+		words[ SYS_WORD ] |= uint64_t( val & mask ) << shift;
+	}
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// the authoritative LED state, readable from any thread without locking
+///
+/// A seqlock: the single writer makes the sequence odd, stores the words
+/// and makes it even again; readers retry until they see the same even
+/// sequence either side of copying the words out.
+class LedStateModel {
+public:
+	LedStateModel( ) : seq_( 0 ) { memset( words_, 0, sizeof(words_) ); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// make a new state visible (one writer only)
+	void Publish( const LedSnapshot& snap ) {
+		const unsigned long seq = __atomic_load_n( &seq_, __ATOMIC_RELAXED );
+		__atomic_store_n( &seq_, seq + 1, __ATOMIC_RELAXED );
+		__atomic_thread_fence( __ATOMIC_RELEASE );
+		for ( size_t i = 0; i < LedSnapshot::WORDS; ++i ) {
+			__atomic_store_n( &words_[i], snap.words[i], __ATOMIC_RELAXED );
+		}
+		__atomic_store_n( &seq_, seq + 2, __ATOMIC_RELEASE );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// consistent copy of the current state (any thread)
+	void Read( LedSnapshot& snap ) const {
+		for ( ;; ) {
+			const unsigned long seq = __atomic_load_n( &seq_, __ATOMIC_ACQUIRE );
+			if ( seq & 1 ) continue; // mid-publish
+			
+			for ( size_t i = 0; i < LedSnapshot::WORDS; ++i ) {
+				snap.words[i] = __atomic_load_n( &words_[i], __ATOMIC_RELAXED );
+			}
+			__atomic_thread_fence( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n( &seq_, __ATOMIC_RELAXED ) == seq ) return;
+		}
+	}
+	
+	/// states published so far
+	unsigned long Version( ) const { return __atomic_load_n( &seq_, __ATOMIC_ACQUIRE ) / 2; }
+	
+private:
+	// no copying
+	LedStateModel( const LedStateModel& rhs );
+	const LedStateModel& operator=( const LedStateModel& rhs );
+	
+	unsigned long	seq_;						///< odd while publishing
+	uint64_t		words_[ LedSnapshot::WORDS ];	///< published state
+};
+
+#endif // INCLUDED_LED_STATE
@@ -0,0 +1,347 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file led_sysfs.h
+///
+/// LED control through the Linux LED class (/sys/class/leds)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LED_SYSFS
+#define INCLUDED_LED_SYSFS
+
+//- includes
+#include "errno_exception.h"
+#include "led_control_base.h"
+#include "mediasmartserverd.h"
+#include "sysfs.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED control through the Linux LED class (/sys/class/leds)
+///
+/// For boxes where a kernel driver owns the GPIOs. Which LED is which comes
+/// from a map file, one LED per line:
+///
+///   # bay   colour  name under /sys/class/leds
+///   0       blue    mediasmart:blue:hdd0
+///   0       red     mediasmart:red:hdd0
+///   0       activity mediasmart:green:hdd0
+///   system  blue    mediasmart:blue:system
+///
+/// Bays are numbered from zero. Brightness (and trigger) files are held open
+/// and only written when an LED changes. Activity LEDs are handed to the
+/// kernel's blkdev trigger when it is available.
+class LedSysfs : public LedControlBase {
+public:
+	/// constructor
+	/// @param map_path LED map file
+	/// @param sysfs_root Where sysfs is mounted (a fabricated tree for testing)
+	LedSysfs( const std::string& map_path, const std::string& sysfs_root = "/sys" )
+		:	map_path_( map_path )
+		,	sysfs_root_( sysfs_root )
+		,	brightness_( 10 )
+	{
+		system_[0] = system_[1] = -1;
+	}
+	
+	/// destructor
+	virtual ~LedSysfs( ) {
+		for ( size_t i = 0; i < leds_.size(); ++i ) {
+			if ( leds_[i].fd_brightness >= 0 ) close( leds_[i].fd_brightness );
+			if ( leds_[i].fd_trigger    >= 0 ) close( leds_[i].fd_trigger    );
+		}
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	const char* Desc( ) const { return "Linux LED class"; }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// read the LED map and open every LED in it
+	virtual bool Init( ) {
+		std::ifstream in( map_path_.c_str() );
+		if ( !in ) throw ErrnoException( map_path_ );
+		
+		std::string line;
+		for ( int line_no = 1; std::getline( in, line ); ++line_no ) {
+			std::istringstream fields( line.substr( 0, line.find( '#' ) ) );
+			std::string bay, colour, name;
+			if ( !(fields >> bay) ) continue;
+			if ( !(fields >> colour >> name) ) throw badLine_( line_no, "expected <bay> <colour> <name>" );
+			
+			int colour_idx = -1;
+			if ( "blue" == colour ) colour_idx = 0;
+			else if ( "red" == colour ) colour_idx = 1;
+			else if ( "activity" == colour ) colour_idx = 2;
+			else throw badLine_( line_no, "colour should be blue, red or activity" );
+			
+			const int led = openLed_( name );
+			if ( led < 0 ) {
+				if ( verbose ) std::cerr << "LedSysfs: no LED '" << name << "'\n";
+				continue;
+			}
+			
+			if ( "system" == bay ) {
+				if ( colour_idx > 1 ) throw badLine_( line_no, "system LEDs are blue or red" );
+				system_[ colour_idx ] = led;
+			} else {
+				char* end = 0;
+				const long idx = strtol( bay.c_str(), &end, 10 );
+				if ( *end || idx < 0 || idx > 1023 ) throw badLine_( line_no, "bay should be a number or 'system'" );
+				
+				if ( size_t(idx) >= bays_.size() ) bays_.resize( idx + 1, Bay() );
+				bays_[ idx ].led[ colour_idx ] = led;
+			}
+		}
+		
+		if ( debug ) std::cout << "LedSysfs: " << leds_.size() << " LEDs, " << bays_.size() << " bays\n";
+		return !leds_.empty();
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// USB is the kernel's business
+	virtual void MountUsb( bool ) { }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set brightness (scaled to each LED's max_brightness)
+	/// @param val 0 (off) to 10 (full)
+	virtual void SetBrightness( int val ) {
+		brightness_ = std::max( 0, std::min( val, 10 ) );
+		for ( size_t i = 0; i < leds_.size(); ++i ) {
+			if ( !leds_[i].on ) continue;
+			leds_[i].on = false; // force a rewrite
+			setLed_( leds_[i], true );
+		}
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// set system LED (off, on, or blink)
+	virtual void SetSystemLed( int led_type, LedState state ) {
+		if ( led_type & LED_BLUE ) setSystemLed_( system_[0], state );
+		if ( led_type & LED_RED  ) setSystemLed_( system_[1], state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// control leds
+	/// @param led_type LED type to turn on/off LED_BLUE, LED_RED, LED_BLUE | LED_RED
+	/// @param led_idx Which bay
+	/// @param state Whether we are turning LED on (true) or off (false)
+	virtual void Set( int led_type, size_t led_idx, bool state ) {
+		if ( led_idx >= bays_.size() ) return;
+		const Bay& bay = bays_[ led_idx ];
+		
+		if ( (led_type & LED_BLUE) && bay.led[0] >= 0 ) setLed_( leds_[ bay.led[0] ], state );
+		if ( (led_type & LED_RED)  && bay.led[1] >= 0 ) setLed_( leds_[ bay.led[1] ], state );
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// retrieve LED state (as last written)
+	virtual int Get( size_t led_idx ) {
+		if ( led_idx >= bays_.size() ) return 0;
+		const Bay& bay = bays_[ led_idx ];
+		
+		int led_type = 0;
+		if ( bay.led[0] >= 0 && leds_[ bay.led[0] ].on ) led_type |= LED_BLUE;
+		if ( bay.led[1] >= 0 && leds_[ bay.led[1] ].on ) led_type |= LED_RED;
+		return led_type;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// number of bays in the map
+	virtual size_t Count( ) const { return bays_.size(); }
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// bind a bay's activity LED to a block device with the blkdev trigger
+	/// @param devnode Block device (e.g. /dev/sda), empty to unbind
+	virtual bool SetActivityTrigger( size_t led_idx, const std::string& devnode ) {
+		if ( led_idx >= bays_.size() || bays_[ led_idx ].led[2] < 0 ) return false;
+		Led& led = leds_[ bays_[ led_idx ].led[2] ];
+		
+		if ( !led.devnode.empty() ) {
+			// trigger goes back to none (which also turns the LED off)
+			writeFile_( led.dir + "/unlink_dev_by_path", led.devnode );
+			writeAttr_( led, led.fd_trigger, "none" );
+			led.devnode.clear( );
+			led.on = false;
+		}
+		if ( devnode.empty() ) return true;
+		
+		// is the trigger there at all? (CONFIG_LEDS_TRIGGER_BLKDEV)
+		char buf[ 4096 ];
+		const ssize_t len = ( led.fd_trigger >= 0 ) ? pread( led.fd_trigger, buf, sizeof(buf) - 1, 0 ) : -1;
+		if ( len <= 0 ) return false;
+		buf[ len ] = 0;
+		if ( !hasWord_( buf, "blkdev" ) ) return false;
+		
+		if ( !writeAttr_( led, led.fd_trigger, "blkdev" ) ) return false;
+		if ( !writeFile_( led.dir + "/link_dev_by_path", devnode ) ) {
+			writeAttr_( led, led.fd_trigger, "none" );
+			return false;
+		}
+		
+		if ( debug || verbose > 1 ) std::cout << "LedSysfs: " << led.name << " blinks for " << devnode << '\n';
+		led.devnode = devnode;
+		return true;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// show disk activity (sampled in userspace)
+	virtual void SetActivity( size_t led_idx, bool state ) {
+		if ( led_idx >= bays_.size() ) return;
+		if ( bays_[ led_idx ].led[2] < 0 ) return LedControlBase::SetActivity( led_idx, state );
+		setLed_( leds_[ bays_[ led_idx ].led[2] ], state );
+	}
+	
+protected:
+	/////////////////////////////////////////////////////////////////////////
+	/// an LED class device
+	struct Led {
+		std::string	name;
+		std::string	dir;			///< LED class directory
+		std::string	devnode;		///< block device the kernel blinks it for
+		int			fd_brightness;
+		int			fd_trigger;
+		int			max_brightness;
+		bool		on;				///< as last written
+		bool		blinking;		///< timer trigger set
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// LEDs of a bay (indices into leds_, -1 if none)
+	struct Bay {
+		Bay( ) { led[0] = led[1] = led[2] = -1; }
+		int led[3];	///< blue, red, activity
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// open an LED (once)
+	/// @returns index into leds_ or -1 if it doesn't exist
+	int openLed_( const std::string& name ) {
+		for ( size_t i = 0; i < leds_.size(); ++i ) {
+			if ( name == leds_[i].name ) return i;
+		}
+		
+		const std::string dir = sysfs_root_ + "/class/leds/" + name;
+		Led led;
+		led.name			= name;
+		led.dir				= dir;
+		led.fd_brightness	= open( (dir + "/brightness").c_str(), O_RDWR | O_CLOEXEC );
+		if ( led.fd_brightness < 0 ) return -1;
+		led.fd_trigger		= open( (dir + "/trigger").c_str(), O_RDWR | O_CLOEXEC );
+		led.max_brightness	= std::max( 1, sysfs_read_number( dir + "/max_brightness", 1 ) );
+		led.on				= sysfs_read_number( dir + "/brightness", 0 ) > 0;
+		led.blinking		= false;
+		
+		leds_.push_back( led );
+		return leds_.size() - 1;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// switch an LED if it changed
+	void setLed_( Led& led, bool state ) {
+		if ( led.on == state && !led.blinking ) return;
+		if ( !led.devnode.empty() ) return; // blkdev trigger owns it
+		
+		// we drive it from here on
+		if ( led.blinking ) {
+			writeAttr_( led, led.fd_trigger, "none" );
+			led.blinking = false;
+		}
+		
+		char buf[ 16 ];
+		const int level = ( state ) ? std::max( 1, led.max_brightness * brightness_ / 10 ) : 0;
+		snprintf( buf, sizeof(buf), "%d", level );
+		if ( writeAttr_( led, led.fd_brightness, buf ) ) led.on = state;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// system LED (blinking is left to the kernel's timer trigger)
+	void setSystemLed_( int idx, LedState state ) {
+		if ( idx < 0 ) return;
+		Led& led = leds_[ idx ];
+		
+		if ( LED_BLINK != state ) {
+			setLed_( led, LED_ON == state );
+		} else if ( !led.blinking && writeAttr_( led, led.fd_trigger, "timer" ) ) {
+			led.blinking = true;
+		}
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// write an attribute
+	static bool writeAttr_( const Led& led, int fd, const char* val ) {
+		if ( fd >= 0 && pwrite( fd, val, strlen(val), 0 ) >= 0 ) return true;
+		
+		if ( debug || verbose > 0 ) std::cerr << "LedSysfs: " << led.name << ": " << strerror( (fd < 0) ? ENOENT : errno ) << '\n';
+		return false;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// write a (rarely used) attribute we don't keep open
+	static bool writeFile_( const std::string& path, const std::string& val ) {
+		const int fd = open( path.c_str(), O_WRONLY | O_CLOEXEC );
+		const bool ok = fd >= 0 && write( fd, val.data(), val.size() ) >= 0;
+		if ( !ok && ( debug || verbose > 0 ) ) std::cerr << "LedSysfs: " << path << ": " << strerror(errno) << '\n';
+		if ( fd >= 0 ) close( fd );
+		return ok;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// whether a trigger list ("none [timer] blkdev") has a trigger
+	static bool hasWord_( const char* list, const char* word ) {
+		const size_t len = strlen( word );
+		for ( const char* pos = strstr( list, word ); pos; pos = strstr( pos + 1, word ) ) {
+			const bool start = ( pos == list || ' ' == pos[-1] || '[' == pos[-1] );
+			const char end = pos[ len ];
+			if ( start && ( !end || ' ' == end || ']' == end || '\n' == end ) ) return true;
+		}
+		return false;
+	}
+	
+	/////////////////////////////////////////////////////////////////////////
+	std::runtime_error badLine_( int line_no, const char* msg ) const {
+		std::ostringstream err;
+		err << map_path_ << ':' << line_no << ": " << msg;
+		return std::runtime_error( err.str() );
+	}
+	
+	std::string			map_path_;		///< LED map file
+	std::string			sysfs_root_;	///< where sysfs is mounted
+	int					brightness_;	///< 0 to 10
+	std::vector< Led >	leds_;			///< every LED we opened
+	std::vector< Bay >	bays_;			///< LEDs for each bay
+	int					system_[2];		///< system blue, red (or -1)
+};
+
+#endif // INCLUDED_LED_SYSFS
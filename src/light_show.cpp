@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file light_show.cpp
+///
+/// LED light shows
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "light_show.h"
+#include "probes.h"
+#include "trace_events.h"
+#include <stdlib.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+/// @param light_show 1 for holiday lights, otherwise 2+ selects chasers etc
+/// @param seed Random seed (for holiday lights)
+LightShow::LightShow( const LedControlPtr& leds, int light_show, unsigned int seed )
+	:	leds_( leds )
+	,	bays_( leds->Count( ) )
+	,	loop_( 0 )
+	,	show_mode_( 0 )
+	,	light_leds_( 0 )
+	,	state_( 0 )
+	,	seed_( seed )
+	,	next_( 0 )
+	,	frames_( 0 )
+{
+	if ( 1 == light_show ) {
+		// holiday lights
+	} else {
+		show_mode_ = (light_show - 2) % 4 + 1;
+		switch ( (light_show - 2) / 4 ) {
+		default:
+		case 0: light_leds_ = LED_BLUE; break;
+		case 1: light_leds_ = LED_RED;  break;
+		case 2: light_leds_ = LED_BLUE | LED_RED; break;
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start rendering frames on an event loop
+void LightShow::Start( EventLoop& loop ) {
+	loop_ = &loop;
+	next_ = loop.Now( );
+	loop.Arm( this, next_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// render a frame and schedule the next one
+void LightShow::OnTimer( uint64_t now ) {
+	Frame( );
+	
+	// keep a steady cadence, but don't try to catch up if we fell behind
+	next_ += FRAME_INTERVAL;
+	if ( next_ <= now ) {
+		MSSD_PROBE1( timer__overrun, now - next_ + FRAME_INTERVAL );
+		next_ = now + FRAME_INTERVAL;
+	}
+	loop_->Arm( this, next_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// render a single frame
+void LightShow::Frame( ) {
+	TraceScope scope( "show.frame", "show" );
+	++frames_;
+	MSSD_PROBE2( show__frame, show_mode_, frames_ );
+	
+	// the whole frame goes out at once (where the LED interface can)
+	leds_->BeginFrame( );
+	
+	switch ( show_mode_ ) {
+	case 0: // holiday lights
+	{
+		for ( size_t i = 0; i < bays_; ++i ) {
+			int light_leds;
+			switch ( rand_r( &seed_ ) % 4 ) {
+			default:
+			case 0: light_leds = 0; break;
+			case 1: light_leds = LED_BLUE; break;
+			case 2: light_leds = LED_RED;  break;
+			case 3: light_leds = LED_BLUE | LED_RED; break;
+			}
+			
+			leds_->Set(  light_leds, i, true );
+			leds_->Set( ~light_leds, i, false );
+		}
+		break;
+	}
+	case 1: // descending chasers
+	{
+		for ( size_t i = 0; i < bays_; ++i ) leds_->Set( light_leds_, i, (i == (bays_ - 1 - state_)) );
+		if ( ++state_ >= bays_ ) state_ = 0;
+		break;
+	}
+	case 2: // ascending chasers
+	{
+		for ( size_t i = 0; i < bays_; ++i ) leds_->Set( light_leds_, i, (i == state_) );
+		if ( ++state_ >= bays_ ) state_ = 0;
+		break;
+	}
+	case 3: // knight rider
+	{
+		// there and back again (a single bay just stays lit)
+		const size_t period = ( bays_ > 1 ) ? 2 * (bays_ - 1) : 1;
+		const size_t sel = ( state_ < bays_ ) ? state_ : period - state_;
+		for ( size_t i = 0; i < bays_; ++i ) leds_->Set( light_leds_, i, (i == sel) );
+		if ( ++state_ >= period ) state_ = 0;
+		break;
+	}
+	case 4: // pulsing
+	{
+		for ( size_t i = 0; i < bays_; ++i ) leds_->Set( light_leds_, i, true );
+		const size_t sel = 1 + ( ( state_ < 9 ) ? state_ : 16 - state_ );
+		leds_->SetBrightness( sel );
+		if ( ++state_ >= 16 ) state_ = 0;
+		break;
+	}
+	}
+	
+	leds_->CommitFrame( );
+}
@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file light_show.h
+///
+/// LED light shows
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_LIGHT_SHOW
+#define INCLUDED_LIGHT_SHOW
+
+//- includes
+#include "event_loop.h"
+#include "led_control_base.h"
+
+/////////////////////////////////////////////////////////////////////////////
+/// LED light shows (one frame per timer tick)
+class LightShow : public EventLoop::Timer {
+public:
+	/// time between frames
+	static const uint64_t FRAME_INTERVAL = 200000000ULL;
+	
+	LightShow( const LedControlPtr& leds, int light_show, unsigned int seed );
+	
+	bool Valid( ) const { return show_mode_ <= 4; }
+	void Start( EventLoop& loop );
+	void Frame( );
+	
+	/// number of frames rendered
+	unsigned long Frames( ) const { return frames_; }
+	
+	void OnTimer( uint64_t now );
+	const char* TraceName( ) const { return "light_show"; }
+	
+private:
+	LedControlPtr	leds_;			///< led control interface
+	size_t			bays_;			///< bays the show runs across
+	EventLoop*		loop_;			///< loop we are running on
+	size_t			show_mode_;		///< which show
+	int				light_leds_;	///< LEDs used by the show
+	size_t			state_;			///< position in the show
+	unsigned int	seed_;			///< random number state
+	uint64_t		next_;			///< next frame due
+	unsigned long	frames_;		///< frames rendered
+};
+
+#endif // INCLUDED_LIGHT_SHOW
@@ -29,32 +29,54 @@
 /////////////////////////////////////////////////////////////////////////////
 
 //- includes
+#include "activity_monitor.h"
+#include "bench.h"
+#include "board_registry.h"
+#include "bpf_activity.h"
 #include "errno_exception.h"
 #include "device_monitor.h"
-#include "led_acerh340.h"
-#include "led_hpex485.h"
+#include "event_stream.h"
+#include "hook_runner.h"
+#include "journal.h"
+#include "led_committer.h"
+#include "led_control_composite.h"
+#include "led_enclosure.h"
+#include "led_gpio.h"
+#include "led_sysfs.h"
+#include "probe_cache.h"
+#include "light_show.h"
+#include "scheduler.h"
+#include "sim_gpio_lines.h"
+#include "sim_port_io.h"
+#include "soak.h"
+#include "trace_events.h"
+#include "watchdog.h"
+#include "worker_pool.h"
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <getopt.h>
 #include <pwd.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/select.h>
 
 using std::cout;
 
 //- globals
 int debug = 0;		///< show debug messages
 int verbose = 0;	///< how much debugging we spew out
+volatile sig_atomic_t exit_signalled = 0;	///< SIGINT or SIGTERM arrived
 
 
 
 /////////////////////////////////////////////////////////////////////////////
 /// our signal handler
-static void sig_handler( int ) { }
+static void sig_handler( int ) { exit_signalled = 1; }
 
 /////////////////////////////////////////////////////////////////////////////
 /// register signal handlers
@@ -65,6 +87,10 @@ void init_signals( ) {
 	sigemptyset( &sa.sa_mask );
 	if ( -1 == sigaction(SIGINT,  &sa, 0) ) throw ErrnoException( "sigaction(SIGINT)"  );
 	if ( -1 == sigaction(SIGTERM, &sa, 0) ) throw ErrnoException( "sigaction(SIGTERM)" );
+	
+	// a dead peer (hook helper, event client) is an error, not a signal
+	sa.sa_handler = SIG_IGN;
+	if ( -1 == sigaction(SIGPIPE, &sa, 0) ) throw ErrnoException( "sigaction(SIGPIPE)" );
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -79,31 +105,106 @@ void drop_priviledges( ) {
 
 /////////////////////////////////////////////////////////////////////////////
 /// attempt to get an LED control interface
-LedControlPtr get_led_interface( ) {
+/// @param board Board we know we are on (otherwise probe each driver in turn)
+LedControlPtr get_led_interface( const PortIoPtr& io, const BoardDesc* board ) {
 	LedControlPtr control;
 	
-	// H340
-	control.reset( new LedAcerH340 );
-	if ( control->Init( ) ) return control;
-	
-	// HP48X
-	control.reset( new LedHpEx48X );
-	if ( control->Init( ) ) return control;
+	if ( board ) {
+		control = board->create( io, *board );
+		return ( control->Init( ) ) ? control : LedControlPtr( );
+	}
 	
+	// probe every driver (once each)
+	const BoardRegistry::ListBoards& boards = BoardRegistry::Boards( );
+	for ( size_t i = 0; i < boards.size(); ++i ) {
+		bool tried = false;
+		for ( size_t j = 0; j < i && !tried; ++j ) tried = ( boards[j]->create == boards[i]->create );
+		if ( tried ) continue;
+		
+		control = boards[i]->create( io, *boards[i] );
+		if ( control->Init( ) ) return control;
+	}
 	
 	return LedControlPtr( );
 }
 
+/////////////////////////////////////////////////////////////////////////////
+/// add enclosure slots after the built-in bays
+/// @param leds Built-in interface (may be null)
+/// @param sysfs_root Where sysfs is mounted
+LedControlPtr add_enclosures( const LedControlPtr& leds, const std::string& sysfs_root ) {
+	LedControlPtr enclosure( new LedEnclosure( sysfs_root ) );
+	if ( !enclosure->Init( ) ) {
+		if ( verbose ) cout << "No enclosure slots under " << sysfs_root << '\n';
+		return leds;
+	}
+	if ( !leds ) return enclosure;
+	
+	std::tr1::shared_ptr< LedControlComposite > composite( new LedControlComposite );
+	composite->Add( leds );
+	composite->Add( enclosure );
+	return composite;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// create simulated port I/O for a board
+/// @param board "ex48x" or "h340"
+SimPortIoPtr get_sim_port_io( const std::string& board ) {
+	const BoardDesc* desc = BoardRegistry::Find( board );
+	if ( desc ) return SimPortIoPtr( new SimPortIo( desc->did_vid ) );
+	
+	throw std::runtime_error( "Unknown board to simulate '" + board + "' (try " + BoardRegistry::Names() + ")" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// set all bay LEDs
+void clear_leds( const LedControlPtr& leds, bool state ) {
+	for ( size_t i = 0; i < leds->Count(); ++i ) leds->Set( LED_BLUE | LED_RED, i, state );
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// show command line help
 int show_help( ) {
 	cout << "Usage: mediasmartserverd [OPTION]...\n"
+		<< "     --activity[=MS]   Show disk activity on bay LEDs (kernel blkdev trigger, or\n"
+		<< "                       sampled every MS milliseconds, default 100)\n"
+		<< "     --activity-bpf    Count sampled disks' I/O with BPF on the block tracepoints\n"
+		<< "     --board=NAME      Skip board detection (" << BoardRegistry::Names() << ")\n"
+		<< "     --bench[=FILE]    Run benchmarks on simulated hardware (JSON to FILE or stdout)\n"
+		<< "     --bench-baseline=FILE  Compare benchmarks against FILE, fail on regression\n"
+		<< "     --bench-tolerance=PCT  Allowed slowdown for timings (default 25)\n"
+		<< "     --bench-trace=FILE     Include replay of a recorded trace in the benchmarks\n"
 		<< "     --brightness=X    Set LED brightness (1 to 10)\n"
+		<< "     --control-socket[=PATH]  Push bay, LED and activity events to clients of a\n"
+		<< "                       Unix socket (default " << EventStream::DEFAULT_PATH << ")\n"
 		<< " -D, --daemon          Detach and run in the background\n"
 		<< "     --debug           Print debug messages\n"
+		<< "     --enclosure[=DIR] Also drive SCSI enclosure slot LEDs (sysfs at DIR)\n"
+		<< "     --gpio=CHIP       Drive the LEDs through a GPIO chip (e.g. /dev/gpiochip0,\n"
+		<< "                       or 'sim' for an in-memory one)\n"
 		<< "     --help            Print help text\n"
+		<< "     --hook-timeout=SECS  Kill hook scripts running longer (default " << HookRunner::DEFAULT_TIMEOUT << ")\n"
+		<< "     --hooks[=DIR]     Run scripts in DIR when disks are added or removed\n"
+		<< "                       (default " << HookRunner::DEFAULT_DIR << ")\n"
+		<< "     --io-uring        Read sampled disks' stat files in one io_uring batch\n"
+		<< "     --iterations=N    Replay the trace N times\n"
+		<< "     --journal[=FILE]  Keep a crash-safe record of events and LED changes in FILE\n"
+		<< "                       (default " << Journal::DEFAULT_PATH << ", read with mediasmartserverd-journal)\n"
+		<< "     --led-map=FILE    Drive Linux LED class devices named in FILE\n"
+		<< "     --probe-cache=DIR Cache hardware probe results in DIR ('none' to disable,\n"
+		<< "                       default /run/mediasmartserverd unless simulating)\n"
+		<< "     --record=FILE     Record udev events to a trace file\n"
+		<< "     --replay=FILE     Replay a trace file against a simulated board and report timings\n"
+		<< "     --simulate=BOARD  Use simulated hardware (ex48x or h340)\n"
+		<< "     --sim-time=SECS   Run for SECS of simulated time (as fast as possible)\n"
+		<< "     --soak=DAYS       Soak test against simulated hardware and hotplug events\n"
+		<< "     --sysfs=DIR       Where sysfs is mounted (default /sys)\n"
+		<< "     --trace-events=FILE  Record event loop activity as Chrome trace-event JSON\n"
+		<< "                       (written on exit and on SIGUSR2)\n"
 		<< " -v, --verbose         verbose (use twice to be more verbose)\n" 
 		<< " -V, --version         Show version number\n" 
+		<< "     --wakeup-budget=N Soak test fails above N wakeups per simulated hour\n"
+		<< "     --watchdog[=SECS] Keep the board's watchdog armed and kick it (default 240)\n"
 	;
 	
 	return 0;
@@ -116,115 +217,214 @@ int show_version( ) {
 	return 0;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+/// how often we woke up (always for simulated time, otherwise if verbose)
+void report_wakeups( EventLoop& loop, uint64_t started ) {
+	const bool simulated = loop.GetClock()->Virtual( );
+	if ( !simulated && verbose <= 0 ) return;
+	
+	const double secs = ( loop.Now( ) - started ) / 1e9;
+	const double per_sec = ( secs > 0 ) ? loop.Wakeups() / secs : 0;
+	cout << ( simulated ? "Simulated " : "Ran " ) << std::fixed << std::setprecision(2) << secs / 3600 << " hours: "
+		<< loop.Wakeups() << " wakeups (" << std::setprecision(1) << per_sec * 3600 << " per hour, "
+		<< std::setprecision(3) << per_sec << " per second)\n";
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// run a light show
-int run_light_show( const LedControlPtr& leds, int light_show ) {
+int run_light_show( const LedControlPtr& leds, EventLoop& loop, int light_show ) {
+	const uint64_t started = loop.Now( );
 	
-	int light_leds = 0;
-	size_t show_mode = 0;
-	if ( 1 == light_show ) {
-		// holiday lights
-		srand( time(0) );
-	} else {
-		show_mode = (light_show - 2) % 4 + 1;
-		switch ( (light_show - 2) / 4 ) {
-		default:
-		case 0: light_leds = LED_BLUE; break;
-		case 1: light_leds = LED_RED;  break;
-		case 2: light_leds = LED_BLUE | LED_RED; break;
-		}
+	// holiday lights are only random when running in real time
+	const bool virtual_time = loop.GetClock()->Virtual( );
+	LightShow show( leds, light_show, ( virtual_time ) ? 1 : time(0) );
+	if ( !show.Valid() ) {
+		cout << "Unsupported light show\n";
+		return 1;
 	}
 	
+	show.Start( loop );
+	loop.Run( );
 	
-	size_t state = 0;
+	if ( virtual_time ) cout << "Rendered " << show.Frames() << " frames\n";
+	report_wakeups( loop, started );
 	
-	sigset_t sigempty;
-	sigemptyset( &sigempty );
-	while ( true ) {
+	return 0;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+/// nanoseconds from a monotonic clock
+static unsigned long long now_ns( ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// replay a recorded trace through the device monitor as fast as we can
+int run_replay( const std::string& path, const std::string& board, int iterations ) {
+	DeviceTrace trace;
+	LoadDeviceTrace( path, trace );
+	if ( trace.events.empty() ) throw std::runtime_error( path + ": no events" );
+	
+	// enumerated devices are processed as a group (like DeviceMonitor::Init)
+	std::vector< ListDeviceEvents > steps;
+	for ( size_t i = 0; i < trace.events.size(); ++i ) {
+		const bool enumerated = ( "enum" == trace.events[i].action );
+		if ( !enumerated || steps.empty() || "enum" != steps.back().back().action ) {
+			steps.push_back( ListDeviceEvents() );
+		}
+		steps.back().push_back( trace.events[i] );
+	}
+	
+	std::vector< unsigned long long > latencies;
+	latencies.reserve( trace.events.size() * std::max( 1, iterations ) );
+	unsigned long long total_ns = 0;
+	unsigned long port_ops = 0;
+	bool state_ok = true;
+	BaySet blue, red;
+	
+	for ( int iter = 0; iter < std::max( 1, iterations ); ++iter ) {
+		SimPortIoPtr io = get_sim_port_io( board );
+		LedControlPtr leds = get_led_interface( io, BoardRegistry::Find( board ) );
+		if ( !leds ) throw std::runtime_error( "Simulated board failed to initialise" );
+		clear_leds( leds, false );
+		
+		DeviceMonitor monitor;
+		monitor.Attach( leds );
+		io->ResetCounters( );
+		
+		// keep per device chatter out of the timings
+		std::streambuf* cout_buf = ( debug || verbose ) ? 0 : std::cout.rdbuf( 0 );
 		
-		switch ( show_mode ) {
-		case 0: // holiday lights
-		{
-			for ( size_t i = 0; i < 4; ++i ) {
-				switch ( rand() % 4 ) {
-				default:
-				case 0: light_leds = 0; break;
-				case 1: light_leds = LED_BLUE; break;
-				case 2: light_leds = LED_RED;  break;
-				case 3: light_leds = LED_BLUE | LED_RED; break;
-				}
-				
-				leds->Set(  light_leds, i, true );
-				leds->Set( ~light_leds, i, false );
+		for ( size_t i = 0; i < steps.size(); ++i ) {
+			const ListDeviceEvents& step = steps[i];
+			const unsigned long long start = now_ns( );
+			if ( "enum" == step.front().action ) {
+				monitor.Enumerated( step );
+			} else {
+				monitor.Dispatch( step.front() );
 			}
-			break;
-		}
-		case 1: // descending chasers
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == (3 - state)) );
-			if ( ++state >= 4 ) state = 0;
-			break;
+			const unsigned long long elapsed = now_ns( ) - start;
+			
+			total_ns += elapsed;
+			for ( size_t j = 0; j < step.size(); ++j ) latencies.push_back( elapsed / step.size() );
 		}
-		case 2: // ascending chasers
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == state) );
-			if ( ++state >= 4 ) state = 0;
-			break;
-		}
-		case 3: // knight rider
-		{
-			const size_t sel = ( state < 3 ) ? state : 6 - state;
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, (i == sel) );
-			if ( ++state >= 6 ) state = 0;
-			break;
-		}
-		case 4: // pulsing
-		{
-			for ( size_t i = 0; i < 4; ++i ) leds->Set( light_leds, i, true );
-			const size_t sel = 1 + ( ( state < 9 ) ? state : 16 - state );
-			leds->SetBrightness( sel );
-			if ( ++state >= 16 ) state = 0;
-			break;
-		}
-		default:
-			cout << "Unsupported light show\n";
-			return 1;
+		
+		if ( cout_buf ) {
+			std::cout.rdbuf( cout_buf );
+			std::cout.clear( );
 		}
+		port_ops += io->Ops( );
 		
+		// read back what the hardware is showing
+		blue = leds->Lit( LED_BLUE );
+		red  = leds->Lit( LED_RED );
 		
-		// wait a bit
-		struct timespec timeout = { 0, 200000000 };
-		int res = pselect( 0, 0, 0, 0, &timeout, &sigempty );
-		if ( res < 0 ) {
-			if ( EINTR != errno ) throw ErrnoException( "select" );
-			cout << "Exiting on signal\n";
-			break; // signalled
+		const BaySet exp_blue = ( trace.has_state ) ? trace.blue : monitor.PresentBays( );
+		const BaySet exp_red  = ( trace.has_state ) ? trace.red  : BaySet( );
+		if ( blue != exp_blue || red != exp_red ) {
+			if ( state_ok ) {
+				cout << "Final LED state mismatch: blue 0x" << std::hex << blue.to_ulong() << " red 0x" << red.to_ulong()
+					<< ", expected blue 0x" << exp_blue.to_ulong() << " red 0x" << exp_red.to_ulong() << std::dec << '\n';
+			}
+			state_ok = false;
 		}
 	}
 	
-	return 0;
+	// report
+	std::sort( latencies.begin(), latencies.end() );
+	const size_t cnt = latencies.size();
+	const double secs = total_ns / 1e9;
+	cout << "Replayed " << trace.events.size() << " events x " << std::max( 1, iterations )
+		<< " in " << std::fixed << std::setprecision(6) << secs << "s"
+		<< " (" << std::setprecision(0) << ( ( secs > 0 ) ? cnt / secs : 0 ) << " events/sec)\n"
+		<< "Latency ns/event: min " << latencies.front()
+		<< ", median " << latencies[ cnt / 2 ]
+		<< ", p99 " << latencies[ std::min( cnt - 1, cnt * 99 / 100 ) ]
+		<< ", max " << latencies.back() << '\n'
+		<< "Port I/O: " << port_ops << " ops (" << std::setprecision(2) << double(port_ops) / cnt << " per event)\n"
+		<< "Final LED state: " << ( state_ok ? "OK" : "MISMATCH" )
+		<< " (blue 0x" << std::hex << blue.to_ulong() << " red 0x" << red.to_ulong() << std::dec << ")\n";
+	
+	return ( state_ok ) ? 0 : 1;
 }
 
-
 /////////////////////////////////////////////////////////////////////////////
 /// main entry point
 int main( int argc, char* argv[] ) try {
+	int activity_ms = 0;
+	bool activity_bpf = false;
+	bool io_uring = false;
+	std::string control_socket;
+	bool bench = false;
+	std::string bench_output;
+	std::string bench_baseline;
+	std::string board_name;
+	std::string enclosure_root;
+	std::string hooks_dir;
+	std::string journal_path;
+	std::string hook_helper;
+	int hook_timeout = HookRunner::DEFAULT_TIMEOUT;
+	std::string gpio_chip;
+	std::string led_map;
+	std::string sysfs_root = "/sys";
+	std::vector< std::string > bench_traces;
+	double bench_tolerance = 25;
 	int brightness = -1;
+	int iterations = 1;
 	int light_show = 0;
 	int mount_usb = -1;
+	int sim_time = -1;
+	int soak_days = 0;
+	int wakeup_budget = 60;
+	int watchdog_secs = 0;
 	bool run_as_daemon = false;
 	bool xmas = false;
+	std::string probe_cache;
+	std::string record_path;
+	std::string replay_path;
+	std::string sim_board;
+	std::string trace_events_path;
 	
 	// long command line arguments
 	const struct option long_opts[] = {
+		{ "activity",	optional_argument,	0, 'Z' },
+		{ "activity-bpf", no_argument,		0, 'F' },
+		{ "bench",		optional_argument,	0, 'B' },
+		{ "bench-baseline", required_argument, 0, 'L' },
+		{ "bench-tolerance", required_argument, 0, 'O' },
+		{ "bench-trace", required_argument,	0, 'A' },
+		{ "board",		required_argument,	0, 'J' },
 		{ "brightness", required_argument,	0, 'b' },
+		{ "control-socket", optional_argument, 0, 'c' },
 		{ "daemon",		no_argument,		0, 'D' },
 		{ "debug",		no_argument,		0, 'd' },
+		{ "enclosure",	optional_argument,	0, 'N' },
+		{ "gpio",		required_argument,	0, 'Q' },
 		{ "help",		no_argument,		0, 'h' },
+		{ "hook-helper", required_argument,	0, 'k' },
+		{ "hook-timeout", required_argument, 0, 't' },
+		{ "hooks",		optional_argument,	0, 'H' },
+		{ "io-uring",	no_argument,		0, 'i' },
+		{ "iterations",	required_argument,	0, 'I' },
+		{ "journal",	optional_argument,	0, 'j' },
+		{ "led-map",	required_argument,	0, 'G' },
 		{ "light-show",	required_argument,	0, 'S' },
+		{ "probe-cache", required_argument,	0, 'C' },
+		{ "record",		required_argument,	0, 'R' },
+		{ "replay",		required_argument,	0, 'P' },
+		{ "simulate",	required_argument,	0, 'M' },
+		{ "sim-time",	required_argument,	0, 'T' },
+		{ "soak",		required_argument,	0, 'K' },
+		{ "sysfs",		required_argument,	0, 'Y' },
 		{ "usb",		required_argument,	0, 'U' },
+		{ "trace-events", required_argument, 0, 'E' },
 		{ "verbose",	no_argument,		0, 'v' },
 		{ "version",	no_argument,		0, 'V' },
+		{ "wakeup-budget", required_argument, 0, 'W' },
+		{ "watchdog",	optional_argument,	0, 'w' },
 		{ "xmas",		no_argument,		0, 'X' },
 		{ 0, 0, 0, 0 },
 	};
@@ -235,6 +435,34 @@ int main( int argc, char* argv[] ) try {
 		if ( -1 == c ) break;
 		
 		switch ( c ) {
+		case 'Z': // disk activity
+			activity_ms = ( optarg ) ? atoi( optarg ) : ActivityMonitor::SAMPLE_INTERVAL / 1000000;
+			break;
+		case 'F': // count activity in the kernel
+			activity_bpf = true;
+			break;
+		case 'i': // batch sampling through io_uring
+			io_uring = true;
+			break;
+		case 'c': // push events to subscribers
+			control_socket = ( optarg ) ? optarg : EventStream::DEFAULT_PATH;
+			break;
+		case 'B': // benchmarks
+			bench = true;
+			if ( optarg ) bench_output = optarg;
+			break;
+		case 'A': // benchmark a recorded trace
+			if ( optarg ) bench_traces.push_back( optarg );
+			break;
+		case 'L': // benchmark baseline
+			if ( optarg ) bench_baseline = optarg;
+			break;
+		case 'O': // benchmark tolerance (percent)
+			if ( optarg ) bench_tolerance = atof( optarg );
+			break;
+		case 'J': // board
+			if ( optarg ) board_name = optarg;
+			break;
 		case 'b': // brightness
 			if ( optarg ) brightness = atoi( optarg );
 			break;
@@ -244,11 +472,59 @@ int main( int argc, char* argv[] ) try {
 		case 'D': // run as a daemon (background)
 			run_as_daemon = true;
 			break;
+		case 'E': // chrome trace-event output
+			if ( optarg ) trace_events_path = optarg;
+			break;
+		case 'N': // enclosure slots
+			enclosure_root = ( optarg ) ? optarg : "-";
+			break;
+		case 'G': // LED class map
+			if ( optarg ) led_map = optarg;
+			break;
+		case 'Q': // GPIO chip
+			if ( optarg ) gpio_chip = optarg;
+			break;
 		case 'h': // help!
 			return show_help( );
+		case 'H': // site scripts
+			hooks_dir = ( optarg ) ? optarg : HookRunner::DEFAULT_DIR;
+			break;
+		case 'k': // we are the hook helper (spawned by the daemon)
+			if ( optarg ) hook_helper = optarg;
+			break;
+		case 't': // hook script time limit
+			if ( optarg ) hook_timeout = atoi( optarg );
+			break;
+		case 'I': // replay iterations
+			if ( optarg ) iterations = atoi( optarg );
+			break;
+		case 'j': // postmortem journal
+			journal_path = ( optarg ) ? optarg : Journal::DEFAULT_PATH;
+			break;
+		case 'K': // soak test
+			if ( optarg ) soak_days = atoi( optarg );
+			break;
+		case 'M': // simulated hardware
+			if ( optarg ) sim_board = optarg;
+			break;
+		case 'P': // replay a trace
+			if ( optarg ) replay_path = optarg;
+			break;
+		case 'C': // probe cache directory
+			if ( optarg ) probe_cache = optarg;
+			break;
+		case 'R': // record a trace
+			if ( optarg ) record_path = optarg;
+			break;
 		case 'S': // light-show
 			if ( optarg ) light_show = atoi( optarg );
 			break;
+		case 'T': // run in simulated time
+			if ( optarg ) sim_time = atoi( optarg );
+			break;
+		case 'Y': // where sysfs is mounted
+			if ( optarg ) sysfs_root = optarg;
+			break;
 		case 'U': // mount/unmount USB device
 			if ( optarg ) mount_usb = atoi( optarg );
 			break;
@@ -257,6 +533,12 @@ int main( int argc, char* argv[] ) try {
 			break;
 		case 'V': // our version
 			return show_version( );
+		case 'W': // soak test wakeup budget
+			if ( optarg ) wakeup_budget = atoi( optarg );
+			break;
+		case 'w': // keep the watchdog armed
+			watchdog_secs = ( optarg ) ? atoi( optarg ) : Watchdog::DEFAULT_TIMEOUT;
+			break;
 		case 'X': // light all the LEDs up like a xmas tree
 			xmas = true;
 			break;
@@ -269,13 +551,91 @@ int main( int argc, char* argv[] ) try {
 	}
 	
 	
+	// spawned to run hooks for another instance
+	if ( !hook_helper.empty() ) return HookRunner::Helper( hook_helper, hook_timeout );
+	
+	// benchmarks are always simulated
+	if ( bench ) return run_bench( bench_output, bench_baseline, bench_tolerance, bench_traces );
+	
+	// soak testing is always simulated
+	if ( soak_days > 0 ) {
+		if ( sim_board.empty() ) sim_board = "ex48x";
+		sim_time = soak_days * 24 * 3600;
+	}
+	
+	// replaying a trace never touches real hardware
+	if ( !replay_path.empty() ) return run_replay( replay_path, sim_board.empty() ? "ex48x" : sim_board, iterations );
+	
 	// register signal handlers
 	init_signals( );
 	
+	// open before we lose access (and our working directory)
+	if ( !trace_events_path.empty() ) TraceEvents::Enable( trace_events_path );
+	if ( !journal_path.empty() ) Journal::Enable( journal_path );
+	
+	// which board (from DMI/PCI ids, before touching any ports)
+	const BoardDesc* board = 0;
+	if ( !board_name.empty() || !sim_board.empty() ) {
+		const std::string& name = ( board_name.empty() ) ? sim_board : board_name;
+		board = BoardRegistry::Find( name );
+		if ( !board ) throw std::runtime_error( "Unknown board '" + name + "' (try " + BoardRegistry::Names() + ")" );
+	} else {
+		board = BoardRegistry::Detect( sysfs_root );
+	}
+	if ( board && ( debug || verbose ) ) cout << "Board: " << board->desc << '\n';
+	
+	// skip re-probing the hardware on later starts (simulations only if asked)
+	if ( probe_cache.empty() && sim_board.empty() ) probe_cache = ProbeCache::DEFAULT_DIR;
+	if ( !probe_cache.empty() && "none" != probe_cache ) ProbeCache::Enable( probe_cache, sysfs_root );
+	
 	// find led control interface
-	LedControlPtr leds = get_led_interface( );
+	LedControlPtr leds;
+	if ( !led_map.empty() ) {
+		// kernel owns the LEDs (no port I/O at all)
+		leds.reset( new LedSysfs( led_map, sysfs_root ) );
+		if ( !leds->Init( ) ) throw std::runtime_error( "No LEDs from " + led_map + " found" );
+	} else if ( !gpio_chip.empty() ) {
+		// kernel GPIO driver owns the pins
+		if ( board && !board->pins ) throw std::runtime_error( std::string( "No GPIO pin map for " ) + board->desc );
+		GpioLinesPtr lines;
+		if ( "sim" == gpio_chip ) lines.reset( new SimGpioLines( 76 ) );
+		else lines.reset( new ChipGpioLines( gpio_chip ) );
+		leds.reset( new LedGpio( lines, ( board ) ? *board->pins : LedGpio::HpEx48X() ) );
+		if ( !leds->Init( ) ) throw std::runtime_error( "No LED lines on " + gpio_chip );
+	} else {
+		PortIoPtr port_io( new HwPortIo );
+		if ( !sim_board.empty() ) port_io = get_sim_port_io( sim_board );
+		leds = get_led_interface( port_io, board );
+	}
+	if ( !enclosure_root.empty() ) leds = add_enclosures( leds, ( "-" == enclosure_root ) ? sysfs_root : enclosure_root );
 	if ( !leds ) throw std::runtime_error( "Failed to find an LED control interface" );
 	
+	// open trace before we lose access (and our working directory)
+	DeviceTraceWriterPtr trace;
+	if ( !record_path.empty() ) trace.reset( new DeviceTraceWriter( record_path ) );
+	
+	// arm the watchdog while we can still get at its registers
+	std::tr1::shared_ptr< Watchdog > watchdog;
+	if ( watchdog_secs > 0 ) watchdog.reset( new Watchdog( leds, watchdog_secs ) );
+	
+	// BPF programs can only be loaded as root
+	std::tr1::shared_ptr< BpfActivity > bpf;
+	if ( activity_ms > 0 && activity_bpf ) {
+		try {
+			bpf.reset( new BpfActivity( sysfs_root ) );
+		} catch ( std::exception& e ) {
+			cout << "No BPF activity counting (" << e.what() << "), sampling instead\n";
+		}
+	}
+	
+	// socket directory (/run) is only writable by root
+	std::tr1::shared_ptr< EventStream > events;
+	if ( !control_socket.empty() ) events.reset( new EventStream( control_socket ) );
+	
+	// hook scripts run as root, so their helper is spawned first
+	std::tr1::shared_ptr< HookRunner > hooks;
+	if ( !hooks_dir.empty() ) hooks.reset( new HookRunner( hooks_dir, hook_timeout ) );
+	
 	// drop root priviledges
 	drop_priviledges( );
 	
@@ -298,28 +658,80 @@ int main( int argc, char* argv[] ) try {
 	if ( brightness >= 0 ) leds->SetBrightness( brightness );
 	
 	// clear out LEDs
-	leds->Set( LED_BLUE | LED_RED, 0, xmas );
-	leds->Set( LED_BLUE | LED_RED, 1, xmas );
-	leds->Set( LED_BLUE | LED_RED, 2, xmas );
-	leds->Set( LED_BLUE | LED_RED, 3, xmas );
+	clear_leds( leds, xmas );
 	if ( xmas ) return 0;
 	
-	if ( light_show > 0 ) return run_light_show( leds, light_show );
+	// real or simulated time
+	ClockPtr clock;
+	if ( sim_time >= 0 ) clock.reset( new VirtualClock( sec_to_ns( sim_time ) ) );
+	else clock.reset( new RealClock );
+	EventLoop loop( clock );
+	const uint64_t started = loop.Now( );
+	
+	// periodic work shares wakeups (observing before the committer, so
+	// whatever it changes is committed in the same wakeup)
+	Scheduler scheduler( loop );
+	if ( watchdog ) watchdog->Start( scheduler );
+	
+	// from here on LED changes are queued and committed by the loop
+	std::tr1::shared_ptr< LedCommitter > committer( new LedCommitter( leds, loop ) );
+	
+	// subscribers hear about each wakeup's events once it is committed
+	if ( events ) {
+		events->Start( loop );
+		committer->Events( events.get() );
+	}
+	
+	if ( light_show > 0 ) return run_light_show( committer, loop, light_show );
+	if ( soak_days > 0 ) return run_soak( committer, loop, soak_days, wakeup_budget );
+	
+	// a run of the daemon proper (detached, so the pid is right)
+	Journal::Start( leds->Desc( ) );
+	
+	// blocking probes (the device scan) run on worker threads
+	WorkerPool workers( loop );
 	
 	// initialise device monitor
 	DeviceMonitor device_monitor;
-	device_monitor.Init( leds );
+	if ( trace ) device_monitor.Record( trace );
+	device_monitor.Workers( &workers );
+	
+	std::tr1::shared_ptr< ActivityMonitor > activity;
+	if ( activity_ms > 0 ) {
+		activity.reset( new ActivityMonitor( committer, scheduler, sysfs_root, ms_to_ns( activity_ms ), std::max( ms_to_ns( activity_ms ), ActivityMonitor::IDLE_INTERVAL ) ) );
+		activity->Bpf( bpf.get() );
+		activity->Uring( io_uring );
+		activity->Events( events.get() );
+		device_monitor.Activity( activity.get() );
+	}
+	device_monitor.Events( events.get() );
+	device_monitor.Init( committer );
+	
+	// (hooks are for changes, so they skip the disks we started with)
+	if ( hooks ) {
+		hooks->Start( loop );
+		device_monitor.Hooks( hooks.get() );
+	}
+	
+	// begin monitoring (what the scan finds is committed as it comes back)
+	device_monitor.Start( loop );
+	loop.Run( );
+	report_wakeups( loop, started );
+	if ( verbose > 0 ) scheduler.Report( cout );
+	if ( hooks && verbose > 0 ) hooks->Report( cout );
 	
-	// begin monitoring
-	device_monitor.Main( );
+	// what the LEDs should be showing when the trace is replayed
+	if ( trace ) trace->WriteState( device_monitor.PresentBays(), BaySet() );
 	
 	// re-enable annoying blinking
 	leds->SetSystemLed( LED_BLUE, LED_BLINK );
 	
+	Journal::Stop( );
 	return 0;
 	
 } catch ( std::exception& e ) {
 	std::cerr << e.what() << '\n';
+	Journal::Error( 0, e.what() );
 	if ( 0 != getuid() ) cout << "Try running as root\n";
 	
 	return 1;
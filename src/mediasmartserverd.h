@@ -30,8 +30,20 @@
 #ifndef INCLUDED_LED_MEDIASMARTSERVERD
 #define INCLUDED_LED_MEDIASMARTSERVERD
 
+//- includes
+#include "board_registry.h"
+#include "led_control_base.h"
+#include "sim_port_io.h"
+#include <signal.h>
+#include <string>
+
 //- globals
 extern int debug;
 extern int verbose;
+extern volatile sig_atomic_t exit_signalled;
+
+//- functions
+LedControlPtr get_led_interface( const PortIoPtr& io, const BoardDesc* board = 0 );
+SimPortIoPtr get_sim_port_io( const std::string& board );
 
 #endif // INCLUDED_LED_MEDIASMARTSERVERD
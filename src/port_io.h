@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file port_io.h
+///
+/// x86 port I/O access (real hardware or simulated)
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PORT_IO
+#define INCLUDED_PORT_IO
+
+//- includes
+#include "probes.h"
+#include <tr1/memory>
+#include <sys/io.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// x86 port I/O access
+/// (mirrors the ioperm/inb/outb family so drivers can run against a simulator)
+class PortIo {
+public:
+	virtual ~PortIo( ) { }
+	
+	virtual int  Ioperm( unsigned long from, unsigned long num, int turn_on ) = 0;
+	virtual unsigned char Inb( unsigned short port ) = 0;
+	virtual unsigned int  Inl( unsigned short port ) = 0;
+	virtual void Outb( unsigned char val, unsigned short port ) = 0;
+	virtual void Outl( unsigned int val, unsigned short port ) = 0;
+	
+protected:
+	PortIo( ) { }
+	
+private:
+	// no copying
+	PortIo( const PortIo& rhs );
+	const PortIo& operator=( const PortIo& rhs );
+};
+typedef std::tr1::shared_ptr< PortIo > PortIoPtr;
+
+/////////////////////////////////////////////////////////////////////////////
+/// port I/O straight to the hardware
+class HwPortIo : public PortIo {
+public:
+	HwPortIo( ) { }
+	
+	int  Ioperm( unsigned long from, unsigned long num, int turn_on ) { return ioperm( from, num, turn_on ); }
+	
+	unsigned char Inb( unsigned short port ) {
+		const unsigned char val = inb( port );
+		MSSD_PROBE2( port__read, port, val );
+		return val;
+	}
+	unsigned int Inl( unsigned short port ) {
+		const unsigned int val = inl( port );
+		MSSD_PROBE2( port__read, port, val );
+		return val;
+	}
+	void Outb( unsigned char val, unsigned short port ) {
+		MSSD_PROBE2( port__write, port, val );
+		outb( val, port );
+	}
+	void Outl( unsigned int val, unsigned short port ) {
+		MSSD_PROBE2( port__write, port, val );
+		outl( val, port );
+	}
+};
+
+#endif // INCLUDED_PORT_IO
@@ -0,0 +1,129 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file probe_cache.cpp
+///
+/// hardware probe results cached across restarts
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "probe_cache.h"
+#include "mediasmartserverd.h"
+#include "sysfs.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+//- statics
+const char* const ProbeCache::DEFAULT_DIR = "/run/mediasmartserverd";
+std::string ProbeCache::dir_;
+std::string ProbeCache::sysfs_root_;
+
+/////////////////////////////////////////////////////////////////////////////
+/// use a cache directory
+void ProbeCache::Enable( const std::string& dir, const std::string& sysfs_root ) {
+	dir_ = dir;
+	sysfs_root_ = sysfs_root;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// what the cache is valid for: this boot of this box
+std::string ProbeCache::key_( ) {
+	std::string boot_id, vendor, product;
+	sysfs_read( "/proc/sys/kernel/random/boot_id", boot_id );
+	sysfs_read( sysfs_root_ + "/class/dmi/id/sys_vendor", vendor );
+	sysfs_read( sysfs_root_ + "/class/dmi/id/product_name", product );
+	return boot_id + '|' + vendor + '|' + product;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// cached results for this boot (if any)
+bool ProbeCache::Lookup( ProbeResult& result ) {
+	if ( dir_.empty() ) return false;
+	
+	std::ifstream in( (dir_ + "/probe").c_str() );
+	if ( !in ) return false;
+	
+	std::string line, key;
+	ProbeResult cached;
+	while ( std::getline( in, line ) ) {
+		const std::string::size_type sep = line.find( ' ' );
+		if ( std::string::npos == sep || '#' == line[0] ) continue;
+		
+		const std::string name = line.substr( 0, sep );
+		const std::string val = line.substr( sep + 1 );
+		const unsigned int num = strtoul( val.c_str(), 0, 0 );
+		
+		if ( "key" == name )				key = val;
+		else if ( "did_vid" == name )		cached.did_vid = num;
+		else if ( "sio_addr" == name )		cached.sio_addr = num;
+		else if ( "sch5127_regs" == name )	cached.sch5127_regs = num;
+		else if ( "lpc_gpiobase" == name )	cached.lpc_gpiobase = num;
+	}
+	
+	if ( key != key_() || !cached.did_vid || !cached.sch5127_regs || !cached.lpc_gpiobase ) {
+		if ( debug ) std::cout << "Probe cache: stale\n";
+		return false;
+	}
+	
+	result = cached;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// remember probe results for the rest of this boot
+void ProbeCache::Store( const ProbeResult& result ) {
+	if ( dir_.empty() ) return;
+	
+	if ( mkdir( dir_.c_str(), 0755 ) && EEXIST != errno ) {
+		if ( debug || verbose ) std::cerr << "Probe cache: " << dir_ << ": " << strerror(errno) << '\n';
+		return;
+	}
+	
+	// write then rename, so nobody ever reads half a file
+	const std::string path = dir_ + "/probe";
+	const std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream out( tmp_path.c_str() );
+		out << "# mediasmartserverd hardware probe results (safe to delete)\n"
+			<< std::hex << std::showbase
+			<< "key " << key_() << '\n'
+			<< "did_vid " << result.did_vid << '\n'
+			<< "sio_addr " << result.sio_addr << '\n'
+			<< "sch5127_regs " << result.sch5127_regs << '\n'
+			<< "lpc_gpiobase " << result.lpc_gpiobase << '\n';
+		if ( !out.flush() ) {
+			if ( debug || verbose ) std::cerr << "Probe cache: failed to write " << tmp_path << '\n';
+			remove( tmp_path.c_str() );
+			return;
+		}
+	}
+	if ( rename( tmp_path.c_str(), path.c_str() ) ) remove( tmp_path.c_str() );
+}
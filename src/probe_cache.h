@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file probe_cache.h
+///
+/// hardware probe results cached across restarts
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PROBE_CACHE
+#define INCLUDED_PROBE_CACHE
+
+//- includes
+#include <string>
+
+/////////////////////////////////////////////////////////////////////////////
+/// what probing an SCH5127 board found
+struct ProbeResult {
+	ProbeResult( ) : did_vid( 0 ), sio_addr( 0 ), sch5127_regs( 0 ), lpc_gpiobase( 0 ) { }
+	
+	unsigned int	did_vid;		///< LPC bridge device and vendor id (board type)
+	unsigned int	sio_addr;		///< SuperIO configuration port (0x2e or 0x4e)
+	unsigned int	sch5127_regs;	///< SCH5127 runtime register base
+	unsigned int	lpc_gpiobase;	///< ICH GPIOBASE
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// hardware probe results cached across restarts
+///
+/// Kept in <dir>/probe and keyed by the kernel boot id plus DMI, so it only
+/// holds for the boot (and box) it was written on. Drivers still check the
+/// LPC bridge id before trusting it.
+class ProbeCache {
+public:
+	/// default location
+	static const char* const DEFAULT_DIR;
+	
+	/// use a cache directory (until then Lookup misses and Store does nothing)
+	static void Enable( const std::string& dir, const std::string& sysfs_root );
+	static bool Enabled( ) { return !dir_.empty(); }
+	
+	static bool Lookup( ProbeResult& result );
+	static void Store( const ProbeResult& result );
+	
+private:
+	static std::string key_( );
+	
+	static std::string dir_;		///< cache directory
+	static std::string sysfs_root_;	///< where sysfs is mounted (for DMI)
+};
+
+#endif // INCLUDED_PROBE_CACHE
@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file probes.h
+///
+/// USDT static tracepoints
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_PROBES
+#define INCLUDED_PROBES
+
+// Static probes for perf, bpftrace and systemtap (provider "mediasmartserverd").
+// They compile to a single nop when <sys/sdt.h> is available (the Makefile
+// defines HAVE_SYS_SDT_H) and to nothing otherwise.
+//
+//   udev-event       (action, devpath)           event received or enumerated
+//   bay-resolved     (led_idx, state, devpath)   event mapped to a bay
+//   led-commit       (port, bits, value)         GPIO level register written
+//   port-read        (port, value)               inb/inl on real hardware
+//   port-write       (port, value)               outb/outl on real hardware
+//   gpio-write       (mask, bits)                GPIO chardev lines set
+//   show-frame       (show_mode, frame)          light show frame rendered
+//   timer-overrun    (late_ns)                   timer fired a whole period late
+//
+// e.g. bpftrace -e 'usdt:./mediasmartserverd:led-commit { printf("%x %x\n", arg0, arg2); }'
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define MSSD_PROBE1( name, a )			DTRACE_PROBE1( mediasmartserverd, name, a )
+#define MSSD_PROBE2( name, a, b )		DTRACE_PROBE2( mediasmartserverd, name, a, b )
+#define MSSD_PROBE3( name, a, b, c )	DTRACE_PROBE3( mediasmartserverd, name, a, b, c )
+#else
+#define MSSD_PROBE1( name, a )			do { } while ( 0 )
+#define MSSD_PROBE2( name, a, b )		do { } while ( 0 )
+#define MSSD_PROBE3( name, a, b, c )	do { } while ( 0 )
+#endif
+
+#endif // INCLUDED_PROBES
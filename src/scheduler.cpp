@@ -0,0 +1,173 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file scheduler.cpp
+///
+/// coalesces periodic work into shared wakeups
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "scheduler.h"
+#include "trace_events.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor
+/// @param tick Grid our own wakeups are aligned to (ns)
+Scheduler::Scheduler( EventLoop& loop, uint64_t tick )
+	:	loop_( loop )
+	,	tick_( tick ? tick : 1 )
+	,	fired_( 0 )
+	,	coalesced_( 0 )
+	,	running_( false )
+{
+	loop_.Observe( this );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor
+Scheduler::~Scheduler( ) {
+	for ( size_t i = 0; i < tasks_.size(); ++i ) tasks_[i]->due_ = Clock::NEVER;
+	loop_.Unobserve( this );
+	if ( Armed() ) loop_.Cancel( this );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start running a task, first due one minimum interval from now
+void Scheduler::Add( Task* task ) {
+	if ( !task->Scheduled() ) tasks_.push_back( task );
+	task->interval_ = task->min_;
+	task->due_ = loop_.Now( ) + task->interval_;
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// stop running a task
+void Scheduler::Remove( Task* task ) {
+	std::vector< Task* >::iterator it = std::find( tasks_.begin(), tasks_.end(), task );
+	if ( tasks_.end() == it ) return;
+	
+	tasks_.erase( it );
+	task->due_ = Clock::NEVER;
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the task did its work off schedule; next due a full interval from now
+void Scheduler::Restart( Task* task ) {
+	if ( !task->Scheduled() ) return;
+	task->due_ = loop_.Now( ) + task->interval_;
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// nothing else woke the loop inside the tightest window
+void Scheduler::OnTimer( uint64_t now ) {
+	++fired_;
+	run_( now );
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the loop is awake anyway; run whatever is already due
+void Scheduler::OnWakeup( uint64_t now ) {
+	coalesced_ += run_( now );
+	arm_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// print each task's runs and current interval
+void Scheduler::Report( std::ostream& os ) const {
+	os << "Scheduler: " << fired_ << " own wakeups, " << coalesced_ << " runs on other wakeups\n";
+	for ( size_t i = 0; i < tasks_.size(); ++i ) {
+		const Task* task = tasks_[i];
+		os << "  " << std::left << std::setw(12) << task->TraceName( ) << std::right
+			<< task->runs_ << " runs, every " << task->interval_ / 1000000 << "ms\n";
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// run tasks that are due, adapting their intervals
+/// @returns number of tasks run
+unsigned long Scheduler::run_( uint64_t now ) {
+	// pick them out first: a task may add or remove tasks
+	ready_.clear( );
+	for ( size_t i = 0; i < tasks_.size(); ++i ) {
+		if ( tasks_[i]->due_ <= now ) ready_.push_back( tasks_[i] );
+	}
+	if ( ready_.empty() ) return 0;
+	
+	unsigned long ran = 0;
+	running_ = true;
+	
+	for ( size_t i = 0; i < ready_.size(); ++i ) {
+		Task* task = ready_[i];
+		if ( !task->Scheduled() ) continue; // removed by an earlier one
+		
+		bool busy;
+		{
+			TraceScope scope( task->TraceName(), "task" );
+			busy = task->OnTick( now );
+		}
+		++task->runs_;
+		++ran;
+		if ( !task->Scheduled() ) continue; // removed itself
+		
+		if ( busy ) {
+			task->interval_ = task->min_;
+		} else if ( task->interval_ < task->max_ ) {
+			task->interval_ = std::min( task->interval_ * 2, task->max_ );
+		}
+		task->due_ = now + task->interval_;
+	}
+	
+	running_ = false;
+	return ran;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// set our timer for the latest grid tick inside the tightest window
+void Scheduler::arm_( ) {
+	if ( running_ ) return;
+	
+	const Task* tightest = 0;
+	for ( size_t i = 0; i < tasks_.size(); ++i ) {
+		if ( !tightest || tasks_[i]->Latest() < tightest->Latest() ) tightest = tasks_[i];
+	}
+	
+	if ( !tightest ) {
+		if ( Armed() ) loop_.Cancel( this );
+		return;
+	}
+	
+	// no tick inside a window narrower than the grid, so take its end
+	const uint64_t latest = tightest->Latest( );
+	uint64_t deadline = latest - latest % tick_;
+	if ( deadline < tightest->due_ ) deadline = latest;
+	
+	if ( deadline != Deadline() ) loop_.Arm( this, deadline );
+}
@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file scheduler.h
+///
+/// coalesces periodic work into shared wakeups
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SCHEDULER
+#define INCLUDED_SCHEDULER
+
+//- includes
+#include "event_loop.h"
+#include <iosfwd>
+#include <vector>
+
+/////////////////////////////////////////////////////////////////////////////
+/// runs periodic tasks on as few wakeups as possible
+///
+/// Each task is due an interval after it last ran and may run any time in
+/// the slack that follows. Our one timer is set for the latest tick of a
+/// shared grid that still falls inside the tightest window, so tasks with
+/// overlapping windows run together, and any task whose window is open
+/// also runs when the loop wakes up for something else.
+///
+/// A task's interval adapts: back to its minimum whenever it reports it
+/// was busy, doubling towards its maximum each time it wasn't.
+class Scheduler : public EventLoop::Timer, public EventLoop::Observer {
+public:
+	/// grid the scheduler's own wakeups are aligned to (ns)
+	static const uint64_t TICK = 100000000ULL;
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// periodic work (owned by whoever added it)
+	class Task {
+	public:
+		/// @param min_interval Time between runs while busy (ns)
+		/// @param max_interval Time between runs once idle (ns)
+		/// @param slack_pct How late a run may be, as a percentage of the interval
+		Task( uint64_t min_interval, uint64_t max_interval, unsigned int slack_pct )
+			:	min_( min_interval ), max_( max_interval < min_interval ? min_interval : max_interval )
+			,	interval_( min_interval ), slack_pct_( slack_pct ), due_( Clock::NEVER ), runs_( 0 ) { }
+		virtual ~Task( ) { }
+		
+		/// do the work
+		/// @returns whether there was anything to do (keeps the interval short)
+		virtual bool OnTick( uint64_t now ) = 0;
+		virtual const char* TraceName( ) const { return "task"; }
+		
+		/// current time between runs
+		uint64_t Interval( ) const { return interval_; }
+		/// times run
+		unsigned long Runs( ) const { return runs_; }
+		bool Scheduled( ) const { return Clock::NEVER != due_; }
+		
+	private:
+		friend class Scheduler;
+		uint64_t Latest( ) const { return due_ + interval_ * slack_pct_ / 100; }
+		
+		uint64_t		min_;		///< interval while busy
+		uint64_t		max_;		///< interval once idle
+		uint64_t		interval_;	///< current interval
+		unsigned int	slack_pct_;	///< allowed lateness (% of interval)
+		uint64_t		due_;		///< earliest next run
+		unsigned long	runs_;		///< run count
+	};
+	
+	Scheduler( EventLoop& loop, uint64_t tick = TICK );
+	~Scheduler( );
+	
+	void Add( Task* task );
+	void Remove( Task* task );
+	void Restart( Task* task );
+	
+	void OnTimer( uint64_t now );
+	void OnWakeup( uint64_t now );
+	const char* TraceName( ) const { return "scheduler"; }
+	
+	void Report( std::ostream& os ) const;
+	
+	/// times our own timer woke the loop
+	unsigned long Fired( ) const { return fired_; }
+	/// task runs that rode along on someone else's wakeup
+	unsigned long Coalesced( ) const { return coalesced_; }
+	
+	EventLoop& Loop( ) { return loop_; }
+	
+private:
+	// no copying
+	Scheduler( const Scheduler& rhs );
+	const Scheduler& operator=( const Scheduler& rhs );
+	
+	unsigned long run_( uint64_t now );
+	void arm_( );
+	
+	EventLoop&				loop_;		///< loop we wake
+	uint64_t				tick_;		///< wakeup grid
+	std::vector< Task* >	tasks_;		///< scheduled tasks
+	std::vector< Task* >	ready_;		///< due this run (kept to save allocating)
+	unsigned long			fired_;		///< own wakeups
+	unsigned long			coalesced_;	///< runs on other wakeups
+	bool					running_;	///< inside run_ (defer arming)
+};
+
+#endif // INCLUDED_SCHEDULER
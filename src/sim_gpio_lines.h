@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file sim_gpio_lines.h
+///
+/// in-memory stand-in for a GPIO chip
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SIM_GPIO_LINES
+#define INCLUDED_SIM_GPIO_LINES
+
+//- includes
+#include "gpio_lines.h"
+#include <stdexcept>
+
+/////////////////////////////////////////////////////////////////////////////
+/// in-memory stand-in for a GPIO chip
+///
+/// Keeps the level of each requested line and counts the ioctls a real
+/// chip would have needed.
+class SimGpioLines : public GpioLines {
+public:
+	/// constructor
+	/// @param num_lines Lines the chip has
+	SimGpioLines( unsigned int num_lines ) : num_lines_( num_lines ), levels_( 0 ) {
+		ResetCounters( );
+	}
+	
+	//- GPIO lines
+	void Request( const std::vector< unsigned int >& offsets, uint64_t initial ) {
+		if ( offsets.size() > GPIO_V2_LINES_MAX ) throw std::runtime_error( "simulated GPIO: too many lines" );
+		for ( size_t i = 0; i < offsets.size(); ++i ) {
+			if ( offsets[i] >= num_lines_ ) throw std::runtime_error( "simulated GPIO: no such line" );
+		}
+		offsets_ = offsets;
+		levels_ = initial;
+		++ops_;
+	}
+	void Set( uint64_t mask, uint64_t bits ) {
+		levels_ = ( levels_ & ~mask ) | ( bits & mask );
+		++ops_;
+	}
+	uint64_t Get( uint64_t mask ) {
+		++ops_;
+		return levels_ & mask;
+	}
+	
+	//- inspection
+	/// level of a chip line (by offset)
+	bool Level( unsigned int offset ) const {
+		for ( size_t i = 0; i < offsets_.size(); ++i ) {
+			if ( offset == offsets_[i] ) return levels_ & ( 1ULL << i );
+		}
+		return false;
+	}
+	
+	/// ioctls (request, set and get)
+	unsigned long Ops( ) const { return ops_; }
+	void ResetCounters( ) { ops_ = 0; }
+	
+private:
+	unsigned int				num_lines_;	///< lines on the chip
+	std::vector< unsigned int >	offsets_;	///< requested lines
+	uint64_t					levels_;	///< level of each requested line
+	unsigned long				ops_;		///< ioctl count
+};
+typedef std::tr1::shared_ptr< SimGpioLines > SimGpioLinesPtr;
+
+#endif // INCLUDED_SIM_GPIO_LINES
@@ -0,0 +1,144 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file sim_port_io.h
+///
+/// in-memory stand-in for the ICH9/SCH5127 port registers
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SIM_PORT_IO
+#define INCLUDED_SIM_PORT_IO
+
+//- includes
+#include "port_io.h"
+#include <string.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// in-memory stand-in for the ICH9/SCH5127 port registers
+///
+/// Emulates just enough for the SCH5127 based drivers to probe and run:
+/// PCI configuration space of the LPC bridge (0xCF8/0xCFC), the SuperIO
+/// configuration index/data pair (0x2E/0x2F), and plain byte storage for
+/// everything else (GPIO and runtime registers). Every access is counted.
+class SimPortIo : public PortIo {
+public:
+	/// constructor
+	/// @param did_vid LPC bridge device and vendor id reported by PCI 31:0
+	SimPortIo( unsigned int did_vid )
+		:	did_vid_( did_vid )
+		,	pci_addr_( 0 )
+		,	sio_index_( 0 )
+	{
+		memset( ports_, 0, sizeof(ports_) );
+		memset( sio_cfg_, 0, sizeof(sio_cfg_) );
+		
+		sio_cfg_[ 0x20 ] = SIO_DEVICE_ID;
+		sio_cfg_[ 0x26 ] = SIO_INDEX;				// no redirect to 0x4e
+		sio_cfg_[ 0x60 ] = RUNTIME_BASE >> 8;
+		sio_cfg_[ 0x61 ] = RUNTIME_BASE & 0xFF;
+		
+		ResetCounters( );
+	}
+	
+	//- port I/O
+	int Ioperm( unsigned long, unsigned long, int ) {
+		++perms_;
+		return 0;
+	}
+	unsigned char Inb( unsigned short port ) {
+		++reads_;
+		if ( SIO_DATA == port ) return sio_cfg_[ sio_index_ ];
+		return ports_[ port ];
+	}
+	unsigned int Inl( unsigned short port ) {
+		++reads_;
+		if ( PCI_CONFIG_DATA == port ) return pciConfig_( pci_addr_ );
+		return ports_[ port ]
+			| ports_[ (port + 1) & 0xFFFF ] << 8
+			| ports_[ (port + 2) & 0xFFFF ] << 16
+			| ports_[ (port + 3) & 0xFFFF ] << 24
+		;
+	}
+	void Outb( unsigned char val, unsigned short port ) {
+		++writes_;
+		if ( SIO_INDEX == port ) sio_index_ = val;
+		else if ( SIO_DATA == port ) sio_cfg_[ sio_index_ ] = val;
+		else ports_[ port ] = val;
+	}
+	void Outl( unsigned int val, unsigned short port ) {
+		++writes_;
+		if ( PCI_CONFIG_ADDRESS == port ) {
+			pci_addr_ = val;
+			return;
+		}
+		for ( size_t i = 0; i < 4; ++i ) ports_[ (port + i) & 0xFFFF ] = val >> (8 * i);
+	}
+	
+	//- statistics
+	unsigned long Reads( ) const  { return reads_;  }
+	unsigned long Writes( ) const { return writes_; }
+	unsigned long Ops( ) const    { return reads_ + writes_; }
+	unsigned long Perms( ) const  { return perms_;  }
+	
+	void ResetCounters( ) {
+		reads_ = writes_ = perms_ = 0;
+	}
+	
+	//- simulated layout
+	enum {
+		GPIOBASE		= 0x0480,	///< ICH9 GPIO base address
+		RUNTIME_BASE	= 0x0A00,	///< SCH5127 runtime registers
+		SIO_DEVICE_ID	= 0x86,		///< SCH5127 device id
+	};
+	
+protected:
+	enum {
+		PCI_CONFIG_ADDRESS	= 0x0CF8,
+		PCI_CONFIG_DATA		= 0x0CFC,
+		SIO_INDEX			= 0x2E,
+		SIO_DATA			= 0x2F,
+	};
+	
+	/// PCI configuration space of the LPC bridge (bus 0, device 31, function 0)
+	unsigned int pciConfig_( unsigned int addr ) const {
+		switch ( addr ) {
+		case 0x8000F800: return did_vid_;
+		case 0x8000F848: return GPIOBASE | 0x1;
+		default: return 0xFFFFFFFF;
+		}
+	}
+	
+	unsigned int	did_vid_;			///< LPC bridge device/vendor id
+	unsigned int	pci_addr_;			///< latched PCI CONFIG_ADDRESS
+	unsigned char	sio_index_;			///< latched SuperIO config index
+	unsigned char	sio_cfg_[ 0x100 ];	///< SuperIO configuration registers
+	unsigned char	ports_[ 0x10000 ];	///< everything else
+	
+	unsigned long	reads_;				///< inb/inl count
+	unsigned long	writes_;			///< outb/outl count
+	unsigned long	perms_;				///< ioperm count
+};
+typedef std::tr1::shared_ptr< SimPortIo > SimPortIoPtr;
+
+#endif // INCLUDED_SIM_PORT_IO
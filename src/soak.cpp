@@ -0,0 +1,239 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file soak.cpp
+///
+/// long running soak test in simulated time
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "soak.h"
+#include "device_monitor.h"
+#include "errno_exception.h"
+#include "mediasmartserverd.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <dirent.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using std::cout;
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// resource usage at a point in time
+struct Usage {
+	long	rss;	///< resident set size (bytes)
+	long	heap;	///< heap in use (bytes)
+	long	fds;	///< open file descriptors
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// sample our own resource usage
+Usage sample_usage( ) {
+	Usage usage = { 0, 0, 0 };
+	
+	// resident pages
+	FILE* statm = fopen( "/proc/self/statm", "r" );
+	if ( statm ) {
+		long size = 0, resident = 0;
+		if ( 2 == fscanf( statm, "%ld %ld", &size, &resident ) ) usage.rss = resident * sysconf( _SC_PAGESIZE );
+		fclose( statm );
+	}
+	
+	// malloc'd bytes
+	usage.heap = mallinfo2( ).uordblks;
+	
+	// open file descriptors (less the one used to look)
+	DIR* dir = opendir( "/proc/self/fd" );
+	if ( dir ) {
+		while ( readdir( dir ) ) ++usage.fds;
+		usage.fds -= 3; // ".", ".." and our own
+		closedir( dir );
+	}
+	
+	return usage;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// plugs and unplugs disks (and the odd USB stick) at random intervals
+class SyntheticHotplug : public EventLoop::Timer {
+public:
+	SyntheticHotplug( DeviceMonitor& monitor, EventLoop& loop, size_t bays )
+		:	monitor_( monitor )
+		,	loop_( loop )
+		,	bays_( std::min( bays, size_t(MAX_BAYS) ) )
+		,	seed_( 1 )
+		,	events_( 0 )
+	{ }
+	
+	/// enumerate a full set of bays then start hotplugging
+	void Start( ) {
+		ListDeviceEvents events;
+		for ( size_t bay = 0; bay < bays_; ++bay ) {
+			events.push_back( SyntheticDeviceEvent( "enum", bay, "pci" ) );
+			present_.set( bay );
+		}
+		monitor_.Enumerated( events );
+		
+		schedule_( loop_.Now() );
+	}
+	
+	void OnTimer( uint64_t now ) {
+		const size_t bay = rand_r( &seed_ ) % bays_;
+		if ( 0 == rand_r( &seed_ ) % 8 ) {
+			// USB stick coming and going (should be ignored)
+			monitor_.Dispatch( SyntheticDeviceEvent( (rand_r( &seed_ ) & 1) ? "add" : "remove", bays_ + bay, "usb" ) );
+		} else {
+			const bool state = !present_[ bay ];
+			monitor_.Dispatch( SyntheticDeviceEvent( state ? "add" : "remove", bay, "pci" ) );
+			present_.flip( bay );
+		}
+		++events_;
+		
+		schedule_( now );
+	}
+	
+	const BaySet& Present( ) const { return present_; }
+	unsigned long Events( ) const { return events_; }
+	
+private:
+	/// next event somewhere between 1 and 20 minutes away
+	void schedule_( uint64_t now ) {
+		loop_.Arm( this, now + sec_to_ns( 60 * (1 + rand_r( &seed_ ) % 20) ) );
+	}
+	
+	DeviceMonitor&	monitor_;	///< who we are feeding
+	EventLoop&		loop_;		///< loop we are scheduled on
+	size_t			bays_;		///< bays the hardware has
+	unsigned int	seed_;		///< random number state
+	BaySet			present_;	///< bays currently populated
+	unsigned long	events_;	///< events generated
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// samples resource usage every simulated hour
+class UsageProbe : public EventLoop::Timer {
+public:
+	UsageProbe( EventLoop& loop )
+		:	loop_( loop )
+		,	samples_( 0 )
+		,	ok_( true )
+	{ }
+	
+	void Start( ) { loop_.Arm( this, loop_.Now() + INTERVAL ); }
+	
+	void OnTimer( uint64_t now ) {
+		const Usage usage = sample_usage( );
+		++samples_;
+		
+		// the first simulated day is warm up
+		if ( samples_ <= 24 ) {
+			baseline_ = usage;
+		} else if ( usage.fds > baseline_.fds
+		         || usage.heap > baseline_.heap + HEAP_SLACK
+		         || usage.rss  > baseline_.rss  + RSS_SLACK ) {
+			if ( ok_ ) {
+				cout << "Resource growth at hour " << samples_ << ": rss " << usage.rss << " (was " << baseline_.rss
+					<< "), heap " << usage.heap << " (was " << baseline_.heap
+					<< "), fds " << usage.fds << " (was " << baseline_.fds << ")\n";
+			}
+			ok_ = false;
+		}
+		last_ = usage;
+		
+		loop_.Arm( this, now + INTERVAL );
+	}
+	
+	unsigned long Samples( ) const { return samples_; }
+	bool Ok( ) const { return ok_; }
+	const Usage& Baseline( ) const { return baseline_; }
+	const Usage& Last( ) const { return last_; }
+	
+private:
+	static const uint64_t INTERVAL = 3600000000000ULL;	///< an hour
+	static const long HEAP_SLACK = 4096;				///< allowed heap growth
+	static const long RSS_SLACK = 64 * 1024;			///< allowed RSS growth
+	
+	EventLoop&		loop_;		///< loop we are scheduled on
+	unsigned long	samples_;	///< samples taken
+	bool			ok_;		///< no growth seen
+	Usage			baseline_;	///< usage after warm up
+	Usage			last_;		///< most recent sample
+};
+
+} // namespace
+
+/////////////////////////////////////////////////////////////////////////////
+/// run the device monitor against a synthetic hotplug workload
+int run_soak( const LedControlPtr& leds, EventLoop& loop, int days, int wakeup_budget ) {
+	if ( !loop.GetClock()->Virtual() ) throw std::runtime_error( "Soak test needs simulated time" );
+	if ( days < 2 ) throw std::runtime_error( "Soak test needs at least two simulated days" );
+	
+	DeviceMonitor monitor;
+	monitor.Attach( leds );
+	
+	SyntheticHotplug hotplug( monitor, loop, leds->HostBays() );
+	UsageProbe probe( loop );
+	
+	// keep per device chatter quiet
+	std::streambuf* cout_buf = ( debug || verbose ) ? 0 : cout.rdbuf( 0 );
+	
+	hotplug.Start( );
+	probe.Start( );
+	loop.Run( );
+	
+	if ( cout_buf ) {
+		cout.rdbuf( cout_buf );
+		cout.clear( );
+	}
+	
+	// wakeups the workload caused (our own probe doesn't count)
+	const double hours = loop.Now( ) / 3600e9;
+	const double wakeups_per_hour = ( loop.Wakeups() - probe.Samples() ) / hours;
+	const bool wakeups_ok = ( wakeups_per_hour <= wakeup_budget );
+	
+	// LEDs should be showing what is plugged in
+	const BaySet blue = leds->Lit( LED_BLUE );
+	const bool leds_ok = ( blue == hotplug.Present() && blue == monitor.PresentBays() );
+	
+	const Usage& base = probe.Baseline( );
+	const Usage& last = probe.Last( );
+	cout << std::fixed << std::setprecision(1)
+		<< "Soaked " << hours / 24 << " simulated days, " << hotplug.Events() << " hotplug events\n"
+		<< "RSS:     " << base.rss  << " -> " << last.rss  << " bytes\n"
+		<< "Heap:    " << base.heap << " -> " << last.heap << " bytes\n"
+		<< "FDs:     " << base.fds  << " -> " << last.fds  << '\n'
+		<< "Wakeups: " << wakeups_per_hour << " per simulated hour (budget " << wakeup_budget << ")\n"
+		<< "LEDs:    blue 0x" << std::hex << blue.to_ulong() << " expected 0x" << hotplug.Present().to_ulong() << std::dec << '\n'
+		<< "Resources: " << ( probe.Ok() ? "FLAT" : "GROWING" )
+		<< ", wakeups: " << ( wakeups_ok ? "OK" : "OVER BUDGET" )
+		<< ", LEDs: " << ( leds_ok ? "OK" : "MISMATCH" ) << '\n';
+	
+	return ( probe.Ok() && wakeups_ok && leds_ok ) ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file soak.h
+///
+/// long running soak test in simulated time
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SOAK
+#define INCLUDED_SOAK
+
+//- includes
+#include "event_loop.h"
+#include "led_control_base.h"
+
+/// run the device monitor against a synthetic hotplug workload
+/// @param days Simulated days to run for (the loop's clock must be virtual)
+/// @param wakeup_budget Maximum wakeups per simulated hour
+/// @returns process exit code (non-zero if a check failed)
+int run_soak( const LedControlPtr& leds, EventLoop& loop, int days, int wakeup_budget );
+
+#endif // INCLUDED_SOAK
@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file sysfs.h
+///
+/// helpers for reading sysfs attributes
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_SYSFS
+#define INCLUDED_SYSFS
+
+//- includes
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// directory entries (less hidden ones, . and ..)
+inline std::vector< std::string > sysfs_list_dir( const std::string& path ) {
+	std::vector< std::string > entries;
+	DIR* dir = opendir( path.c_str() );
+	if ( !dir ) return entries;
+	
+	while ( const dirent* ent = readdir( dir ) ) {
+		if ( '.' == ent->d_name[0] ) continue;
+		entries.push_back( ent->d_name );
+	}
+	closedir( dir );
+	return entries;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// whether an attribute exists
+inline bool sysfs_is_file( const std::string& path ) {
+	struct stat st;
+	return 0 == stat( path.c_str(), &st ) && S_ISREG( st.st_mode );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read an attribute (without the trailing newline)
+/// @returns false if it couldn't be read
+inline bool sysfs_read( const std::string& path, std::string& val ) {
+	const int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+	if ( fd < 0 ) return false;
+	
+	char buf[ 4096 ];
+	const ssize_t len = read( fd, buf, sizeof(buf) );
+	close( fd );
+	if ( len < 0 ) return false;
+	
+	val.assign( buf, len );
+	while ( !val.empty() && '\n' == val[ val.size() - 1 ] ) val.erase( val.size() - 1 );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// read a numeric attribute
+inline int sysfs_read_number( const std::string& path, int def ) {
+	std::string val;
+	if ( !sysfs_read( path, val ) || val.empty() ) return def;
+	return atoi( val.c_str() );
+}
+
+#endif // INCLUDED_SYSFS
@@ -0,0 +1,182 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file trace_events.cpp
+///
+/// Chrome trace-event (Perfetto) export of event loop activity
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "trace_events.h"
+#include "errno_exception.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+/////////////////////////////////////////////////////////////////////////////
+/// a complete ("X") slice
+struct TraceRecord {
+	const char*	name;
+	const char*	cat;
+	uint64_t	start;
+	uint64_t	end;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// per-thread ring of records
+struct TraceBuffer {
+	TraceBuffer( size_t capacity ) : records( capacity ), count( 0 ), tid( syscall( SYS_gettid ) ) { }
+	
+	std::vector< TraceRecord >	records;	///< preallocated ring
+	uint64_t					count;		///< records ever written
+	long						tid;		///< owning thread
+};
+
+//- globals
+std::string					trace_path;			///< where we write to
+size_t						trace_capacity = 0;	///< records per thread
+std::vector< TraceBuffer* >	trace_buffers;		///< every thread's buffer
+pthread_mutex_t				trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+volatile sig_atomic_t		trace_signalled = 0;
+__thread TraceBuffer*		thread_buffer = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+/// SIGUSR2 asks for a flush (done from the event loop)
+void sig_flush( int ) { trace_signalled = 1; }
+
+/////////////////////////////////////////////////////////////////////////////
+/// this thread's buffer (allocated on first use)
+TraceBuffer* get_buffer( ) {
+	if ( thread_buffer ) return thread_buffer;
+	
+	thread_buffer = new TraceBuffer( trace_capacity );
+	pthread_mutex_lock( &trace_mutex );
+	trace_buffers.push_back( thread_buffer );
+	pthread_mutex_unlock( &trace_mutex );
+	return thread_buffer;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// flush at exit
+void flush_at_exit( ) {
+	try {
+		TraceEvents::Flush( );
+	} catch ( std::exception& e ) {
+		std::cerr << e.what() << '\n';
+	}
+}
+
+} // namespace
+
+//- statics
+bool TraceEvents::enabled_ = false;
+
+/////////////////////////////////////////////////////////////////////////////
+/// start recording
+void TraceEvents::Enable( const std::string& path, size_t capacity ) {
+	trace_path = path;
+	trace_capacity = capacity;
+	get_buffer( ); // preallocate for the main thread
+	enabled_ = true;
+	
+	struct sigaction sa;
+	sa.sa_flags = 0;
+	sa.sa_handler = &sig_flush;
+	sigemptyset( &sa.sa_mask );
+	if ( -1 == sigaction(SIGUSR2, &sa, 0) ) throw ErrnoException( "sigaction(SIGUSR2)" );
+	
+	atexit( &flush_at_exit );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// timestamp in nanoseconds
+uint64_t TraceEvents::Now( ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// record a complete slice
+void TraceEvents::Record( const char* name, const char* cat, uint64_t start, uint64_t end ) {
+	TraceBuffer* buffer = get_buffer( );
+	TraceRecord& rec = buffer->records[ buffer->count % buffer->records.size() ];
+	rec.name	= name;
+	rec.cat		= cat;
+	rec.start	= start;
+	rec.end		= end;
+	++buffer->count;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// write everything recorded so far as trace-event JSON
+void TraceEvents::Flush( ) {
+	if ( !enabled_ ) return;
+	
+	std::ofstream out( trace_path.c_str() );
+	if ( !out ) throw ErrnoException( trace_path );
+	
+	const long pid = getpid( );
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+	
+	pthread_mutex_lock( &trace_mutex );
+	for ( size_t b = 0; b < trace_buffers.size(); ++b ) {
+		const TraceBuffer& buffer = *trace_buffers[b];
+		const uint64_t cap = buffer.records.size();
+		const uint64_t begin = ( buffer.count > cap ) ? buffer.count - cap : 0;
+		
+		for ( uint64_t i = begin; i < buffer.count; ++i ) {
+			const TraceRecord& rec = buffer.records[ i % cap ];
+			out << ( first ? "" : ",\n" ) << std::fixed << std::setprecision(3)
+				<< "{\"name\":\"" << rec.name << "\",\"cat\":\"" << rec.cat << "\",\"ph\":\"X\""
+				<< ",\"ts\":" << rec.start / 1e3 << ",\"dur\":" << ( rec.end - rec.start ) / 1e3
+				<< ",\"pid\":" << pid << ",\"tid\":" << buffer.tid << '}';
+			first = false;
+		}
+	}
+	pthread_mutex_unlock( &trace_mutex );
+	
+	out << "\n]}\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// flush if SIGUSR2 was received
+bool TraceEvents::PollSignal( ) {
+	if ( !trace_signalled ) return false;
+	trace_signalled = 0;
+	
+	Flush( );
+	return true;
+}
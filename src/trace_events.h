@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file trace_events.h
+///
+/// Chrome trace-event (Perfetto) export of event loop activity
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_TRACE_EVENTS
+#define INCLUDED_TRACE_EVENTS
+
+//- includes
+#include <string>
+#include <stdint.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// Chrome trace-event (Perfetto) export of event loop activity
+///
+/// When enabled every TraceScope records begin/end timestamps into a
+/// preallocated per-thread ring buffer (the oldest records are overwritten
+/// once full). The buffers are written out as JSON on exit, or on SIGUSR2
+/// via PollSignal() from the event loop.
+class TraceEvents {
+public:
+	/// start recording (capacity is per thread)
+	static void Enable( const std::string& path, size_t capacity = 65536 );
+	static bool Enabled( ) { return enabled_; }
+	
+	/// record a complete slice
+	static void Record( const char* name, const char* cat, uint64_t start, uint64_t end );
+	
+	/// write everything recorded so far
+	static void Flush( );
+	
+	/// flush if SIGUSR2 was received (returns whether it was)
+	static bool PollSignal( );
+	
+	/// timestamp (CLOCK_MONOTONIC nanoseconds)
+	static uint64_t Now( );
+	
+private:
+	static bool enabled_;	///< recording?
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// records a slice for the lifetime of the object
+class TraceScope {
+public:
+	TraceScope( const char* name, const char* cat )
+		:	name_( name )
+		,	cat_( cat )
+		,	start_( TraceEvents::Enabled() ? TraceEvents::Now() : 0 )
+	{ }
+	~TraceScope( ) {
+		if ( start_ ) TraceEvents::Record( name_, cat_, start_, TraceEvents::Now() );
+	}
+	
+private:
+	const char*	name_;	///< slice name
+	const char*	cat_;	///< slice category
+	uint64_t	start_;	///< when we started (0 if not recording)
+};
+
+#endif // INCLUDED_TRACE_EVENTS
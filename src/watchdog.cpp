@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file watchdog.cpp
+///
+/// hardware watchdog kept alive from the event loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "watchdog.h"
+#include "mediasmartserverd.h"
+#include "trace_events.h"
+#include <iostream>
+#include <stdexcept>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (arms the watchdog, so needs to happen while we are root)
+/// @param secs Seconds without a kick before the board resets
+Watchdog::Watchdog( const LedControlPtr& leds, unsigned int secs )
+	:	Scheduler::Task( secs * 1000000000ULL / 4, secs * 1000000000ULL / 4, 100 )
+	,	leds_( leds )
+	,	kicks_( 0 )
+{
+	if ( !leds_->ArmWatchdog( secs ) ) throw std::runtime_error( std::string( "No watchdog on " ) + leds_->Desc( ) );
+	if ( debug || verbose > 0 ) std::cout << "Watchdog armed (" << secs << "s)\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor (disarms so a clean exit doesn't reset the board)
+///
+/// The scheduler is not touched: it has already finished running (and may
+/// have gone) by the time we are stopping.
+Watchdog::~Watchdog( ) {
+	leds_->DisarmWatchdog( );
+	if ( debug || verbose > 0 ) std::cout << "Watchdog disarmed after " << kicks_ << " kicks\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// start kicking from a scheduler
+void Watchdog::Start( Scheduler& scheduler ) {
+	kick_( );
+	scheduler.Add( this );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// due (the scheduler has either woken up anyway or is running out of slack)
+bool Watchdog::OnTick( uint64_t ) {
+	kick_( );
+	return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// kick
+void Watchdog::kick_( ) {
+	TraceScope scope( "watchdog.kick", "watchdog" );
+	leds_->KickWatchdog( );
+	++kicks_;
+}
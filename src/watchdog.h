@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file watchdog.h
+///
+/// hardware watchdog kept alive from the event loop
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_WATCHDOG
+#define INCLUDED_WATCHDOG
+
+//- includes
+#include "led_control_base.h"
+#include "scheduler.h"
+
+/////////////////////////////////////////////////////////////////////////////
+/// keeps the board's watchdog armed while the daemon is healthy
+///
+/// A scheduler task due a quarter of the timeout after the last kick, with
+/// slack up to half, so kicks ride along on wakeups the loop has anyway
+/// (udev, light show, activity sampling). The scheduler only wakes for us
+/// if nothing else has in that window: an idle daemon costs one wakeup per
+/// half timeout and a busy one none at all.
+class Watchdog : public Scheduler::Task {
+public:
+	/// default seconds without a kick before the board resets
+	static const unsigned int DEFAULT_TIMEOUT = 240;
+	
+	Watchdog( const LedControlPtr& leds, unsigned int secs );
+	~Watchdog( );
+	
+	void Start( Scheduler& scheduler );
+	
+	bool OnTick( uint64_t now );
+	const char* TraceName( ) const { return "watchdog"; }
+	
+	/// kicks so far
+	unsigned long Kicks( ) const { return kicks_; }
+	
+private:
+	// no copying
+	Watchdog( const Watchdog& rhs );
+	const Watchdog& operator=( const Watchdog& rhs );
+	
+	void kick_( );
+	
+	LedControlPtr	leds_;			///< interface owning the watchdog
+	unsigned long	kicks_;			///< kick count
+};
+
+#endif // INCLUDED_WATCHDOG
@@ -0,0 +1,299 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file worker_pool.cpp
+///
+/// worker threads for blocking work, with deadlines and per-disk limits
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+
+//- includes
+#include "worker_pool.h"
+#include "errno_exception.h"
+#include "trace_events.h"
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////////
+/// constructor (starts the threads)
+WorkerPool::WorkerPool( EventLoop& loop, size_t threads )
+	:	loop_( loop )
+	,	event_fd_( -1 )
+	,	thread_cnt_( 0 )
+	,	started_( 0 )
+	,	pending_( 0 )
+	,	pending_cnt_( 0 )
+	,	done_( 0 )
+	,	done_tail_( 0 )
+	,	stop_( false )
+	,	completed_( 0 )
+	,	expired_( 0 )
+	,	cancelled_( 0 )
+	,	rejected_( 0 )
+{
+	for ( size_t i = 0; i < MAX_THREADS; ++i ) busy_[i] = NO_KEY;
+	
+	event_fd_ = eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK );
+	if ( event_fd_ < 0 ) throw ErrnoException( "eventfd" );
+	loop_.Add( event_fd_, this );
+	
+	pthread_mutex_init( &mutex_, 0 );
+	pthread_cond_init( &work_cond_, 0 );
+	pthread_cond_init( &idle_cond_, 0 );
+	
+	threads = std::max( size_t(1), std::min( threads, size_t(MAX_THREADS) ) );
+	for ( ; thread_cnt_ < threads; ++thread_cnt_ ) {
+		const int err = pthread_create( &threads_[ thread_cnt_ ], 0, &WorkerPool::thread_, this );
+		if ( err ) {
+			errno = err;
+			throw ErrnoException( "pthread_create" );
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// destructor (waits for jobs in hand, drops the rest without completing)
+WorkerPool::~WorkerPool( ) {
+	pthread_mutex_lock( &mutex_ );
+	stop_ = true;
+	pthread_cond_broadcast( &work_cond_ );
+	pthread_mutex_unlock( &mutex_ );
+	for ( size_t i = 0; i < thread_cnt_; ++i ) pthread_join( threads_[i], 0 );
+	
+	pthread_cond_destroy( &idle_cond_ );
+	pthread_cond_destroy( &work_cond_ );
+	pthread_mutex_destroy( &mutex_ );
+	
+	if ( Armed() ) loop_.Cancel( this );
+	loop_.Remove( event_fd_ );
+	close( event_fd_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// queue a job (loop thread)
+/// @param key Disk the job talks to (NO_KEY if none)
+/// @param deadline Loop time after which the result is no use
+void WorkerPool::Submit( Job* job, long key, uint64_t deadline ) {
+	pthread_mutex_lock( &mutex_ );
+	job->next_		= 0;
+	job->key_		= key;
+	job->deadline_	= deadline;
+	job->cancel_	= 0;
+	
+	if ( stop_ || pending_cnt_ >= MAX_PENDING ) {
+		finish_( job, Job::REJECTED );
+	} else {
+		job->status_ = Job::QUEUED;
+		Job** tail = &pending_;
+		while ( *tail ) tail = &(*tail)->next_;
+		*tail = job;
+		++pending_cnt_;
+		pthread_cond_signal( &work_cond_ );
+	}
+	pthread_mutex_unlock( &mutex_ );
+	
+	if ( Clock::NEVER != deadline && ( !Armed() || deadline < Deadline() ) ) loop_.Arm( this, deadline );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// ask for a job to be abandoned (loop thread; it still gets Complete())
+void WorkerPool::Cancel( Job* job ) {
+	pthread_mutex_lock( &mutex_ );
+	if ( Job::QUEUED == job->status_ && unlink_( pending_, job ) ) {
+		--pending_cnt_;
+		finish_( job, Job::CANCELLED );
+	} else if ( Job::RUNNING == job->status_ ) {
+		__atomic_store_n( &job->cancel_, 1, __ATOMIC_RELEASE );
+	}
+	pthread_mutex_unlock( &mutex_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// the job is going away: make sure we never touch it again (loop thread)
+///
+/// Waits if it is on a thread right now, so only use this when tearing
+/// down; Complete() isn't called.
+void WorkerPool::Forget( Job* job ) {
+	pthread_mutex_lock( &mutex_ );
+	if ( Job::RUNNING == job->status_ ) {
+		__atomic_store_n( &job->cancel_, 1, __ATOMIC_RELEASE );
+		while ( Job::RUNNING == job->status_ ) pthread_cond_wait( &idle_cond_, &mutex_ );
+	}
+	if ( unlink_( pending_, job ) ) --pending_cnt_;
+	unlink_( done_, job, &done_tail_ );
+	job->status_ = Job::IDLE;
+	pthread_mutex_unlock( &mutex_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// jobs finished on the threads
+void WorkerPool::OnReadable( int ) {
+	uint64_t cnt;
+	if ( read( event_fd_, &cnt, sizeof(cnt) ) < 0 && EAGAIN != errno ) throw ErrnoException( "read" );
+	deliver_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// a deadline passed: drop jobs that are still waiting
+void WorkerPool::OnTimer( uint64_t now ) {
+	uint64_t next = Clock::NEVER;
+	
+	pthread_mutex_lock( &mutex_ );
+	for ( Job** link = &pending_; *link; ) {
+		Job* job = *link;
+		if ( job->deadline_ <= now ) {
+			*link = job->next_;
+			--pending_cnt_;
+			finish_( job, Job::EXPIRED );
+		} else {
+			next = std::min( next, job->deadline_ );
+			link = &job->next_;
+		}
+	}
+	pthread_mutex_unlock( &mutex_ );
+	
+	if ( Clock::NEVER != next ) loop_.Arm( this, next );
+	deliver_( );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void* WorkerPool::thread_( void* arg ) {
+	static_cast< WorkerPool* >( arg )->run_( );
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// worker thread: run jobs until told to stop
+void WorkerPool::run_( ) {
+	pthread_mutex_lock( &mutex_ );
+	const size_t idx = started_++;
+	
+	for ( ;; ) {
+		Job* job = 0;
+		while ( !stop_ && !( job = take_( idx ) ) ) pthread_cond_wait( &work_cond_, &mutex_ );
+		if ( stop_ ) break;
+		pthread_mutex_unlock( &mutex_ );
+		
+		{
+			TraceScope scope( "worker.job", "workers" );
+			job->Run( );
+		}
+		
+		pthread_mutex_lock( &mutex_ );
+		busy_[ idx ] = NO_KEY;
+		finish_( job, ( job->Cancelled( ) ) ? Job::CANCELLED : Job::DONE );
+		
+		// its disk is free for the next job, and Forget may be waiting on it
+		pthread_cond_broadcast( &work_cond_ );
+		pthread_cond_broadcast( &idle_cond_ );
+	}
+	pthread_mutex_unlock( &mutex_ );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// oldest waiting job whose disk isn't busy (mutex held)
+WorkerPool::Job* WorkerPool::take_( size_t idx ) {
+	for ( Job** link = &pending_; *link; link = &(*link)->next_ ) {
+		Job* job = *link;
+		if ( NO_KEY != job->key_ ) {
+			bool busy = false;
+			for ( size_t i = 0; i < thread_cnt_ && !busy; ++i ) busy = ( busy_[i] == job->key_ );
+			if ( busy ) continue;
+		}
+		
+		*link = job->next_;
+		--pending_cnt_;
+		job->status_ = Job::RUNNING;
+		busy_[ idx ] = job->key_;
+		return job;
+	}
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// job is final: hand it to the loop (mutex held)
+void WorkerPool::finish_( Job* job, Job::Status status ) {
+	job->status_ = status;
+	job->next_ = 0;
+	
+	// delivered in the order they finished (per key, that's the order queued)
+	const bool wake = !done_;
+	if ( done_tail_ ) done_tail_->next_ = job;
+	else done_ = job;
+	done_tail_ = job;
+	
+	// one write per batch (the loop drains the whole list)
+	if ( wake ) {
+		const uint64_t one = 1;
+		if ( write( event_fd_, &one, sizeof(one) ) < 0 ) {
+			// only fails with the counter saturated, which wakes the loop anyway
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// call Complete() on everything that is final (loop thread)
+///
+/// One at a time: the rest stay on done_, so a Complete() that destroys
+/// another job's owner can Forget it there.
+void WorkerPool::deliver_( ) {
+	const uint64_t now = loop_.Now( );
+	for ( ;; ) {
+		pthread_mutex_lock( &mutex_ );
+		Job* job = done_;
+		if ( job ) done_ = job->next_;
+		if ( !done_ ) done_tail_ = 0;
+		pthread_mutex_unlock( &mutex_ );
+		if ( !job ) break;
+		
+		// ran, but too late to be of use
+		if ( Job::DONE == job->status_ && job->deadline_ < now ) job->status_ = Job::EXPIRED;
+		
+		switch ( job->status_ ) {
+		case Job::DONE:			++completed_; break;
+		case Job::EXPIRED:		++expired_; break;
+		case Job::CANCELLED:	++cancelled_; break;
+		default:				++rejected_; break;
+		}
+		
+		job->Complete( ); // may resubmit or free it
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// remove a job from a list (mutex held)
+/// @param tail The list's last job, kept up to date (optional)
+bool WorkerPool::unlink_( Job*& list, Job* job, Job** tail ) {
+	Job* prev = 0;
+	for ( Job** link = &list; *link; link = &(*link)->next_ ) {
+		if ( *link == job ) {
+			*link = job->next_;
+			if ( tail && *tail == job ) *tail = prev;
+			return true;
+		}
+		prev = *link;
+	}
+	return false;
+}
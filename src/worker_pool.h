@@ -0,0 +1,160 @@
+/////////////////////////////////////////////////////////////////////////////
+/// @file worker_pool.h
+///
+/// worker threads for blocking work, with deadlines and per-disk limits
+///
+/// -------------------------------------------------------------------------
+///
+/// Copyright (c) 2009-2010 Chris Byrne
+/// 
+/// This software is provided 'as-is', without any express or implied
+/// warranty. In no event will the authors be held liable for any damages
+/// arising from the use of this software.
+/// 
+/// Permission is granted to anyone to use this software for any purpose,
+/// including commercial applications, and to alter it and redistribute it
+/// freely, subject to the following restrictions:
+/// 
+/// 1. The origin of this software must not be misrepresented; you must not
+/// claim that you wrote the original software. If you use this software
+/// in a product, an acknowledgment in the product documentation would be
+/// appreciated but is not required.
+/// 
+/// 2. Altered source versions must be plainly marked as such, and must not
+/// be misrepresented as being the original software.
+/// 
+/// 3. This notice may not be removed or altered from any source
+/// distribution.
+///
+/////////////////////////////////////////////////////////////////////////////
+#ifndef INCLUDED_WORKER_POOL
+#define INCLUDED_WORKER_POOL
+
+//- includes
+#include "event_loop.h"
+#include <pthread.h>
+#include <stdexcept>
+
+/////////////////////////////////////////////////////////////////////////////
+/// small fixed pool of threads the event loop hands blocking work to
+///
+/// SMART queries, statfs on a sleeping mount or a full sysfs scan can take
+/// seconds; run here they only hold up whoever asked, never the LEDs.
+///
+/// - Jobs sharing a key (a disk) run one at a time, so a drive never has
+///   more than one of our commands queued at it.
+/// - A job still waiting when its deadline passes is dropped without
+///   running. One that overruns finishes as expired and its result is
+///   ignored (a thread stuck in the kernel can't be interrupted).
+/// - Cancel works the same way; a long Run() can poll Cancelled().
+/// - Completions come back through an eventfd and Complete() is always
+///   called on the loop thread, exactly once.
+class WorkerPool : public EventLoop::Handler, public EventLoop::Timer {
+public:
+	enum {
+		MAX_THREADS	= 8,	///< most threads a pool can have
+		MAX_PENDING	= 64,	///< jobs waiting beyond this are rejected
+		NO_KEY		= -1,	///< job isn't tied to a disk
+	};
+	
+	/////////////////////////////////////////////////////////////////////////
+	/// a unit of blocking work (owned by the submitter)
+	class Job {
+	public:
+		enum Status {
+			IDLE,		///< not submitted
+			QUEUED,		///< waiting for a thread
+			RUNNING,	///< on a thread
+			DONE,		///< ran to completion
+			CANCELLED,	///< cancelled (before or while running)
+			EXPIRED,	///< deadline passed (before or while running)
+			REJECTED,	///< queue was full
+		};
+		
+		Job( ) : next_( 0 ), key_( NO_KEY ), deadline_( Clock::NEVER ), status_( IDLE ), cancel_( 0 ) { }
+		virtual ~Job( ) { }
+		
+		/// do the work (worker thread)
+		virtual void Run( ) = 0;
+		/// the outcome is known (loop thread)
+		virtual void Complete( ) = 0;
+		
+		/// where it is (only settled on the loop thread once Complete() is called)
+		Status GetStatus( ) const { return status_; }
+		/// asked to stop (poll from long running work)
+		bool Cancelled( ) const { return __atomic_load_n( &cancel_, __ATOMIC_ACQUIRE ); }
+		
+	private:
+		friend class WorkerPool;
+		Job*		next_;		///< list link
+		long		key_;		///< disk (NO_KEY if none)
+		uint64_t	deadline_;	///< loop time it is wanted by
+		Status		status_;	///< where it is
+		int			cancel_;	///< cancellation requested
+	};
+	
+	WorkerPool( EventLoop& loop, size_t threads = 2 );
+	~WorkerPool( );
+	
+	void Submit( Job* job, long key = NO_KEY, uint64_t deadline = Clock::NEVER );
+	void Cancel( Job* job );
+	void Forget( Job* job );
+	
+	void OnReadable( int fd );
+	void OnTimer( uint64_t now );
+	const char* TraceName( ) const { return "workers"; }
+	
+	//- statistics
+	unsigned long Completed( ) const { return completed_; }
+	unsigned long Expired( ) const { return expired_; }
+	unsigned long Cancellations( ) const { return cancelled_; }
+	unsigned long Rejected( ) const { return rejected_; }
+	
+private:
+	// no copying
+	WorkerPool( const WorkerPool& rhs );
+	const WorkerPool& operator=( const WorkerPool& rhs );
+	
+	static void* thread_( void* arg );
+	void run_( );
+	Job* take_( size_t idx );
+	void finish_( Job* job, Job::Status status );
+	void deliver_( );
+	bool unlink_( Job*& list, Job* job, Job** tail = 0 );
+	
+	EventLoop&		loop_;			///< loop completions go to
+	int				event_fd_;		///< completions pending
+	pthread_t		threads_[ MAX_THREADS ];
+	size_t			thread_cnt_;	///< threads created
+	size_t			started_;		///< threads that have picked a busy_ slot
+	long			busy_[ MAX_THREADS ];	///< keys being worked on (NO_KEY if idle)
+	pthread_mutex_t	mutex_;			///< guards everything below
+	pthread_cond_t	work_cond_;		///< work arrived, a key freed up, or stop
+	pthread_cond_t	idle_cond_;		///< a running job finished
+	Job*			pending_;		///< waiting (oldest first)
+	size_t			pending_cnt_;
+	Job*			done_;			///< final, waiting for Complete() (oldest first)
+	Job*			done_tail_;		///< newest on done_ (or NULL)
+	bool			stop_;			///< shutting down
+	unsigned long	completed_;		///< jobs that ran to completion
+	unsigned long	expired_;		///< jobs past their deadline
+	unsigned long	cancelled_;		///< jobs cancelled
+	unsigned long	rejected_;		///< jobs turned away
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// thrown out of co_await CoOffload when the job didn't run to completion
+class JobAborted : public std::runtime_error {
+public:
+	JobAborted( WorkerPool::Job::Status status )
+		:	std::runtime_error( ( WorkerPool::Job::EXPIRED == status ) ? "job expired"
+				: ( WorkerPool::Job::CANCELLED == status ) ? "job cancelled" : "job rejected" )
+		,	status_( status )
+	{ }
+	WorkerPool::Job::Status Status( ) const { return status_; }
+	
+private:
+	WorkerPool::Job::Status status_;
+};
+
+#endif // INCLUDED_WORKER_POOL